@@ -0,0 +1,237 @@
+#include <malloc.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../src/tihijson.h"
+
+// 解析/序列化基准测试
+//
+// 用法: bench [--min-time 秒] [--depth 层数] [--threads 序列化线程数] [文件...]
+// 不指定文件时依次测试 bench/data 下的 twitter.json, canada.json,
+// citm_catalog.json (缺失的跳过) 以及内存中生成的深层嵌套文档.
+// 每个语料输出一行 JSON, 便于脚本收集和对比不同版本的结果.
+
+// 统计堆分配: 替换全局 operator new/delete, 用 malloc_usable_size
+// 跟踪当前存活字节数与峰值
+static bool g_counting = false;
+static uint64_t g_allocs = 0;
+static uint64_t g_alloc_bytes = 0;
+static int64_t g_live_bytes = 0;
+static int64_t g_peak_bytes = 0;
+
+void* operator new(size_t n) {
+    void* p = malloc(n == 0 ? 1 : n);
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    if (g_counting) {
+        ++g_allocs;
+        g_alloc_bytes += n;
+        g_live_bytes += malloc_usable_size(p);
+        if (g_live_bytes > g_peak_bytes) {
+            g_peak_bytes = g_live_bytes;
+        }
+    }
+    return p;
+}
+
+void operator delete(void* p) noexcept {
+    if (p != nullptr && g_counting) {
+        g_live_bytes -= malloc_usable_size(p);
+    }
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept { operator delete(p); }
+
+struct Corpus {
+    std::string name;
+    std::string data;
+};
+
+struct Result {
+    double parse_mb_s = 0;
+    double stringify_mb_s = 0;
+    size_t stringify_bytes = 0;
+    double allocs_per_doc = 0;
+    double alloc_bytes_per_doc = 0;
+    int64_t peak_heap_bytes = 0;
+};
+
+static bool read_file(const std::string& path, std::string& out) {
+    std::ifstream in(path.c_str(), std::ios::binary);
+    if (!in) {
+        return false;
+    }
+    std::stringstream ss;
+    ss << in.rdbuf();
+    out = ss.str();
+    return true;
+}
+
+static std::string base_name(const std::string& path) {
+    size_t pos = path.find_last_of('/');
+    return pos == std::string::npos ? path : path.substr(pos + 1);
+}
+
+// {"a":[{"a":[ ... 0 ... ]}]}, 对象和数组交替嵌套 depth 层
+static std::string make_deep(size_t depth) {
+    std::string s;
+    for (size_t i = 0; i < depth; ++i) {
+        s += (i % 2 == 0) ? "{\"a\":" : "[";
+    }
+    s += "0";
+    for (size_t i = depth; i > 0; --i) {
+        s += ((i - 1) % 2 == 0) ? "}" : "]";
+    }
+    return s;
+}
+
+static double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                         start)
+        .count();
+}
+
+static bool run(const tihi::Json& json, tihi::JsonContxt& context,
+                const Corpus& corpus, double min_time, Result& r) {
+    const double mb = double(corpus.data.size()) / (1 << 20);
+
+    // 单独解析一次, 统计分配次数/字节数和峰值堆占用
+    g_allocs = g_alloc_bytes = 0;
+    g_live_bytes = g_peak_bytes = 0;
+    g_counting = true;
+    tihi::JsonValue::ptr value(new tihi::JsonValue);
+    tihi::Json::STATUS status = json.parse(corpus.data, value, context);
+    g_counting = false;
+    if (status != tihi::Json::PARSE_OK) {
+        std::cerr << corpus.name << ": parse error " << status << std::endl;
+        return false;
+    }
+    r.allocs_per_doc = double(g_allocs);
+    r.alloc_bytes_per_doc = double(g_alloc_bytes);
+    r.peak_heap_bytes = g_peak_bytes;
+
+    size_t iterations = 0;
+    auto start = std::chrono::steady_clock::now();
+    double elapsed = 0;
+    do {
+        tihi::JsonValue::ptr v(new tihi::JsonValue);
+        json.parse(corpus.data, v, context);
+        ++iterations;
+        elapsed = seconds_since(start);
+    } while (elapsed < min_time);
+    r.parse_mb_s = mb * iterations / elapsed;
+
+    std::string out;
+    iterations = 0;
+    start = std::chrono::steady_clock::now();
+    do {
+        json.stringify(out, value, context);
+        ++iterations;
+        elapsed = seconds_since(start);
+    } while (elapsed < min_time);
+    r.stringify_bytes = out.size();
+    r.stringify_mb_s = double(out.size()) / (1 << 20) * iterations / elapsed;
+    return true;
+}
+
+int main(int argc, char** argv) {
+    double min_time = 1.0;
+    size_t depth = 1000;
+    size_t threads = 1;
+    std::vector<std::string> files;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--min-time" && i + 1 < argc) {
+            min_time = atof(argv[++i]);
+        } else if (arg == "--depth" && i + 1 < argc) {
+            depth = strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--threads" && i + 1 < argc) {
+            threads = strtoul(argv[++i], nullptr, 10);
+        } else {
+            files.push_back(arg);
+        }
+    }
+
+    bool use_defaults = files.empty();
+    if (use_defaults) {
+        const std::string dir = TIHIJSON_BENCH_DATA_DIR;
+        files = {dir + "/twitter.json", dir + "/canada.json",
+                 dir + "/citm_catalog.json"};
+    }
+
+    std::vector<Corpus> corpora;
+    for (const auto& f : files) {
+        Corpus c;
+        c.name = base_name(f);
+        if (!read_file(f, c.data)) {
+            std::cerr << "skip " << f << ": cannot open" << std::endl;
+            continue;
+        }
+        corpora.push_back(c);
+    }
+    if (use_defaults) {
+        Corpus c;
+        c.name = "deep_nesting_" + std::to_string(depth);
+        c.data = make_deep(depth);
+        corpora.push_back(c);
+    }
+
+    const tihi::Json json;
+    tihi::JsonContxt context;
+    context.max_depth = depth + 1;
+    context.stringify_threads = threads;
+
+    int ret = 0;
+    for (const auto& c : corpora) {
+        Result r;
+        if (!run(json, context, c, min_time, r)) {
+            ret = 1;
+            continue;
+        }
+        printf(
+            "{\"corpus\":\"%s\",\"bytes\":%zu,\"parse_mb_s\":%.2f,"
+            "\"stringify_mb_s\":%.2f,\"stringify_bytes\":%zu,"
+            "\"allocs_per_doc\":%.0f,\"alloc_bytes_per_doc\":%.0f,"
+            "\"peak_heap_bytes\":%lld}\n",
+            c.name.c_str(), c.data.size(), r.parse_mb_s, r.stringify_mb_s,
+            r.stringify_bytes, r.allocs_per_doc, r.alloc_bytes_per_doc,
+            static_cast<long long>(r.peak_heap_bytes));
+#ifdef TIHIJSON_PROFILE
+        // 各阶段累计统计 (覆盖本语料的全部解析/序列化次数)
+        const tihi::JsonStats& st = context.stats;
+        const std::pair<const char*, const tihi::JsonPhaseStats*> phases[] = {
+            {"whitespace", &st.whitespace}, {"string", &st.string},
+            {"number", &st.number},         {"alloc", &st.alloc},
+            {"insert", &st.insert},         {"stringify", &st.stringify}};
+        printf("{\"corpus\":\"%s\",\"profile\":{", c.name.c_str());
+        for (size_t i = 0; i < sizeof(phases) / sizeof(phases[0]); ++i) {
+            printf("%s\"%s\":{\"ns\":%llu,\"bytes\":%llu,\"calls\":%llu}",
+                   i == 0 ? "" : ",", phases[i].first,
+                   static_cast<unsigned long long>(phases[i].second->ns),
+                   static_cast<unsigned long long>(phases[i].second->bytes),
+                   static_cast<unsigned long long>(phases[i].second->calls));
+        }
+        printf("}}\n");
+        context.stats.reset();
+#endif
+        fflush(stdout);
+    }
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    printf("{\"max_rss_kb\":%ld}\n", usage.ru_maxrss);
+    return ret;
+}
@@ -0,0 +1,87 @@
+#include <stdint.h>
+
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../src/tihijson.h"
+
+// 多线程解析吞吐测试: 所有线程共享同一个 Json, 每个线程使用自己的
+// JsonContxt, 线程数从 1 递增到 CPU 核数, 输出每个线程数下的吞吐
+
+static std::string make_document(size_t records) {
+    std::stringstream ss;
+    ss << '[';
+    for (size_t i = 0; i < records; ++i) {
+        if (i != 0) {
+            ss << ',';
+        }
+        ss << "{\"id\":" << i << ",\"name\":\"user_" << i
+           << "\",\"score\":" << i * 0.5
+           << ",\"tags\":[\"a\",\"b\",\"c\"],\"active\":true,"
+              "\"parent\":null}";
+    }
+    ss << ']';
+    return ss.str();
+}
+
+int main(int argc, char** argv) {
+    size_t records = argc > 1 ? std::stoul(argv[1]) : 2000;
+    size_t iterations = argc > 2 ? std::stoul(argv[2]) : 20;
+    size_t max_threads = std::thread::hardware_concurrency();
+    if (argc > 3) {
+        max_threads = std::stoul(argv[3]);
+    }
+    if (max_threads == 0) {
+        max_threads = 1;
+    }
+
+    const std::string doc = make_document(records);
+    const tihi::Json json;
+
+    double single = 0;
+    for (size_t threads = 1; threads <= max_threads; ++threads) {
+        std::vector<std::thread> workers;
+        std::vector<int> failed(threads, 0);
+
+        auto start = std::chrono::steady_clock::now();
+        for (size_t t = 0; t < threads; ++t) {
+            workers.emplace_back([&, t]() {
+                tihi::JsonContxt context;
+                for (size_t i = 0; i < iterations; ++i) {
+                    tihi::JsonValue::ptr value(new tihi::JsonValue);
+                    if (json.parse(doc, value, context) !=
+                        tihi::Json::PARSE_OK) {
+                        failed[t] = 1;
+                    }
+                }
+            });
+        }
+        for (auto& w : workers) {
+            w.join();
+        }
+        double seconds = std::chrono::duration<double>(
+                             std::chrono::steady_clock::now() - start)
+                             .count();
+
+        for (int f : failed) {
+            if (f) {
+                std::cerr << "parse failed" << std::endl;
+                return 1;
+            }
+        }
+
+        double mb = double(doc.size()) * iterations * threads / (1 << 20);
+        double throughput = mb / seconds;
+        if (threads == 1) {
+            single = throughput;
+        }
+        std::cout << "threads: " << threads << " throughput: " << throughput
+                  << " MB/s speedup: " << throughput / single << std::endl;
+    }
+
+    return 0;
+}
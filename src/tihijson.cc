@@ -1,10 +1,24 @@
 #include "tihijson.h"
+#include "tihijson_utf8.h"
 
 #include <assert.h>
-
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <exception>
 #include <iostream>
-#include <sstream>
+#include <new>
+#include <system_error>
+#include <thread>
 #include <unordered_map>
+#include <unordered_set>
 
 namespace tihi {
 
@@ -21,17 +35,234 @@ namespace tihi {
         assert(expr);                       \
     } while (0)
 
-#define SKIP_WS                                                    \
-    do {                                                           \
-        m_context->curr_pos =                                      \
-            str.find_first_not_of(" \t\r\n", m_context->curr_pos); \
+#ifdef TIHIJSON_PROFILE
+// 作用域结束时把耗时和处理的字节数累加到 stats
+class ProfileScope {
+public:
+    explicit ProfileScope(JsonPhaseStats& stats)
+        : m_stats(stats), m_begin(std::chrono::steady_clock::now()) {}
+    // 以解析位置 pos 的前进量作为处理的字节数, pos 为 npos 时视为 size
+    ProfileScope(JsonPhaseStats& stats, const size_t& pos, size_t size)
+        : m_stats(stats),
+          m_pos(&pos),
+          m_start(pos),
+          m_size(size),
+          m_begin(std::chrono::steady_clock::now()) {}
+
+    ~ProfileScope() {
+        if (m_pos != nullptr) {
+            size_t end = *m_pos == std::string::npos ? m_size : *m_pos;
+            if (end > m_start) {
+                m_stats.bytes += end - m_start;
+            }
+        }
+        ++m_stats.calls;
+        m_stats.ns += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                          std::chrono::steady_clock::now() - m_begin)
+                          .count();
+    }
+
+    void add_bytes(uint64_t n) { m_stats.bytes += n; }
+
+private:
+    JsonPhaseStats& m_stats;
+    const size_t* m_pos = nullptr;
+    size_t m_start = 0;
+    size_t m_size = 0;
+    std::chrono::steady_clock::time_point m_begin;
+};
+
+#define PROFILE_SCOPE(c, phase) ProfileScope profile_scope((c).stats.phase)
+#define PROFILE_PARSE(phase) \
+    ProfileScope profile_scope(ctx.stats.phase, ctx.curr_pos, str.size())
+#define PROFILE_ADD_BYTES(n) profile_scope.add_bytes(n)
+#else
+#define PROFILE_SCOPE(c, phase)
+#define PROFILE_PARSE(phase)
+#define PROFILE_ADD_BYTES(n)
+#endif
+
+#define SKIP_WS                                                            \
+    do {                                                                   \
+        PROFILE_PARSE(whitespace);                                         \
+        ctx.curr_pos = str.find_first_not_of(" \t\r\n", ctx.curr_pos);     \
     } while (0)
 
+void* JsonMallocAllocator::do_allocate(size_t n) {
+    void* p = malloc(n);
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void JsonMallocAllocator::do_deallocate(void* p, size_t) { free(p); }
+
+void* JsonVTableAllocator::do_allocate(size_t n) {
+    void* p = m_vtable.allocate(m_vtable.user, n);
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void JsonVTableAllocator::do_deallocate(void* p, size_t n) {
+    m_vtable.deallocate(m_vtable.user, p, n);
+}
+
+// 解码左引号之后的字符串, 定义在解析部分
+static Json::STATUS decode_chars(const char*& p, const char* end,
+                                 std::string& out);
+
+JsonValue::ptr JsonValue::create(JsonAllocator* alloc) {
+    if (alloc == nullptr) {
+        return std::make_shared<JsonValue>();
+    }
+    return std::allocate_shared<JsonValue>(JsonStlAllocator<JsonValue>(alloc));
+}
+
+JsonValue::JsonValue(const JsonValue& other)
+    : m_type(other.m_type),
+      m_cache_valid(other.m_cache_valid),
+      m_hash_valid(other.m_hash_valid),
+      m_view_escaped(other.m_view_escaped),
+      m_number(other.m_number),
+      m_str(other.m_str),
+      m_view(other.m_view),
+      m_view_size(other.m_view_size),
+      m_vec(other.m_vec),
+      m_packed(other.m_packed),
+      m_obj(other.m_obj),
+      m_cache(other.m_cache ? new std::string(*other.m_cache) : nullptr),
+      m_hash(other.m_hash) {}
+
+JsonValue& JsonValue::operator=(const JsonValue& other) {
+    if (this == &other) {
+        return *this;
+    }
+    touch();
+    release_children();
+    m_type = other.m_type;
+    m_number = other.m_number;
+    m_str = other.m_str;
+    m_view = other.m_view;
+    m_view_size = other.m_view_size;
+    m_view_escaped = other.m_view_escaped;
+    m_vec = other.m_vec;
+    m_packed = other.m_packed;
+    m_obj = other.m_obj;
+    return *this;
+}
+
+JsonValue::~JsonValue() {
+    drop_expanded();
+    // 逐层释放子节点, 避免深层嵌套时析构递归过深
+    std::vector<ptr> pending;
+    take_children(pending);
+    while (!pending.empty()) {
+        ptr p = std::move(pending.back());
+        pending.pop_back();
+        if (p.use_count() == 1) {
+            p->take_children(pending);
+        }
+    }
+}
+
+void JsonValue::take_children(std::vector<ptr>& out) {
+    // 被共享的子节点可能比本节点活得更久
+    release_children();
+    for (auto& v : m_vec) {
+        if (v && (!v->m_vec.empty() || !v->m_obj.empty())) {
+            out.push_back(std::move(v));
+        }
+    }
+    for (auto& p : m_obj) {
+        if (p.second &&
+            (!p.second->m_vec.empty() || !p.second->m_obj.empty())) {
+            out.push_back(std::move(p.second));
+        }
+    }
+}
+
+const JsonValue::Expanded& JsonValue::expanded() const {
+    Expanded* e = m_expanded.load(std::memory_order_acquire);
+    if (e != nullptr) {
+        return *e;
+    }
+    std::unique_ptr<Expanded> created(new Expanded);
+    if (m_type == JSON_ARRAY) {
+        created->vec.reserve(m_packed.size());
+        for (double d : m_packed) {
+            created->vec.push_back(create());
+            created->vec.back()->m_type = JSON_NUMBER;
+            created->vec.back()->m_number = d;
+        }
+    } else {
+        size_t size = 0;
+        const char* data = str_bytes(created->str, size);
+        if (data != created->str.data()) {
+            created->str.assign(data, size);
+        }
+    }
+    // 其他线程先创建时使用它的结果
+    if (m_expanded.compare_exchange_strong(e, created.get(),
+                                           std::memory_order_acq_rel,
+                                           std::memory_order_acquire)) {
+        e = created.release();
+    }
+    return *e;
+}
+
+void JsonValue::drop_expanded() {
+    delete m_expanded.exchange(nullptr, std::memory_order_acquire);
+}
+
+void JsonValue::touch() {
+    drop_expanded();
+    // 有效的节点其子节点必然有效, 所以遇到已失效的祖先即可停止
+    for (JsonValue* p = this;
+         p != nullptr && (p->m_cache_valid || p->m_hash_valid);
+         p = p->m_parent) {
+        p->m_cache_valid = false;
+        p->m_hash_valid = false;
+        p->m_cache.reset();
+    }
+}
+
+void JsonValue::release_children() {
+    for (auto& v : m_vec) {
+        if (v && v->m_parent == this) {
+            v->m_parent = nullptr;
+        }
+    }
+    for (auto& p : m_obj) {
+        if (p.second && p.second->m_parent == this) {
+            p.second->m_parent = nullptr;
+        }
+    }
+}
+
+void JsonValue::replace_child(ptr& slot, ptr v) {
+    touch();
+    if (slot && slot->m_parent == this) {
+        slot->m_parent = nullptr;
+    }
+    slot = std::move(v);
+    if (slot) {
+        slot->m_parent = this;
+    }
+}
+
 int JsonValue::get_type() const { return m_type; }
 
 void JsonValue::set_type(Type v) {
+    touch();
+    release_children();
     std::string().swap(m_str);
+    m_view = nullptr;
     std::vector<ptr>().swap(m_vec);
+    std::vector<double>().swap(m_packed);
+    std::unordered_map<std::string, ptr>().swap(m_obj);
     m_type = v;
 }
 
@@ -40,46 +271,194 @@ double JsonValue::get_number() const {
     return m_number;
 }
 void JsonValue::set_number(double v) {
+    touch();
+    release_children();
     m_type = JSON_NUMBER;
     std::string().swap(m_str);
+    m_view = nullptr;
     std::vector<ptr>().swap(m_vec);
+    std::vector<double>().swap(m_packed);
+    std::unordered_map<std::string, ptr>().swap(m_obj);
     m_number = v;
 }
 
 const std::string& JsonValue::get_str() const {
     ASSERT2(m_type == JSON_STRING, "类型错误");
+    if (m_view != nullptr) {
+        // 输入可能被多个线程共享读取, 不能就地复制
+        return expanded().str;
+    }
     return m_str;
 }
-void JsonValue::set_str(const std::string v) {
+void JsonValue::set_str(const std::string& v) {
+    touch();
+    release_children();
     m_type = JSON_STRING;
     std::vector<ptr>().swap(m_vec);
+    std::vector<double>().swap(m_packed);
+    std::unordered_map<std::string, ptr>().swap(m_obj);
+    m_view = nullptr;
     m_str = v;
 }
+void JsonValue::set_str(std::string&& v) {
+    touch();
+    release_children();
+    m_type = JSON_STRING;
+    std::vector<ptr>().swap(m_vec);
+    std::vector<double>().swap(m_packed);
+    std::unordered_map<std::string, ptr>().swap(m_obj);
+    m_view = nullptr;
+    m_str = std::move(v);
+}
 
 size_t JsonValue::get_str_size() const {
     ASSERT2(m_type == JSON_STRING, "类型错误");
-    return m_str.size();
+    if (m_view != nullptr && !m_view_escaped) {
+        return m_view_size;
+    }
+    return get_str().size();
+}
+
+const char* JsonValue::get_str_data() const {
+    ASSERT2(m_type == JSON_STRING, "类型错误");
+    if (m_view != nullptr && !m_view_escaped) {
+        return m_view;
+    }
+    return get_str().data();
+}
+
+bool JsonValue::is_borrowed() const { return m_view != nullptr; }
+
+void JsonValue::own_str() {
+    if (m_view == nullptr) {
+        return;
+    }
+    drop_expanded();
+    if (m_view_escaped) {
+        // 解析时已经检查过语法, 右引号紧跟在 m_view 之后
+        const char* p = m_view;
+        decode_chars(p, m_view + m_view_size + 1, m_str);
+    } else {
+        m_str.assign(m_view, m_view_size);
+    }
+    m_view = nullptr;
+}
+
+const char* JsonValue::str_bytes(std::string& tmp, size_t& size) const {
+    if (m_view == nullptr) {
+        size = m_str.size();
+        return m_str.data();
+    }
+    if (m_view_escaped) {
+        const char* p = m_view;
+        decode_chars(p, m_view + m_view_size + 1, tmp);
+        size = tmp.size();
+        return tmp.data();
+    }
+    size = m_view_size;
+    return m_view;
 }
 
 const std::vector<JsonValue::ptr>& JsonValue::get_vec() const {
     ASSERT2(m_type == JSON_ARRAY, "类型错误");
-    return m_vec;
+    if (m_packed.empty()) {
+        return m_vec;
+    }
+    // 打包的数组可能被多个文档共享, 不能就地展开
+    return expanded().vec;
 }
 
-void JsonValue::set_vec(const std::vector<JsonValue::ptr> v) {
+void JsonValue::set_vec(const std::vector<JsonValue::ptr>& v) {
+    set_vec(std::vector<JsonValue::ptr>(v));
+}
+
+void JsonValue::set_vec(std::vector<JsonValue::ptr>&& v) {
+    touch();
+    release_children();
     m_type = JSON_ARRAY;
     std::string().swap(m_str);
-    m_vec = v;
+    m_view = nullptr;
+    std::vector<double>().swap(m_packed);
+    std::unordered_map<std::string, ptr>().swap(m_obj);
+    m_vec = std::move(v);
+    for (auto& c : m_vec) {
+        if (c) {
+            c->m_parent = this;
+        }
+    }
 }
 
 size_t JsonValue::get_vec_size() const {
     ASSERT2(m_type == JSON_ARRAY, "类型错误");
-    return m_vec.size();
+    return m_packed.empty() ? m_vec.size() : m_packed.size();
 }
 
 void JsonValue::push_back_vec(JsonValue::ptr v) {
+    touch();
+    unpack();
+    m_type = JsonValue::JSON_ARRAY;
+    if (v) {
+        v->m_parent = this;
+    }
+    m_vec.push_back(std::move(v));
+}
+
+void JsonValue::reserve_vec(size_t n) {
+    touch();
+    unpack();
+    m_type = JsonValue::JSON_ARRAY;
+    m_vec.reserve(n);
+}
+
+JsonValue& JsonValue::emplace_back(JsonAllocator* alloc) {
+    touch();
+    unpack();
     m_type = JsonValue::JSON_ARRAY;
-    m_vec.push_back(v);
+    m_vec.push_back(create(alloc));
+    JsonValue& child = *m_vec.back();
+    child.m_type = JSON_NULL;
+    child.m_parent = this;
+    return child;
+}
+
+bool JsonValue::is_packed() const {
+    return m_type == JSON_ARRAY && !m_packed.empty();
+}
+
+const std::vector<double>& JsonValue::get_packed() const {
+    ASSERT2(m_type == JSON_ARRAY, "类型错误");
+    return m_packed;
+}
+
+void JsonValue::set_packed(const std::vector<double>& v) {
+    set_packed(std::vector<double>(v));
+}
+
+void JsonValue::set_packed(std::vector<double>&& v) {
+    touch();
+    release_children();
+    m_type = JSON_ARRAY;
+    std::string().swap(m_str);
+    m_view = nullptr;
+    std::vector<ptr>().swap(m_vec);
+    std::unordered_map<std::string, ptr>().swap(m_obj);
+    m_packed = std::move(v);
+}
+
+void JsonValue::unpack() {
+    if (m_packed.empty()) {
+        return;
+    }
+    drop_expanded();
+    m_vec.reserve(m_packed.size());
+    for (double d : m_packed) {
+        m_vec.push_back(create());
+        JsonValue& child = *m_vec.back();
+        child.m_type = JSON_NUMBER;
+        child.m_number = d;
+        child.m_parent = this;
+    }
+    std::vector<double>().swap(m_packed);
 }
 
 const std::unordered_map<std::string, JsonValue::ptr>& JsonValue::get_obj()
@@ -88,77 +467,1187 @@ const std::unordered_map<std::string, JsonValue::ptr>& JsonValue::get_obj()
     return m_obj;
 }
 
-void JsonValue::set_obj(const std::unordered_map<std::string, ptr> v) {
+void JsonValue::set_obj(const std::unordered_map<std::string, ptr>& v) {
+    set_obj(std::unordered_map<std::string, ptr>(v));
+}
+
+void JsonValue::set_obj(std::unordered_map<std::string, ptr>&& v) {
+    touch();
+    release_children();
     m_type = JSON_OBJECT;
     std::string().swap(m_str);
+    m_view = nullptr;
     std::vector<JsonValue::ptr>().swap(m_vec);
-    m_obj = v;
+    std::vector<double>().swap(m_packed);
+    m_obj = std::move(v);
+    for (auto& p : m_obj) {
+        if (p.second) {
+            p.second->m_parent = this;
+        }
+    }
+}
+
+size_t JsonValue::get_obj_size() const {
+    ASSERT2(m_type == JSON_OBJECT, "类型错误");
+    return m_obj.size();
+}
+
+void JsonValue::insert_obj(const std::string& k, JsonValue::ptr v) {
+    m_type = JSON_OBJECT;
+    replace_child(m_obj[k], std::move(v));
+}
+
+void JsonValue::insert_obj(std::string&& k, JsonValue::ptr v) {
+    m_type = JSON_OBJECT;
+    replace_child(m_obj[std::move(k)], std::move(v));
+}
+
+void JsonValue::reserve_obj(size_t n) {
+    touch();
+    m_type = JSON_OBJECT;
+    m_obj.reserve(n);
+}
+
+JsonValue& JsonValue::emplace(const std::string& k, JsonAllocator* alloc) {
+    return emplace(std::string(k), alloc);
+}
+
+JsonValue& JsonValue::emplace(std::string&& k, JsonAllocator* alloc) {
+    m_type = JSON_OBJECT;
+    ptr& slot = m_obj[std::move(k)];
+    replace_child(slot, create(alloc));
+    slot->m_type = JSON_NULL;
+    return *slot;
+}
+
+const JsonValue::ptr JsonValue::get_value_from_obj_by_string(
+    const std::string& s) const {
+    ASSERT2(m_type == JSON_OBJECT, "类型错误");
+    auto it = m_obj.find(s);
+    return it == m_obj.end() ? nullptr : it->second;
+}
+
+static const JsonValue::ptr NULL_VALUE;
+
+const JsonValue::ptr& JsonValue::get(const JsonKey& key) const {
+    ASSERT2(m_type == JSON_OBJECT, "类型错误");
+    auto it = m_obj.find(key.str());
+    return it == m_obj.end() ? NULL_VALUE : it->second;
+}
+
+size_t JsonValue::get(const JsonKey* keys, size_t n, JsonValue** out) const {
+    size_t found = 0;
+    for (size_t i = 0; i < n; ++i) {
+        out[i] = get(keys[i]).get();
+        if (out[i] != nullptr) {
+            ++found;
+        }
+    }
+    return found;
+}
+
+static uint64_t hash_mix(uint64_t h) {
+    h ^= h >> 30;
+    h *= 0xbf58476d1ce4e5b9ULL;
+    h ^= h >> 27;
+    h *= 0x94d049bb133111ebULL;
+    h ^= h >> 31;
+    return h;
+}
+
+static uint64_t hash_combine(uint64_t seed, uint64_t v) {
+    return hash_mix(seed ^ (v + 0x9e3779b97f4a7c15ULL + (seed << 6) +
+                            (seed >> 2)));
+}
+
+// 数字节点的哈希, 打包的元素按同样的方式计算
+static uint64_t number_hash(double d) {
+    // 0 与 -0 相等, 哈希也要相同
+    d = d == 0 ? 0.0 : d;
+    uint64_t bits;
+    memcpy(&bits, &d, sizeof(bits));
+    return hash_combine(hash_mix(JsonValue::JSON_NUMBER), bits);
+}
+
+// 字符串值的哈希, 直接作用于字节, 借用的字符串不必先复制
+static uint64_t bytes_hash(const char* p, size_t size) {
+    uint64_t h = hash_mix(size);
+    for (; size >= 8; p += 8, size -= 8) {
+        uint64_t w;
+        memcpy(&w, p, sizeof(w));
+        h = hash_combine(h, w);
+    }
+    uint64_t tail = 0;
+    memcpy(&tail, p, size);
+    return hash_combine(h, tail);
+}
+
+size_t JsonValue::hash() const {
+    if (m_hash_valid) {
+        return m_hash;
+    }
+
+    // 后序遍历, 避免深层嵌套时递归过深; second 为子节点是否已经入栈
+    std::vector<std::pair<const JsonValue*, bool>> pending;
+    pending.emplace_back(this, false);
+    while (!pending.empty()) {
+        const JsonValue* v = pending.back().first;
+        if (v->m_hash_valid) {
+            pending.pop_back();
+            continue;
+        }
+        if (pending.back().second) {
+            pending.pop_back();
+            v->compute_hash();
+            continue;
+        }
+        pending.back().second = true;
+        for (const auto& c : v->m_vec) {
+            if (c && !c->m_hash_valid) {
+                pending.emplace_back(c.get(), false);
+            }
+        }
+        for (const auto& p : v->m_obj) {
+            if (p.second && !p.second->m_hash_valid) {
+                pending.emplace_back(p.second.get(), false);
+            }
+        }
+    }
+    return m_hash;
+}
+
+void JsonValue::compute_hash() const {
+    uint64_t h = hash_mix(m_type);
+    switch (m_type) {
+        case JSON_NUMBER:
+            h = number_hash(m_number);
+            break;
+        case JSON_STRING: {
+            std::string tmp;
+            size_t size;
+            const char* data = str_bytes(tmp, size);
+            h = hash_combine(h, bytes_hash(data, size));
+            break;
+        }
+        case JSON_ARRAY:
+            for (double d : m_packed) {
+                h = hash_combine(h, number_hash(d));
+            }
+            for (const auto& v : m_vec) {
+                h = hash_combine(h, v ? v->m_hash : 0);
+            }
+            break;
+        case JSON_OBJECT: {
+            // 成员哈希求和, 与遍历顺序无关
+            uint64_t sum = 0;
+            for (const auto& p : m_obj) {
+                sum += hash_combine(std::hash<std::string>()(p.first),
+                                    p.second ? p.second->m_hash : 0);
+            }
+            h = hash_combine(hash_combine(h, sum), m_obj.size());
+            break;
+        }
+        default:
+            break;
+    }
+
+    m_hash = static_cast<size_t>(h);
+    m_hash_valid = true;
+}
+
+// 打包的数组与普通数组逐个比较元素
+static bool packed_equals(const std::vector<double>& packed,
+                          const std::vector<JsonValue::ptr>& vec) {
+    if (packed.size() != vec.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < vec.size(); ++i) {
+        if (vec[i] == nullptr ||
+            vec[i]->get_type() != JsonValue::JSON_NUMBER ||
+            vec[i]->get_number() != packed[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool JsonValue::equals(const JsonValue& other) const {
+    // 逐对比较, 避免深层嵌套时递归过深
+    std::vector<std::pair<const JsonValue*, const JsonValue*>> pending;
+    pending.emplace_back(this, &other);
+    while (!pending.empty()) {
+        const JsonValue* a = pending.back().first;
+        const JsonValue* b = pending.back().second;
+        pending.pop_back();
+        if (a == b) {
+            continue;
+        }
+        if (a == nullptr || b == nullptr || !a->equals_node(*b, pending)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool JsonValue::equals_node(
+    const JsonValue& other,
+    std::vector<std::pair<const JsonValue*, const JsonValue*>>& pending)
+    const {
+    if (m_type != other.m_type || hash() != other.hash()) {
+        return false;
+    }
+
+    switch (m_type) {
+        case JSON_NUMBER:
+            return m_number == other.m_number;
+        case JSON_STRING: {
+            std::string tmp, other_tmp;
+            size_t size, other_size;
+            const char* data = str_bytes(tmp, size);
+            const char* other_data = other.str_bytes(other_tmp, other_size);
+            return size == other_size && memcmp(data, other_data, size) == 0;
+        }
+        case JSON_ARRAY:
+            if (!m_packed.empty() || !other.m_packed.empty()) {
+                if (!m_packed.empty() && !other.m_packed.empty()) {
+                    return m_packed == other.m_packed;
+                }
+                return m_packed.empty() ? packed_equals(other.m_packed, m_vec)
+                                        : packed_equals(m_packed, other.m_vec);
+            }
+            if (m_vec.size() != other.m_vec.size()) {
+                return false;
+            }
+            for (size_t i = 0; i < m_vec.size(); ++i) {
+                pending.emplace_back(m_vec[i].get(), other.m_vec[i].get());
+            }
+            return true;
+        case JSON_OBJECT:
+            if (m_obj.size() != other.m_obj.size()) {
+                return false;
+            }
+            for (const auto& p : m_obj) {
+                auto it = other.m_obj.find(p.first);
+                if (it == other.m_obj.end()) {
+                    return false;
+                }
+                pending.emplace_back(p.second.get(), it->second.get());
+            }
+            return true;
+        default:
+            return true;
+    }
+}
+
+bool JsonValue::accept(JsonHandler& handler) const {
+    switch (m_type) {
+        case JSON_NULL:
+            return handler.null();
+        case JSON_FALSE:
+            return handler.boolean(false);
+        case JSON_TRUE:
+            return handler.boolean(true);
+        case JSON_NUMBER:
+            return handler.number(m_number);
+        case JSON_STRING:
+            if (m_view != nullptr) {
+                // 借用的字符串复制到临时串中交给 handler, 不修改节点
+                std::string tmp;
+                if (!m_view_escaped) {
+                    tmp.assign(m_view, m_view_size);
+                } else {
+                    const char* p = m_view;
+                    decode_chars(p, m_view + m_view_size + 1, tmp);
+                }
+                return handler.string(tmp);
+            }
+            return handler.string(m_str);
+        case JSON_ARRAY:
+            if (!handler.start_array()) {
+                return false;
+            }
+            for (double d : m_packed) {
+                if (!handler.number(d)) {
+                    return false;
+                }
+            }
+            for (const auto& v : m_vec) {
+                if (v ? !v->accept(handler) : !handler.null()) {
+                    return false;
+                }
+            }
+            return handler.end_array();
+        case JSON_OBJECT:
+            if (!handler.start_object()) {
+                return false;
+            }
+            for (const auto& p : m_obj) {
+                if (!handler.key(p.first)) {
+                    return false;
+                }
+                if (p.second ? !p.second->accept(handler) : !handler.null()) {
+                    return false;
+                }
+            }
+            return handler.end_object();
+        default:
+            return false;
+    }
+}
+
+// 按 RFC 6901 把 pointer 拆成 token, 处理 ~1 -> '/' 和 ~0 -> '~'
+static bool split_pointer(const std::string& pointer,
+                          std::vector<std::string>& tokens) {
+    tokens.clear();
+    if (pointer.empty()) {
+        return true;
+    }
+    if (pointer[0] != '/') {
+        return false;
+    }
+
+    for (size_t i = 0; i < pointer.size(); ++i) {
+        char c = pointer[i];
+        if (c == '/') {
+            tokens.emplace_back();
+        } else if (c == '~') {
+            if (i + 1 >= pointer.size() ||
+                (pointer[i + 1] != '0' && pointer[i + 1] != '1')) {
+                return false;
+            }
+            tokens.back().push_back(pointer[++i] == '0' ? '~' : '/');
+        } else {
+            tokens.back().push_back(c);
+        }
+    }
+    return true;
+}
+
+static bool parse_index(const std::string& token, size_t& index) {
+    if (token.empty() || (token.size() > 1 && token[0] == '0')) {
+        return false;
+    }
+    index = 0;
+    for (char c : token) {
+        if (c < '0' || c > '9') {
+            return false;
+        }
+        index = index * 10 + (c - '0');
+    }
+    return true;
+}
+
+// std::string 的堆内存 (容量 + 结尾的 '\0'), 短字符串存放在对象内时为 0
+static size_t string_heap(const std::string& s) {
+    const char* p = s.data();
+    const char* self = reinterpret_cast<const char*>(&s);
+    if (p >= self && p < self + sizeof(s)) {
+        return 0;
+    }
+    return s.capacity() + 1;
+}
+
+static void count_string(JsonMemoryUsage& usage, const std::string& s) {
+    size_t heap = string_heap(s);
+    if (heap > 0) {
+        usage.strings += s.size() + 1;
+        usage.slack += heap - s.size() - 1;
+    }
+}
+
+JsonMemoryUsage JsonValue::memory_usage() const {
+    using Object = std::unordered_map<std::string, ptr>;
+    // 哈希表节点: 成员本身, next 指针和缓存的哈希值
+    const size_t kHashNode =
+        sizeof(Object::value_type) + sizeof(void*) + sizeof(size_t);
+    // make_shared 的控制块: 虚表指针和两个计数
+    const size_t kControlBlock = sizeof(void*) + 2 * sizeof(int);
+
+    JsonMemoryUsage usage;
+    std::unordered_set<const JsonValue*> shared;
+    std::vector<const JsonValue*> pending(1, this);
+    auto visit = [&](const ptr& child) {
+        if (child && (child.use_count() == 1 ||
+                      shared.insert(child.get()).second)) {
+            pending.push_back(child.get());
+        }
+    };
+    while (!pending.empty()) {
+        const JsonValue& v = *pending.back();
+        pending.pop_back();
+
+        ++usage.node_count;
+        usage.nodes += sizeof(JsonValue) + kControlBlock;
+        count_string(usage, v.m_str);
+
+        usage.containers += v.m_vec.size() * sizeof(ptr);
+        usage.slack += (v.m_vec.capacity() - v.m_vec.size()) * sizeof(ptr);
+        usage.containers += v.m_packed.size() * sizeof(double);
+        usage.slack +=
+            (v.m_packed.capacity() - v.m_packed.size()) * sizeof(double);
+
+        size_t buckets = v.m_obj.bucket_count();
+        // 只有一个桶时 libstdc++ 使用对象内的单个桶, 不分配
+        if (buckets > 1) {
+            size_t used = std::min(buckets, v.m_obj.size());
+            usage.hash_tables += used * sizeof(void*);
+            usage.slack += (buckets - used) * sizeof(void*);
+        }
+        usage.hash_tables += v.m_obj.size() * kHashNode;
+        for (const auto& p : v.m_obj) {
+            count_string(usage, p.first);
+        }
+
+        if (v.m_cache) {
+            usage.caches += sizeof(std::string) + string_heap(*v.m_cache);
+        }
+        const Expanded* e = v.m_expanded.load(std::memory_order_acquire);
+        if (e != nullptr) {
+            usage.caches += sizeof(Expanded) + string_heap(e->str) +
+                            e->vec.size() * (sizeof(ptr) + sizeof(JsonValue) +
+                                             kControlBlock);
+        }
+
+        for (const auto& c : v.m_vec) {
+            visit(c);
+        }
+        for (const auto& p : v.m_obj) {
+            visit(p.second);
+        }
+    }
+    return usage;
+}
+
+void JsonValue::shrink() {
+    own_str();
+    m_str.shrink_to_fit();
+    m_vec.shrink_to_fit();
+    m_packed.shrink_to_fit();
+    if (m_cache) {
+        m_cache->shrink_to_fit();
+    }
+    if (!m_obj.empty() || m_obj.bucket_count() > 1) {
+        // key 不能原地修改, 重新建表才能收缩 key 和桶数组
+        std::unordered_map<std::string, ptr> obj;
+        obj.reserve(m_obj.size());
+        for (auto& p : m_obj) {
+            obj.emplace(std::string(p.first.data(), p.first.size()),
+                        std::move(p.second));
+        }
+        m_obj.swap(obj);
+    }
+}
+
+void JsonValue::compact(JsonAllocator* alloc) {
+    // 待处理的节点及其移动前的地址, 子节点的父指针可能还指向旧地址
+    std::vector<std::pair<JsonValue*, const JsonValue*>> pending;
+    std::unordered_set<const JsonValue*> shared;
+    pending.emplace_back(this, this);
+
+    auto visit = [&](JsonValue* parent, const JsonValue* old_parent,
+                     ptr& slot) {
+        if (!slot) {
+            return;
+        }
+        if (slot->m_parent == old_parent) {
+            slot->m_parent = parent;
+        }
+        if (slot.use_count() > 1) {
+            if (shared.insert(slot.get()).second) {
+                pending.emplace_back(slot.get(), slot.get());
+            }
+            return;
+        }
+        // 只被父节点持有: 移到新分配的节点中
+        JsonValue& from = *slot;
+        ptr to = create(alloc);
+        to->m_type = from.m_type;
+        to->m_cache_valid = from.m_cache_valid;
+        to->m_hash_valid = from.m_hash_valid;
+        to->m_number = from.m_number;
+        to->m_str.swap(from.m_str);
+        to->m_view = from.m_view;
+        to->m_view_size = from.m_view_size;
+        to->m_view_escaped = from.m_view_escaped;
+        to->m_vec.swap(from.m_vec);
+        to->m_packed.swap(from.m_packed);
+        to->m_obj.swap(from.m_obj);
+        to->m_cache.swap(from.m_cache);
+        to->m_hash = from.m_hash;
+        to->m_parent = parent;
+        pending.emplace_back(to.get(), &from);
+        slot = std::move(to);
+    };
+
+    while (!pending.empty()) {
+        JsonValue* v = pending.back().first;
+        const JsonValue* old = pending.back().second;
+        pending.pop_back();
+        v->shrink();
+        for (auto& c : v->m_vec) {
+            visit(v, old, c);
+        }
+        for (auto& p : v->m_obj) {
+            visit(v, old, p.second);
+        }
+    }
+}
+
+// 被其他文档 (或调用方) 共享时换成浅拷贝, 子节点继续共享
+void JsonDocument::make_unique(JsonValue::ptr& slot, JsonValue* parent) {
+    if (slot.use_count() > 1) {
+        // 共享的节点可能正被其他线程读取, 不写它. 例外是它记录的父节点
+        // 正是本文档独占的 parent (如调用方另外持有它的指针), 此时断开
+        // 这条即将失效的链接; 文档之间共享的根和子树不会满足这个条件
+        if (parent != nullptr && slot->m_parent == parent) {
+            slot->m_parent = nullptr;
+        }
+        slot = std::make_shared<JsonValue>(*slot);
+    }
+    // 共享期间父指针可能指向其他文档中的节点
+    slot->m_parent = parent;
+}
+
+JsonValue::ptr JsonDocument::find(const std::string& pointer) const {
+    std::vector<std::string> tokens;
+    if (!split_pointer(pointer, tokens)) {
+        return nullptr;
+    }
+
+    JsonValue::ptr node = m_root;
+    for (const auto& token : tokens) {
+        size_t index = 0;
+        if (node->m_type == JsonValue::JSON_OBJECT) {
+            auto it = node->m_obj.find(token);
+            if (it == node->m_obj.end()) {
+                return nullptr;
+            }
+            node = it->second;
+        } else if (node->m_type == JsonValue::JSON_ARRAY &&
+                   parse_index(token, index) &&
+                   index < node->get_vec_size()) {
+            // 打包的数组不展开, 返回另外展开的元素, 见 get_vec()
+            node = node->get_vec()[index];
+        } else {
+            return nullptr;
+        }
+    }
+    return node;
+}
+
+JsonValue::ptr JsonDocument::mutate(const std::string& pointer) {
+    std::vector<std::string> tokens;
+    if (!split_pointer(pointer, tokens)) {
+        return nullptr;
+    }
+
+    // 先确认路径存在, 避免路径无效时白白复制
+    if (find(pointer) == nullptr) {
+        return nullptr;
+    }
+
+    JsonValue::ptr* slot = &m_root;
+    make_unique(*slot, nullptr);
+    for (const auto& token : tokens) {
+        JsonValue& node = **slot;
+        if (node.m_type == JsonValue::JSON_OBJECT) {
+            slot = &node.m_obj.find(token)->second;
+        } else {
+            size_t index = 0;
+            parse_index(token, index);
+            node.unpack();
+            slot = &node.m_vec[index];
+        }
+        make_unique(*slot, &node);
+    }
+    return *slot;
+}
+
+bool JsonDocument::set(const std::string& pointer, JsonValue::ptr value) {
+    if (pointer.empty()) {
+        m_root = value;
+        return true;
+    }
+
+    size_t pos = pointer.find_last_of('/');
+    if (pos == std::string::npos) {
+        return false;
+    }
+    std::vector<std::string> tokens;
+    if (!split_pointer(pointer.substr(pos), tokens)) {
+        return false;
+    }
+    const std::string& last = tokens[0];
+
+    std::string parent_pointer = pointer.substr(0, pos);
+    int parent_type = 0;
+    size_t parent_size = 0;
+    {
+        // 只在这个作用域内持有父节点, 以免多出的引用使 mutate() 复制它
+        JsonValue::ptr parent = find(parent_pointer);
+        if (parent == nullptr) {
+            return false;
+        }
+        parent_type = parent->m_type;
+        parent_size = parent_type == JsonValue::JSON_ARRAY
+                          ? parent->get_vec_size()
+                          : 0;
+    }
+
+    size_t index = 0;
+    if (parent_type == JsonValue::JSON_OBJECT) {
+        mutate(parent_pointer)->insert_obj(last, value);
+    } else if (parent_type == JsonValue::JSON_ARRAY && last == "-") {
+        mutate(parent_pointer)->push_back_vec(value);
+    } else if (parent_type == JsonValue::JSON_ARRAY &&
+               parse_index(last, index) && index < parent_size) {
+        JsonValue::ptr parent = mutate(parent_pointer);
+        parent->unpack();
+        parent->replace_child(parent->m_vec[index], value);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+JsonBuilder::JsonBuilder(JsonAllocator* alloc)
+    : m_alloc(alloc), m_has_key(false) {}
+
+JsonValue& JsonBuilder::next() {
+    if (m_stack.empty()) {
+        ASSERT2(m_root == nullptr, "文档已经完成");
+        m_root = JsonValue::create(m_alloc);
+        m_root->set_type(JsonValue::JSON_NULL);
+        return *m_root;
+    }
+    JsonValue* top = m_stack.back();
+    if (top->get_type() == JsonValue::JSON_ARRAY) {
+        return top->emplace_back(m_alloc);
+    }
+    ASSERT2(m_has_key, "对象成员缺少键");
+    m_has_key = false;
+    return top->emplace(std::move(m_key), m_alloc);
+}
+
+JsonBuilder& JsonBuilder::null() {
+    next();
+    return *this;
+}
+
+JsonBuilder& JsonBuilder::boolean(bool v) {
+    next().set_type(v ? JsonValue::JSON_TRUE : JsonValue::JSON_FALSE);
+    return *this;
+}
+
+JsonBuilder& JsonBuilder::number(double v) {
+    next().set_number(v);
+    return *this;
+}
+
+JsonBuilder& JsonBuilder::string(const std::string& v) {
+    next().set_str(v);
+    return *this;
+}
+
+JsonBuilder& JsonBuilder::string(std::string&& v) {
+    next().set_str(std::move(v));
+    return *this;
+}
+
+JsonBuilder& JsonBuilder::start_array(size_t reserve) {
+    JsonValue& v = next();
+    v.set_vec(std::vector<JsonValue::ptr>());
+    v.reserve_vec(reserve);
+    m_stack.push_back(&v);
+    return *this;
+}
+
+JsonBuilder& JsonBuilder::end_array() {
+    ASSERT2(!m_stack.empty() &&
+                m_stack.back()->get_type() == JsonValue::JSON_ARRAY,
+            "没有未结束的数组");
+    m_stack.pop_back();
+    return *this;
+}
+
+JsonBuilder& JsonBuilder::start_object(size_t reserve) {
+    JsonValue& v = next();
+    v.set_obj(std::unordered_map<std::string, JsonValue::ptr>());
+    v.reserve_obj(reserve);
+    m_stack.push_back(&v);
+    return *this;
+}
+
+JsonBuilder& JsonBuilder::end_object() {
+    ASSERT2(!m_stack.empty() &&
+                m_stack.back()->get_type() == JsonValue::JSON_OBJECT &&
+                !m_has_key,
+            "没有未结束的对象");
+    m_stack.pop_back();
+    return *this;
+}
+
+JsonBuilder& JsonBuilder::key(const std::string& k) {
+    return key(std::string(k));
+}
+
+JsonBuilder& JsonBuilder::key(std::string&& k) {
+    ASSERT2(!m_stack.empty() &&
+                m_stack.back()->get_type() == JsonValue::JSON_OBJECT &&
+                !m_has_key,
+            "键的位置错误");
+    m_key = std::move(k);
+    m_has_key = true;
+    return *this;
+}
+
+JsonValue::ptr JsonBuilder::take() {
+    ASSERT2(m_root != nullptr && m_stack.empty(), "文档尚未完成");
+    return std::move(m_root);
+}
+
+Json::Json(JsonContxt::ptr context) : m_context(context) {}
+
+Json::STATUS Json::parse(const std::string& str, JsonValue::ptr json_value) {
+    return parse(str, json_value, *m_context);
+}
+
+static JsonValue::ptr new_node(JsonContxt& ctx) {
+    PROFILE_SCOPE(ctx, alloc);
+    PROFILE_ADD_BYTES(sizeof(JsonValue));
+    return JsonValue::create(ctx.allocator);
+}
+
+// 去重模式: 返回已解析过的与 value 相等的节点, 没有时登记 value
+static JsonValue::ptr intern_node(JsonContxt& ctx, JsonValue::ptr value) {
+    size_t h = value->hash();
+    auto range = ctx.dedup_table.equal_range(h);
+    for (auto it = range.first; it != range.second; ++it) {
+        if (it->second->equals(*value)) {
+            return it->second;
+        }
+    }
+    ctx.dedup_table.emplace(h, value);
+    return value;
+}
+
+// 解析事件 -> JsonValue 树. 容器节点保存在解析栈的 Frame::value 中,
+// 结束时挂到上一层; 标量直接挂到栈顶容器. 设置了 ctx.observer 时先把
+// 事件交给它
+class TreeBuilder {
+public:
+    TreeBuilder(JsonValue::ptr root, JsonContxt& ctx)
+        : m_root(root), m_ctx(ctx), m_observer(ctx.observer) {}
+
+    void start_document() {
+        if (m_observer) {
+            m_observer->start_document();
+        }
+    }
+    bool null() {
+        if (m_observer && !m_observer->null()) {
+            return false;
+        }
+        scalar()->set_type(JsonValue::JSON_NULL);
+        return attach_scalar();
+    }
+    bool boolean(bool b) {
+        if (m_observer && !m_observer->boolean(b)) {
+            return false;
+        }
+        scalar()->set_type(b ? JsonValue::JSON_TRUE : JsonValue::JSON_FALSE);
+        return attach_scalar();
+    }
+    bool number(double d) {
+        if (m_observer && !m_observer->number(d)) {
+            return false;
+        }
+        if (m_ctx.pack_numbers && m_ctx.depth > 0) {
+            // 至今只有数字的数组直接追加到打包的元素中; 出现其他值时
+            // push_back_vec 会先展开
+            JsonContxt::Frame& frame = m_ctx.top_frame();
+            if (frame.array && frame.value->m_vec.empty()) {
+                frame.value->m_packed.push_back(d);
+                return true;
+            }
+        }
+        scalar()->set_number(d);
+        return attach_scalar();
+    }
+    bool string(const std::string& s) {
+        if (m_observer && !m_observer->string(s)) {
+            return false;
+        }
+        scalar()->set_str(s);
+        return attach_scalar();
+    }
+    bool borrow_strings() const { return m_ctx.borrow_strings; }
+    // 借用输入中 [p, p + size) 的原始字节, 含转义时取值时再解码
+    bool string_view(const char* p, size_t size, bool escaped) {
+        if (m_observer) {
+            std::string& s = m_ctx.scratch;
+            s.clear();
+            decode_chars(p, p + size + 1, s);
+            if (!m_observer->string(s)) {
+                return false;
+            }
+        }
+        JsonValue* v = scalar();
+        v->set_str(std::string());
+        v->m_view = p;
+        v->m_view_size = size;
+        v->m_view_escaped = escaped;
+        return attach_scalar();
+    }
+    bool start_array() {
+        if (m_observer && !m_observer->start_array()) {
+            return false;
+        }
+        container()->set_vec(std::vector<JsonValue::ptr>());
+        return true;
+    }
+    bool start_object() {
+        if (m_observer && !m_observer->start_object()) {
+            return false;
+        }
+        container()->set_obj(
+            std::unordered_map<std::string, JsonValue::ptr>());
+        return true;
+    }
+    bool key(const std::string& k) {
+        return !m_observer || m_observer->key(k);
+    }
+    bool end_array() {
+        if (m_observer && !m_observer->end_array()) {
+            return false;
+        }
+        attach_container();
+        return true;
+    }
+    bool end_object() {
+        if (m_observer && !m_observer->end_object()) {
+            return false;
+        }
+        attach_container();
+        return true;
+    }
+
+private:
+    // 标量写入的节点: 根或新节点
+    JsonValue* scalar() {
+        if (m_ctx.depth == 0) {
+            return m_root.get();
+        }
+        m_value = new_node(m_ctx);
+        return m_value.get();
+    }
+    // 刚压栈的容器节点: 最外层为根
+    JsonValue* container() {
+        JsonContxt::Frame& frame = m_ctx.top_frame();
+        frame.value = m_ctx.depth == 1 ? m_root : new_node(m_ctx);
+        return frame.value.get();
+    }
+    bool attach_scalar() {
+        if (m_ctx.depth > 0) {
+            attach(m_ctx.top_frame(), std::move(m_value));
+        }
+        return true;
+    }
+    void attach_container() {
+        if (m_ctx.depth > 1) {
+            attach(m_ctx.stack[m_ctx.depth - 2],
+                   std::move(m_ctx.top_frame().value));
+        }
+    }
+    void attach(JsonContxt::Frame& parent, JsonValue::ptr value) {
+        PROFILE_SCOPE(m_ctx, insert);
+        if (m_ctx.dedup) {
+            value = intern_node(m_ctx, std::move(value));
+        }
+        if (parent.array) {
+            parent.value->push_back_vec(std::move(value));
+        } else {
+            parent.value->insert_obj(std::move(parent.key), std::move(value));
+        }
+    }
+
+    JsonValue::ptr m_root;
+    JsonValue::ptr m_value;
+    JsonContxt& m_ctx;
+    JsonHandler* m_observer;
+};
+
+// 解析事件 -> 用户的 JsonHandler
+class EventForwarder {
+public:
+    explicit EventForwarder(JsonHandler& h) : m_h(h) {}
+
+    void start_document() { m_h.start_document(); }
+    bool null() { return m_h.null(); }
+    bool boolean(bool b) { return m_h.boolean(b); }
+    bool number(double d) { return m_h.number(d); }
+    bool string(const std::string& s) { return m_h.string(s); }
+    // handler 需要解码后的字符串, 不借用
+    bool borrow_strings() const { return false; }
+    bool string_view(const char*, size_t, bool) { return false; }
+    bool start_array() { return m_h.start_array(); }
+    bool start_object() { return m_h.start_object(); }
+    bool key(const std::string& k) { return m_h.key(k); }
+    bool end_array() { return m_h.end_array(); }
+    bool end_object() { return m_h.end_object(); }
+
+private:
+    JsonHandler& m_h;
+};
+
+Json::STATUS Json::parse(const std::string& str,
+                         JsonValue::ptr json_value,
+                         JsonContxt& ctx) const {
+    json_value->set_type(JsonValue::JSON_NULL);
+    TreeBuilder builder(json_value, ctx);
+    Json::STATUS ret = parse_document(str, builder, ctx);
+    ctx.dedup_table.clear();
+    if (ret != PARSE_OK) {
+        json_value->set_type(JsonValue::JSON_NULL);
+    }
+    return ret;
+}
+
+Json::STATUS Json::parse(const std::string& str, JsonHandler& handler,
+                         JsonContxt& ctx) const {
+    EventForwarder forwarder(handler);
+    return parse_document(str, forwarder, ctx);
+}
+
+template <class Handler>
+Json::STATUS Json::parse_document(const std::string& str, Handler& h,
+                                  JsonContxt& ctx) const {
+    ctx.curr_pos = 0;
+    h.start_document();
+
+    if (str.empty()) {
+        return PARSE_EXPECT_VALUE;
+    }
+
+    ctx.curr_pos = str.find_first_not_of(" \t\r\n", ctx.curr_pos);
+
+    if (ctx.curr_pos == str.npos) {
+        return PARSE_EXPECT_VALUE;
+    }
+
+    if (ctx.validate_utf8 && !utf8::validate(str.data(), str.size())) {
+        return PARSE_INVALID_UTF8;
+    }
+
+    Json::STATUS ret = parse_value(str, h, ctx);
+
+    if (ret == PARSE_OK && ctx.curr_pos < str.size()) {
+        ctx.curr_pos =
+            str.find_first_not_of(" \t\r\n", ctx.curr_pos);
+        if (ctx.curr_pos != std::string::npos) {
+            ret = PARSE_ROOT_NOT_SINGULAR;
+        }
+    }
+
+    return ret;
+}
+
+// 序列化时字符串中需要转义的字节: 0 表示原样输出, 'u' 表示输出 \uXXXX,
+// 其余为反斜杠后的字符
+struct EscapeTable {
+    char escape[256];
+
+    EscapeTable() {
+        for (int i = 0; i < 256; ++i) {
+            escape[i] = i < 0x20 ? 'u' : 0;
+        }
+        escape[static_cast<unsigned char>('\"')] = '\"';
+        escape[static_cast<unsigned char>('\\')] = '\\';
+        escape[static_cast<unsigned char>('\b')] = 'b';
+        escape[static_cast<unsigned char>('\f')] = 'f';
+        escape[static_cast<unsigned char>('\n')] = 'n';
+        escape[static_cast<unsigned char>('\r')] = 'r';
+        escape[static_cast<unsigned char>('\t')] = 't';
+    }
+};
+
+static const EscapeTable ESCAPE_TABLE;
+
+static void write_string(std::string& out, const char* p, size_t size) {
+    static const char HEX[] = "0123456789ABCDEF";
+    out += '\"';
+    const char* end = p + size;
+    while (p != end) {
+        // 整段复制不需要转义的字节
+        const char* run = p;
+        while (p != end && !ESCAPE_TABLE.escape[static_cast<uint8_t>(*p)]) {
+            ++p;
+        }
+        out.append(run, p - run);
+        if (p == end) {
+            break;
+        }
+
+        char e = ESCAPE_TABLE.escape[static_cast<uint8_t>(*p)];
+        if (e == 'u') {
+            char buf[6] = {'\\', 'u', '0', '0',
+                           HEX[static_cast<uint8_t>(*p) >> 4],
+                           HEX[static_cast<uint8_t>(*p) & 0xF]};
+            out.append(buf, sizeof(buf));
+        } else {
+            out += '\\';
+            out += e;
+        }
+        ++p;
+    }
+    out += '\"';
+}
+
+// 字符串中是否有需要转义的字节. 每次检查 8 字节: 某个字节为 '"',
+// '\\' 或小于 0x20 时对应的最高位被置 1
+static bool needs_escape(const char* p, size_t size) {
+    const uint64_t kOnes = 0x0101010101010101ULL;
+    const uint64_t kHigh = 0x8080808080808080ULL;
+    const char* end = p + size;
+    for (; end - p >= 8; p += 8) {
+        uint64_t w;
+        memcpy(&w, p, sizeof(w));
+        uint64_t quote = w ^ (kOnes * '\"');
+        uint64_t backslash = w ^ (kOnes * '\\');
+        uint64_t hit = ((quote - kOnes) & ~quote) |
+                       ((backslash - kOnes) & ~backslash) |
+                       ((w - kOnes * 0x20) & ~w);
+        if (hit & kHigh) {
+            return true;
+        }
+    }
+    for (; p != end; ++p) {
+        if (ESCAPE_TABLE.escape[static_cast<uint8_t>(*p)]) {
+            return true;
+        }
+    }
+    return false;
 }
 
-size_t JsonValue::get_obj_size() const {
-    ASSERT2(m_type == JSON_OBJECT, "类型错误");
-    return m_obj.size();
+static void write_number(std::string& out, double d) {
+    // 与 std::ostream 默认格式 (精度 6 的 %g) 保持一致
+    char buf[32];
+    int n = snprintf(buf, sizeof(buf), "%g", d);
+    out.append(buf, n);
 }
 
-void JsonValue::insert_obj(const std::string& k, JsonValue::ptr v) {
-    m_type = JSON_OBJECT;
-    m_obj[k] = v;
+void JsonIovec::add_ref(const char* data, size_t size) {
+    m_refs.push_back(Ref{m_buffer.size(), data, size});
+    m_referenced += size;
 }
 
-const JsonValue::ptr JsonValue::get_value_from_obj_by_string(
-    const std::string& s) {
-    ASSERT2(m_type == JSON_OBJECT, "类型错误");
-    if (m_obj.find(s) == m_obj.end()) {
-        return nullptr;
+void JsonIovec::finish() {
+    // 缓冲区不再增长, 此时才能取得指向它的指针
+    m_iov.clear();
+    m_iov.reserve(m_refs.size() * 2 + 1);
+    size_t pos = 0;
+    auto add = [this](const char* p, size_t n) {
+        if (n > 0) {
+            m_iov.push_back(iovec{const_cast<char*>(p), n});
+        }
+    };
+    for (const Ref& ref : m_refs) {
+        add(m_buffer.data() + pos, ref.pos - pos);
+        add(ref.data, ref.size);
+        pos = ref.pos;
     }
-
-    return m_obj[s];
+    add(m_buffer.data() + pos, m_buffer.size() - pos);
+    m_size = m_buffer.size() + m_referenced;
 }
 
-Json::Json(JsonContxt::ptr context) : m_context(context) {}
-
-Json::STATUS Json::parse(const std::string& str, JsonValue::ptr json_value) {
-    m_context->curr_pos = 0;
-
-    if (str.empty()) {
-        return PARSE_EXPECT_VALUE;
+std::string JsonIovec::to_string() const {
+    std::string out;
+    out.reserve(m_size);
+    for (const auto& v : m_iov) {
+        out.append(static_cast<const char*>(v.iov_base), v.iov_len);
     }
+    return out;
+}
 
-    m_context->curr_pos = str.find_first_not_of(" \t\r\n", m_context->curr_pos);
-
-    if (m_context->curr_pos == str.npos) {
-        return PARSE_EXPECT_VALUE;
+bool JsonIovec::write(int fd) const {
+    const size_t kMaxIov = IOV_MAX;
+    size_t i = 0;
+    size_t skip = 0;  // m_iov[i] 中已写出的字节
+    std::vector<struct iovec> batch;
+    while (i < m_iov.size()) {
+        size_t n = std::min(kMaxIov, m_iov.size() - i);
+        batch.assign(m_iov.begin() + i, m_iov.begin() + i + n);
+        batch[0].iov_base = static_cast<char*>(batch[0].iov_base) + skip;
+        batch[0].iov_len -= skip;
+        ssize_t written = writev(fd, batch.data(), static_cast<int>(n));
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        size_t left = static_cast<size_t>(written);
+        while (i < m_iov.size() && left >= m_iov[i].iov_len - skip) {
+            left -= m_iov[i].iov_len - skip;
+            skip = 0;
+            ++i;
+        }
+        skip += left;
     }
+    return true;
+}
 
-    json_value->set_type(JsonValue::JSON_NULL);
+void JsonIovec::clear() {
+    m_buffer.clear();
+    m_refs.clear();
+    m_iov.clear();
+    m_size = 0;
+    m_referenced = 0;
+}
 
-    Json::STATUS ret = parse_value(str, json_value);
+static bool use_parallel(const JsonContxt& ctx, size_t children) {
+    // 缓存要求子树自底向上全部填好, 与分块并行不兼容
+    return ctx.stringify_threads > 1 && !ctx.cache_subtrees &&
+           children >= ctx.parallel_min_children;
+}
 
-    if (ret == PARSE_OK && m_context->curr_pos < str.size()) {
-        m_context->curr_pos =
-            str.find_first_not_of(" \t\r\n", m_context->curr_pos);
-        if (m_context->curr_pos != std::string::npos) {
-            ret = PARSE_ROOT_NOT_SINGULAR;
-            json_value->set_type(JsonValue::JSON_NULL);
-        }
-    }
+int Json::stringify(std::string& str, JsonValue::ptr json_value) const {
+    return stringify(str, json_value, *m_context);
+}
 
+int Json::stringify(std::string& str, JsonValue::ptr json_value,
+                    JsonContxt& ctx) const {
+    PROFILE_SCOPE(ctx, stringify);
+    str.clear();
+    if (json_value == nullptr) {
+        return Json::STRINGIFY_ERROR;
+    }
+    int ret = stringify_value(str, *json_value, ctx);
+    PROFILE_ADD_BYTES(str.size());
     return ret;
 }
 
-static std::unordered_map<char, std::string> ESCAPE2CHAR{
-    {'\b', "\\b"}, {'\f', "\\f"},  {'\n', "\\n"}, {'\r', "\\r"},
-    {'\t', "\\t"}, {'\"', "\\\""}, {'/', "/"},  {'\\', "\\\\"}};
-
-int Json::stringify(std::string& str, JsonValue::ptr json_value) {
-    std::string().swap(str);
+int Json::stringify(JsonIovec& out, JsonValue::ptr json_value) const {
+    return stringify(out, json_value, *m_context);
+}
 
+int Json::stringify(JsonIovec& out, JsonValue::ptr json_value,
+                    JsonContxt& ctx) const {
+    PROFILE_SCOPE(ctx, stringify);
+    out.clear();
     if (json_value == nullptr) {
         return Json::STRINGIFY_ERROR;
     }
+    int ret = stringify_value(out.m_buffer, *json_value, ctx, &out);
+    out.finish();
+    PROFILE_ADD_BYTES(out.size());
+    return ret;
+}
 
-    std::stringstream ss;
-
+int Json::stringify_value(std::string& str, const JsonValue& value,
+                          JsonContxt& ctx, JsonIovec* iov) const {
+    // 引用的字节不在 str 中, 无法缓存, 也不能分块拼接
+    bool cache = ctx.cache_subtrees && iov == nullptr;
     /*
         JSON_NULL = 1,
         JSON_FALSE = 2,
@@ -168,168 +1657,444 @@ int Json::stringify(std::string& str, JsonValue::ptr json_value) {
         JSON_ARRAY = 6,
         JSON_OBJECT = 7
     */
-    switch (json_value->get_type()) {
+    size_t begin = str.size();
+    switch (value.get_type()) {
         case JsonValue::JSON_NULL: {
-            ss << "null";
+            str += "null";
             break;
         }
         case JsonValue::JSON_TRUE: {
-            ss << "true";
+            str += "true";
             break;
         }
         case JsonValue::JSON_FALSE: {
-            ss << "false";
+            str += "false";
             break;
         }
         case JsonValue::JSON_NUMBER: {
-            ss << json_value->get_number();
+            write_number(str, value.m_number);
             break;
         }
         case JsonValue::JSON_STRING: {
-            const std::string& str_tmp = json_value->get_str();
-            ss << "\"";
-            for (auto c : str_tmp) {
-                if (ESCAPE2CHAR.find(c) != ESCAPE2CHAR.end()) {
-                    ss << ESCAPE2CHAR[c];
-                } else if (c < 0x20) {
-                    char tmp_s[7];
-                    sprintf(tmp_s, "\\u%04X", c);
-                    ss << tmp_s;
-                } else {
-                    ss << c;
-                }
+            std::string tmp;
+            size_t size;
+            const char* data = value.str_bytes(tmp, size);
+            // 借用的字符串不含转义时, 其中也不会有需要转义的字节
+            bool plain = value.m_view != nullptr && !value.m_view_escaped;
+            if (iov != nullptr && size >= iov->min_ref_bytes &&
+                !value.m_view_escaped && (plain || !needs_escape(data, size))) {
+                str += '\"';
+                iov->add_ref(data, size);
+                str += '\"';
+                break;
+            }
+            if (plain) {
+                str += '\"';
+                str.append(data, size);
+                str += '\"';
+                break;
             }
-            ss << "\"";
+            write_string(str, data, size);
             break;
         }
         case JsonValue::JSON_ARRAY: {
-            const std::vector<JsonValue::ptr>& tmp_vec = json_value->get_vec();
-            size_t sz = tmp_vec.size();
-
-            if (sz == 0) {
-                ss << "[]";
+            if (cache && value.m_cache_valid && value.m_cache) {
+                str += *value.m_cache;
+                return STRINGIFY_OK;
+            }
+            if (!value.m_packed.empty()) {
+                str += '[';
+                for (size_t i = 0; i < value.m_packed.size(); ++i) {
+                    if (i > 0) {
+                        str += ',';
+                    }
+                    write_number(str, value.m_packed[i]);
+                }
+                str += ']';
                 break;
             }
+            if (iov == nullptr && use_parallel(ctx, value.m_vec.size())) {
+                return stringify_parallel(str, value, ctx.stringify_threads);
+            }
 
-            ss << '[';
-            std::string tmp_str;
-            int ret = stringify(tmp_str, tmp_vec[0]);
-            if (ret != STRINGIFY_OK) {
-                return ret;
+            str += '[';
+            for (size_t i = 0; i < value.m_vec.size(); ++i) {
+                if (value.m_vec[i] == nullptr) {
+                    return STRINGIFY_ERROR;
+                }
+                if (i > 0) {
+                    str += ',';
+                }
+                int ret = stringify_value(str, *value.m_vec[i], ctx, iov);
+                if (ret != STRINGIFY_OK) {
+                    return ret;
+                }
+            }
+            str += ']';
+            break;
+        }
+        case JsonValue::JSON_OBJECT: {
+            if (cache && value.m_cache_valid && value.m_cache) {
+                str += *value.m_cache;
+                return STRINGIFY_OK;
+            }
+            if (iov == nullptr && use_parallel(ctx, value.m_obj.size())) {
+                return stringify_parallel(str, value, ctx.stringify_threads);
             }
-            ss << tmp_str;
 
-            for (size_t i = 1; i < sz; ++i) {
-                ss << ',';
-                stringify(tmp_str, tmp_vec[i]);
-                ss << tmp_str;
+            str += '{';
+            bool first = true;
+            for (const auto& p : value.m_obj) {
+                if (p.second == nullptr) {
+                    return STRINGIFY_ERROR;
+                }
+                if (!first) {
+                    str += ',';
+                }
+                first = false;
+                write_string(str, p.first.data(), p.first.size());
+                str += ':';
+                int ret = stringify_value(str, *p.second, ctx, iov);
+                if (ret != STRINGIFY_OK) {
+                    return ret;
+                }
             }
-            ss << ']';
+            str += '}';
+            break;
+        }
+    }
+
+    if (cache) {
+        // 子节点都已有效, 本节点随之有效; 只有足够长的容器才保存结果
+        value.m_cache_valid = true;
+        size_t n = str.size() - begin;
+        if ((value.m_type == JsonValue::JSON_ARRAY ||
+             value.m_type == JsonValue::JSON_OBJECT) &&
+            n >= ctx.cache_min_bytes) {
+            value.m_cache.reset(new std::string(str, begin, n));
+        } else {
+            value.m_cache.reset();
+        }
+    }
+    return STRINGIFY_OK;
+}
+
+int Json::stringify_parallel(std::string& str, const JsonValue& value,
+                             size_t threads) const {
+    using Member = std::pair<const std::string, JsonValue::ptr>;
+    bool is_array = value.m_type == JsonValue::JSON_ARRAY;
+    size_t n = is_array ? value.m_vec.size() : value.m_obj.size();
+    // 对象按迭代顺序取出成员, 保证与单线程的输出顺序一致
+    std::vector<const Member*> members;
+    if (!is_array) {
+        members.reserve(n);
+        for (const auto& p : value.m_obj) {
+            members.push_back(&p);
+        }
+    }
 
+    // 块数多于线程数, 子树大小不均时也能大致均衡
+    size_t chunks = std::min(n, threads * 4);
+    std::vector<std::string> parts(chunks);
+    std::vector<int> rets(chunks, STRINGIFY_OK);
+    // 块中抛出的异常 (如 bad_alloc), 全部线程结束后在调用线程重新抛出
+    std::vector<std::exception_ptr> errors(chunks);
+    std::atomic<size_t> next_chunk(0);
+
+    auto stringify_chunk = [&](size_t c, JsonContxt& wctx) {
+        size_t begin = n * c / chunks;
+        size_t end = n * (c + 1) / chunks;
+        std::string& out = parts[c];
+        for (size_t i = begin; i < end; ++i) {
+            if (i > begin) {
+                out += ',';
+            }
+            const JsonValue::ptr* child = nullptr;
+            if (is_array) {
+                child = &value.m_vec[i];
+            } else {
+                write_string(out, members[i]->first.data(),
+                             members[i]->first.size());
+                out += ':';
+                child = &members[i]->second;
+            }
+            if (*child == nullptr) {
+                rets[c] = STRINGIFY_ERROR;
+                return;
+            }
+            rets[c] = stringify_value(out, **child, wctx);
+            if (rets[c] != STRINGIFY_OK) {
+                return;
+            }
+        }
+    };
+    auto worker = [&]() {
+        // 工作线程使用默认上下文: 不读写缓存, 也不再嵌套并行
+        JsonContxt wctx;
+        for (size_t c = next_chunk++; c < chunks; c = next_chunk++) {
+            try {
+                stringify_chunk(c, wctx);
+            } catch (...) {
+                // 异常离开工作线程会调用 std::terminate
+                errors[c] = std::current_exception();
+                rets[c] = STRINGIFY_ERROR;
+            }
+        }
+    };
+
+    std::vector<std::thread> pool;
+    // 离开作用域时 (包括当前线程抛出异常) 等待所有工作线程
+    struct Joiner {
+        std::vector<std::thread>& pool;
+        ~Joiner() {
+            for (auto& t : pool) {
+                if (t.joinable()) {
+                    t.join();
+                }
+            }
+        }
+    } joiner{pool};
+    for (size_t t = 1; t < threads && t < chunks; ++t) {
+        try {
+            pool.emplace_back(worker);
+        } catch (const std::system_error&) {
+            // 创建线程失败时剩下的块由当前线程完成
             break;
         }
-        case JsonValue::JSON_OBJECT: {
-            const std::unordered_map<std::string, JsonValue::ptr>& obj_tmp = 
-                json_value->get_obj();
-            size_t sz = obj_tmp.size();
-            
-            if (sz == 0) {
-                ss << "{}";
+    }
+    worker();
+    for (auto& t : pool) {
+        t.join();
+    }
+    for (const auto& e : errors) {
+        if (e) {
+            std::rethrow_exception(e);
+        }
+    }
+
+    size_t total = chunks + 1;
+    for (size_t c = 0; c < chunks; ++c) {
+        if (rets[c] != STRINGIFY_OK) {
+            return rets[c];
+        }
+        total += parts[c].size();
+    }
+    str.reserve(str.size() + total);
+    str += is_array ? '[' : '{';
+    for (size_t c = 0; c < chunks; ++c) {
+        if (c > 0) {
+            str += ',';
+        }
+        str += parts[c];
+    }
+    str += is_array ? ']' : '}';
+    return STRINGIFY_OK;
+}
+
+template <class Handler>
+Json::STATUS Json::parse_value(const std::string& str, Handler& h,
+                               JsonContxt& ctx) const {
+    ctx.clear_stack();
+
+    size_t sz = str.size();
+    Json::STATUS ret = PARSE_OK;
+
+    for (;;) {
+        // 解析一个值; 遇到数组/对象时压栈, 转而解析其第一个元素
+        char c = ctx.curr_pos < sz ? str[ctx.curr_pos] : '\0';
+        if (c == '[' || c == '{') {
+            if (ctx.depth >= ctx.max_depth) {
+                ret = PARSE_DEPTH_EXCEEDED;
+                break;
+            }
+
+            ++(ctx.curr_pos);
+            SKIP_WS;
+            JsonContxt::Frame& frame = ctx.push_frame(nullptr);
+            frame.array = c == '[';
+
+            if (frame.array) {
+                if (!h.start_array()) {
+                    ret = PARSE_REJECTED;
+                    break;
+                }
+                if (ctx.curr_pos == str.npos) {
+                    ret = PARSE_MISS_COMMA_OR_SQUARE_BRACKET;
+                    break;
+                }
+                if (str[ctx.curr_pos] != ']') {
+                    continue;
+                }
+            } else {
+                if (!h.start_object()) {
+                    ret = PARSE_REJECTED;
+                    break;
+                }
+                if (ctx.curr_pos == str.npos) {
+                    ret = PARSE_MISS_COMMA_OR_CURLY_BRACKET;
+                    break;
+                }
+                if (str[ctx.curr_pos] != '}') {
+                    ret = parse_member_key(str, frame.key, ctx);
+                    if (ret != PARSE_OK) {
+                        break;
+                    }
+                    if (!h.key(frame.key)) {
+                        ret = PARSE_REJECTED;
+                        break;
+                    }
+                    continue;
+                }
+            }
+
+            // 空数组/空对象
+            ++(ctx.curr_pos);
+            if (!(frame.array ? h.end_array() : h.end_object())) {
+                ret = PARSE_REJECTED;
+                break;
+            }
+            ctx.pop_frame();
+        } else {
+            ret = parse_scalar(str, h, ctx);
+            if (ret != PARSE_OK) {
                 break;
             }
+        }
+
+        // 一个值已解析完成: 根据分隔符决定继续解析下一个元素还是结束父节点
+        bool next_value = false;
+        while (!next_value && ctx.depth > 0) {
+            JsonContxt::Frame& top = ctx.top_frame();
+            SKIP_WS;
 
-            ss << '{';
-            std::string tmp_str;
-            size_t pair_counts = 0;
-            for (const auto& p : obj_tmp) {
-                int ret = stringify(tmp_str, p.second);
-                if (ret != Json::STRINGIFY_OK) {
-                    return Json::STRINGIFY_ERROR;
+            if (top.array) {
+                if (ctx.curr_pos == str.npos) {
+                    ret = PARSE_MISS_COMMA_OR_SQUARE_BRACKET;
+                    break;
+                }
+                if (str[ctx.curr_pos] == ',') {
+                    ++(ctx.curr_pos);
+                    SKIP_WS;
+                    if (ctx.curr_pos == str.npos) {
+                        ret = PARSE_MISS_COMMA_OR_SQUARE_BRACKET;
+                        break;
+                    }
+                    next_value = true;
+                } else if (str[ctx.curr_pos] == ']') {
+                    ++(ctx.curr_pos);
+                } else {
+                    ret = PARSE_MISS_COMMA_OR_SQUARE_BRACKET;
+                    break;
+                }
+            } else {
+                if (ctx.curr_pos == str.npos) {
+                    ret = PARSE_MISS_COMMA_OR_CURLY_BRACKET;
+                    break;
+                }
+                if (str[ctx.curr_pos] == ',') {
+                    ++(ctx.curr_pos);
+                    SKIP_WS;
+                    ret = parse_member_key(str, top.key, ctx);
+                    if (ret != PARSE_OK) {
+                        break;
+                    }
+                    if (!h.key(top.key)) {
+                        ret = PARSE_REJECTED;
+                        break;
+                    }
+                    next_value = true;
+                } else if (str[ctx.curr_pos] == '}') {
+                    ++(ctx.curr_pos);
+                } else {
+                    ret = PARSE_MISS_COMMA_OR_CURLY_BRACKET;
+                    break;
                 }
+            }
 
-                if (pair_counts == sz - 1) {
-                    ss << '\"' << p.first << '\"' << ':' << tmp_str;
-                    ++pair_counts;
+            if (!next_value) {
+                if (!(top.array ? h.end_array() : h.end_object())) {
+                    ret = PARSE_REJECTED;
                     break;
                 }
-                
-                ss << '\"' << p.first << '\"' << ':' << tmp_str << ',';
-                ++pair_counts;
+                ctx.pop_frame();
             }
-            ss << '}';
+        }
+
+        if (ret != PARSE_OK || ctx.depth == 0) {
             break;
         }
     }
 
-    str = ss.str();
-
-    return STRINGIFY_OK;
+    if (ret != PARSE_OK) {
+        ctx.clear_stack();
+    }
+    return ret;
 }
 
-Json::STATUS Json::parse_value(const std::string& str,
-                               JsonValue::ptr json_value) {
+template <class Handler>
+Json::STATUS Json::parse_scalar(const std::string& str, Handler& h,
+                                JsonContxt& ctx) const {
     /*
     n ➔ null
     f ➔ false
     t ➔ true
     " ➔ string
     0-9/- ➔ number
-    [ ➔ array
-    { ➔ object
     */
-    switch (str[m_context->curr_pos]) {
+    if (ctx.curr_pos >= str.size()) {
+        return PARSE_EXPECT_VALUE;
+    }
+
+    Json::STATUS ret = PARSE_OK;
+    bool accepted = true;
+    switch (str[ctx.curr_pos]) {
         case 'n':
-            return parse_null(str, json_value);
+            ret = parse_literal(str, "null", 4, ctx);
+            accepted = ret != PARSE_OK || h.null();
+            break;
         case 'f':
-            return parse_false(str, json_value);
+            ret = parse_literal(str, "false", 5, ctx);
+            accepted = ret != PARSE_OK || h.boolean(false);
+            break;
         case 't':
-            return parse_true(str, json_value);
+            ret = parse_literal(str, "true", 4, ctx);
+            accepted = ret != PARSE_OK || h.boolean(true);
+            break;
         case '\"':
-            return parse_str(str, json_value);
-        case '[':
-            return parse_vec(str, json_value);
-        case '{':
-            return parse_obj(str, json_value);
+            if (h.borrow_strings()) {
+                size_t begin = ctx.curr_pos;
+                bool escaped = false;
+                ret = parse_str_view(str, escaped, ctx);
+                accepted = ret != PARSE_OK ||
+                           h.string_view(str.data() + begin + 1,
+                                         ctx.curr_pos - begin - 2, escaped);
+                break;
+            }
+            ret = parse_str(str, ctx);
+            accepted = ret != PARSE_OK || h.string(ctx.scratch);
+            break;
         case '\0':
             return PARSE_EXPECT_VALUE;
-        default:
-            return parse_number(str, json_value);
+        default: {
+            double number = 0;
+            ret = parse_number(str, number, ctx);
+            accepted = ret != PARSE_OK || h.number(number);
+            break;
+        }
     }
+    return accepted ? ret : PARSE_REJECTED;
 }
 
-#define XX(expect, actual, type, len)                         \
-    do {                                                      \
-        if (m_context->curr_pos + len - 1 >= str.size()) {    \
-            return PARSE_INVALID_VALUE;                       \
-        }                                                     \
-        if (str.substr(m_context->curr_pos, len) != expect) { \
-            return PARSE_INVALID_VALUE;                       \
-        }                                                     \
-        m_context->curr_pos += len;                           \
-        json_value->set_type(type);                           \
-        return PARSE_OK;                                      \
-    } while (0)
-
-/*null = "null"*/
-Json::STATUS Json::parse_null(const std::string& str,
-                              JsonValue::ptr json_value) {
-    XX("null", str, JsonValue::JSON_NULL, 4);
-}
-
-/*false= "false"*/
-Json::STATUS Json::parse_false(const std::string& str,
-                               JsonValue::ptr json_value) {
-    XX("false", str, JsonValue::JSON_FALSE, 5);
-}
-
-/*true = "true"*/
-Json::STATUS Json::parse_true(const std::string& str,
-                              JsonValue::ptr json_value) {
-    XX("true", str, JsonValue::JSON_TRUE, 4);
+/* null = "null", false = "false", true = "true" */
+Json::STATUS Json::parse_literal(const std::string& str, const char* literal,
+                                 size_t len, JsonContxt& ctx) const {
+    if (str.compare(ctx.curr_pos, len, literal) != 0) {
+        return PARSE_INVALID_VALUE;
+    }
+    ctx.curr_pos += len;
+    return PARSE_OK;
 }
 
-#undef XX
-
 #define ISDIGIT(ch) ((ch >= '0') && (ch <= '9'))
 
 enum State {
@@ -370,7 +2135,7 @@ CharType to_char_type(char ch) {
         return CHAR_NEGATIVE_SING;
     } else if (ch == '.') {
         return CHAR_POINT;
-    } else if (ch == ' ') {
+    } else if (ch == ' ' || ch == '\t' || ch == '\r' || ch == '\n') {
         return CHAR_SPACE;
     } else if (ch == ']' || ch == '}' || ch == ',') {
         return CHAR_SQUARE_BRACKET_BRACES;
@@ -379,8 +2144,11 @@ CharType to_char_type(char ch) {
     }
 }
 
-bool Json::is_number(const std::string& str) {
-    std::unordered_map<State, std::unordered_map<CharType, State>> transfer{
+using TransferTable =
+    std::unordered_map<State, std::unordered_map<CharType, State>>;
+
+bool Json::is_number(const std::string& str, JsonContxt& ctx) const {
+    static const TransferTable transfer{
         {STATE_INITIAL,
          {{CHAR_SPACE, STATE_INITIAL},
           {CHAR_DIGIT, STATE_DIGIT},
@@ -425,13 +2193,15 @@ bool Json::is_number(const std::string& str) {
     int len = str.size();
     State st = STATE_INITIAL;
 
-    for (int i = m_context->curr_pos; i < len; ++i) {
+    for (int i = ctx.curr_pos; i < len; ++i) {
         CharType typ = to_char_type(str[i]);
         // std::cout << "typ: " << typ << std::endl;
-        if (transfer[st].find(typ) == transfer[st].end()) {
+        const std::unordered_map<CharType, State>& row = transfer.at(st);
+        auto it = row.find(typ);
+        if (it == row.end()) {
             return false;
         } else {
-            st = transfer[st][typ];
+            st = it->second;
             if (st == STATE_END) {
                 return true;
             }
@@ -442,322 +2212,244 @@ bool Json::is_number(const std::string& str) {
            st == STATE_EXP_NUMBER || st == STATE_INI_ZERO;
 }
 
-Json::STATUS Json::parse_number(const std::string& str,
-                                JsonValue::ptr json_value) {
-    if (!is_number(str)) {
+Json::STATUS Json::parse_number(const std::string& str, double& number,
+                                JsonContxt& ctx) const {
+    PROFILE_PARSE(number);
+    if (!is_number(str, ctx)) {
         return Json::PARSE_INVALID_VALUE;
     }
 
-    std::size_t n = 0; /*已处理字符数*/
-    double tmp = 0;
-    try {
-        tmp = std::stod(str.substr(m_context->curr_pos), &n);
-    } catch (...) {
+    // 直接在原串上转换, 避免每个数字都拷贝一次剩余输入
+    const char* begin = str.c_str() + ctx.curr_pos;
+    char* end = nullptr;
+    errno = 0;
+    double tmp = strtod(begin, &end);
+    if (errno == ERANGE) {
         return Json::PARSE_NUMBER_OUT_OF_RANGE;
     }
 
+    std::size_t n = end - begin; /*已处理字符数*/
     if (n == 0) {
         return Json::PARSE_INVALID_VALUE;
     }
-    m_context->curr_pos += n;
-    json_value->set_number(tmp);
+    ctx.curr_pos += n;
+    number = tmp;
     return Json::PARSE_OK;
 }
 
-std::unordered_map<char, uint8_t> CHAR2U8{
-    {'0', 0},  {'1', 1},  {'2', 2},  {'3', 3},  {'4', 4},  {'5', 5},
-    {'6', 6},  {'7', 7},  {'8', 8},  {'9', 9},  {'A', 10}, {'a', 10},
-    {'B', 11}, {'b', 11}, {'C', 12}, {'c', 12}, {'D', 13}, {'d', 13},
-    {'E', 14}, {'e', 14}, {'F', 15}, {'f', 15},
+// 字符串解码用到的查找表, 在静态初始化阶段构造一次
+struct StringTables {
+    StringTables() {
+        for (int c = 0; c < 256; ++c) {
+            special[c] = c < 0x20 || c == '\"' || c == '\\';
+            escape[c] = 0;
+            hex[c] = -1;
+        }
+        escape[static_cast<uint8_t>('b')] = '\b';
+        escape[static_cast<uint8_t>('f')] = '\f';
+        escape[static_cast<uint8_t>('n')] = '\n';
+        escape[static_cast<uint8_t>('r')] = '\r';
+        escape[static_cast<uint8_t>('t')] = '\t';
+        escape[static_cast<uint8_t>('\"')] = '\"';
+        escape[static_cast<uint8_t>('/')] = '/';
+        escape[static_cast<uint8_t>('\\')] = '\\';
+        for (int c = '0'; c <= '9'; ++c) {
+            hex[c] = c - '0';
+        }
+        for (int c = 'a'; c <= 'f'; ++c) {
+            hex[c] = c - 'a' + 10;
+            hex[c - 'a' + 'A'] = c - 'a' + 10;
+        }
+    }
+
+    bool special[256];  // 需要单独处理的字符: '"', '\\' 和控制字符
+    char escape[256];   // '\\' 之后的字符 -> 转义结果, 0 表示非法 (含 'u')
+    int8_t hex[256];    // 十六进制字符 -> 值, -1 表示非法
 };
 
-static bool parse_hex4(const std::string& str, uint16_t& u) {
-    int n = str.size();
-    if (n != 4) {
-        return 0;
+static const StringTables STR_TABLES;
+
+static bool parse_hex4(const char* p, const char* end, uint32_t& u) {
+    if (end - p < 4) {
+        return false;
     }
 
     u = 0;
-    for (int i = 0; i < n; ++i) {
-        if (CHAR2U8.find(str[i]) == CHAR2U8.end()) {
-            u = 0;
+    for (int i = 0; i < 4; ++i) {
+        int8_t h = STR_TABLES.hex[static_cast<uint8_t>(p[i])];
+        if (h < 0) {
             return false;
         }
-        u |= CHAR2U8[str[i]];
-        if (i == n - 1) {
-            break;
-        }
-        u = u << 4;
+        u = (u << 4) | h;
     }
-
     return true;
 }
 
-static const std::string decode_utf8(const std::string& str, size_t& pos) {
-    std::stringstream ss;
-    size_t n = str.size();
-    if (pos + 4 >= n) {
-        return ss.str();
-    }
-
-    uint32_t u = 0;
-    uint16_t u_h = 0;
-    uint16_t u_l = 0;
-    if (!parse_hex4(str.substr(pos, 4), u_h)) {
-        return ss.str();
+/* p 指向 "\u" 之后的 4 位十六进制数, 成功时 p 移到转义序列之后 */
+static bool read_unicode(const char*& p, const char* end, uint32_t& u) {
+    if (!parse_hex4(p, end, u)) {
+        return false;
     }
-    pos += 4;
-
-    if (u_h >= 0xd800 && u_h <= 0xdbff) {
-        if (pos + 1 >= n) {
-            return ss.str();
-        }
-
-        if (str[pos] == '\\' && str[pos + 1] == 'u') {
-            pos += 2;
-            if (pos + 4 >= n) {
-                return ss.str();
-            }
-            if (!parse_hex4(str.substr(pos, 4), u_l)) {
-                return ss.str();
-            }
-
-            if (!(u_l >= 0xdc00 && u_l <= 0xdfff)) {
-                return ss.str();
-            }
+    p += 4;
 
-            pos += 4;
-            u = 0x10000 + ((u_h - 0xD800) << 10) + (u_l - 0xDC00);
-        } else {
-            return ss.str();
+    if (u >= 0xd800 && u <= 0xdbff) {
+        uint32_t low = 0;
+        if (end - p < 2 || p[0] != '\\' || p[1] != 'u' ||
+            !parse_hex4(p + 2, end, low) || low < 0xdc00 || low > 0xdfff) {
+            return false;
         }
-    } else {
-        u = u_h;
+        p += 6;
+        u = 0x10000 + ((u - 0xd800) << 10) + (low - 0xdc00);
     }
+    return true;
+}
 
-    if (u >= 0x0000 && u <= 0x007f) {
-        ss << char(u & 0x7f);
-    } else if (u >= 0x0080 && u <= 0x07ff) {
-        ss << char(0xc0 | ((u >> 6) & 0x1f));
-        ss << char(0x80 | (u & 0x3f));
-    } else if (u >= 0x0800 && u <= 0xffff) {
-        ss << char(0xe0 | ((u >> 12) & 0x0f));
-        ss << char(0x80 | ((u >> 6) & 0x3f));
-        ss << char(0x80 | ((u)&0x3f));
-    } else if (u >= 0x10000 && 0x10ffff) {
-        ss << char(0xf0 | ((u >> 18) & 0x07));
-        ss << char(0x80 | ((u >> 12) & 0x3f));
-        ss << char(0x80 | ((u >> 6) & 0x3f));
-        ss << char(0x80 | ((u)&0x3f));
+static bool decode_unicode(const char*& p, const char* end, std::string& out) {
+    uint32_t u = 0;
+    if (!read_unicode(p, end, u)) {
+        return false;
     }
-
-    return ss.str();
+    utf8::append(u, out);
+    return true;
 }
 
-static std::unordered_map<char, char> CHAR2ESCAPE{
-    {'b', '\b'}, {'f', '\f'},  {'n', '\n'}, {'r', '\r'},
-    {'t', '\t'}, {'\"', '\"'}, {'/', '/'},  {'\\', '\\'}};
-
-Json::STATUS Json::parse_str(const std::string& str,
-                             JsonValue::ptr json_value) {
-    size_t sz = str.size();
-
-    ++(m_context->curr_pos);
-    std::string tmp;
-    while (m_context->curr_pos < sz && str[m_context->curr_pos] != '\"') {
-        if (str[m_context->curr_pos] == '\\') {
-            ++(m_context->curr_pos);
-            if (CHAR2ESCAPE.find(str[m_context->curr_pos]) !=
-                CHAR2ESCAPE.end()) {
-                tmp.push_back(CHAR2ESCAPE[str[m_context->curr_pos]]);
-                ++(m_context->curr_pos);
-            } else if (str[m_context->curr_pos] == 'u') {
-                ++(m_context->curr_pos);
-                std::string tmp_utf8 = decode_utf8(str, m_context->curr_pos);
-                if (tmp_utf8.empty()) {
-                    json_value->set_type(JsonValue::JSON_NULL);
-                    return PARSE_INVALID_UNICODE_HEX;
-                }
-
-                tmp += tmp_utf8;
-            } else {
-                json_value->set_type(JsonValue::JSON_NULL);
-                return PARSE_INVALID_STRING_ESCAPE;
-            }
-            continue;
+/*
+ * 解码 p (左引号之后) 开始的字符串, 结果追加到 out. 不含转义的连续字符
+ * 整段拷贝; 成功时 p 指向右引号.
+ */
+static Json::STATUS decode_chars(const char*& p, const char* end,
+                                 std::string& out) {
+    for (;;) {
+        const char* run = p;
+        while (p < end && !STR_TABLES.special[static_cast<uint8_t>(*p)]) {
+            ++p;
         }
+        out.append(run, p - run);
 
-        if (str[m_context->curr_pos] <= 31) {
-            json_value->set_type(JsonValue::JSON_NULL);
-            return PARSE_INVALID_STRING_CHAR;
+        if (p >= end) {
+            return Json::PARSE_MISS_QUOTATION_MARK;
         }
 
-        tmp.push_back(str[m_context->curr_pos]);
-        ++(m_context->curr_pos);
-    }
-
-    if (m_context->curr_pos >= sz) {
-        return Json::PARSE_MISS_QUOTATION_MARK;
-    }
-
-    json_value->set_str(tmp);
-    ++(m_context->curr_pos);
-    return Json::PARSE_OK;
-}
-
-Json::STATUS Json::parse_str_raw(const std::string& str, std::string& ret) {
-    size_t sz = str.size();
-
-    if (str[m_context->curr_pos] != '\"') {
-        return Json::PARSE_MISS_KEY;
-    }
-
-    ++(m_context->curr_pos);
-
-    std::string tmp;
-    while (m_context->curr_pos < sz && str[m_context->curr_pos] != '\"') {
-        if (str[m_context->curr_pos] == '\\') {
-            ++(m_context->curr_pos);
-            if (CHAR2ESCAPE.find(str[m_context->curr_pos]) !=
-                CHAR2ESCAPE.end()) {
-                tmp.push_back(CHAR2ESCAPE[str[m_context->curr_pos]]);
-                ++(m_context->curr_pos);
-            } else if (str[m_context->curr_pos] == 'u') {
-                ++(m_context->curr_pos);
-                std::string tmp_utf8 = decode_utf8(str, m_context->curr_pos);
-                if (tmp_utf8.empty()) {
-                    return PARSE_INVALID_UNICODE_HEX;
-                }
-
-                tmp += tmp_utf8;
-            } else {
-                return PARSE_INVALID_STRING_ESCAPE;
-            }
-            continue;
+        if (*p == '\"') {
+            return Json::PARSE_OK;
         }
 
-        if (str[m_context->curr_pos] <= 31) {
-            return PARSE_INVALID_STRING_CHAR;
+        if (*p != '\\') {
+            return Json::PARSE_INVALID_STRING_CHAR;
         }
 
-        tmp.push_back(str[m_context->curr_pos]);
-        ++(m_context->curr_pos);
-    }
-
-    if (m_context->curr_pos >= sz) {
-        return Json::PARSE_MISS_QUOTATION_MARK;
+        ++p;
+        char e = p < end ? STR_TABLES.escape[static_cast<uint8_t>(*p)] : 0;
+        if (e != 0) {
+            out.push_back(e);
+            ++p;
+        } else if (p < end && *p == 'u') {
+            ++p;
+            if (!decode_unicode(p, end, out)) {
+                return Json::PARSE_INVALID_UNICODE_HEX;
+            }
+        } else {
+            return Json::PARSE_INVALID_STRING_ESCAPE;
+        }
     }
-
-    ret = tmp;
-    ++(m_context->curr_pos);
-    return Json::PARSE_OK;
 }
 
-Json::STATUS Json::parse_vec(const std::string& str,
-                             JsonValue::ptr json_value) {
-    size_t sz = str.size();
-    if (sz < 2) {
-        return PARSE_MISS_COMMA_OR_SQUARE_BRACKET;
-    }
-
-    ++(m_context->curr_pos);
-    m_context->curr_pos = str.find_first_not_of(" \t\r\n", m_context->curr_pos);
-
-    if (str[m_context->curr_pos] == ']') {
-        ++(m_context->curr_pos);
-        json_value->set_vec({});
-        return PARSE_OK;
+/* 解码 str[pos] (左引号) 开始的字符串, 成功时 pos 指向右引号之后 */
+static Json::STATUS decode_string(const std::string& str, size_t& pos,
+                                  std::string& out) {
+    const char* begin = str.data();
+    const char* p = begin + pos + 1;
+    out.clear();
+    Json::STATUS ret = decode_chars(p, begin + str.size(), out);
+    if (ret == Json::PARSE_OK) {
+        pos = p + 1 - begin;
     }
+    return ret;
+}
 
-    while (m_context->curr_pos < sz) {
-        JsonValue::ptr tmp_json_value = JsonValue::ptr(new JsonValue);
-        Json::STATUS ret = parse_value(str, tmp_json_value);
-        if (ret != Json::PARSE_OK) {
-            json_value->set_type(JsonValue::JSON_NULL);
-            return ret;
+/*
+ * 与 decode_string 做同样的检查但不解码, 用于借用的字符串. escaped 为
+ * 是否含有转义
+ */
+static Json::STATUS scan_string(const std::string& str, size_t& pos,
+                                bool& escaped) {
+    const char* begin = str.data();
+    const char* end = begin + str.size();
+    const char* p = begin + pos + 1;
+    escaped = false;
+
+    for (;;) {
+        while (p < end && !STR_TABLES.special[static_cast<uint8_t>(*p)]) {
+            ++p;
         }
-
-        json_value->push_back_vec(tmp_json_value);
-
-        m_context->curr_pos =
-            str.find_first_not_of(" \t\r\n", m_context->curr_pos);
-        if (m_context->curr_pos == str.npos) {
-            json_value->set_type(JsonValue::JSON_NULL);
-            return PARSE_MISS_COMMA_OR_SQUARE_BRACKET;
+        if (p >= end) {
+            return Json::PARSE_MISS_QUOTATION_MARK;
         }
-
-        if (str[(m_context->curr_pos)] == ',') {
-            ++(m_context->curr_pos);
-            m_context->curr_pos =
-                str.find_first_not_of(" \t\r\n", m_context->curr_pos);
-        } else if (str[(m_context->curr_pos)] == ']') {
-            ++(m_context->curr_pos);
+        if (*p == '\"') {
+            pos = p + 1 - begin;
             return Json::PARSE_OK;
         }
-    }
-
-    json_value->set_type(JsonValue::JSON_NULL);
-    return Json::PARSE_MISS_COMMA_OR_SQUARE_BRACKET;
-}
+        if (*p != '\\') {
+            return Json::PARSE_INVALID_STRING_CHAR;
+        }
 
-Json::STATUS Json::parse_obj(const std::string& str,
-                             JsonValue::ptr json_value) {
-    size_t sz = str.size();
-    if (sz - m_context->curr_pos < 2) {
-        return Json::PARSE_MISS_BRACES;
+        escaped = true;
+        ++p;
+        uint32_t u;
+        if (p < end && STR_TABLES.escape[static_cast<uint8_t>(*p)] != 0) {
+            ++p;
+        } else if (p < end && *p == 'u') {
+            ++p;
+            if (!read_unicode(p, end, u)) {
+                return Json::PARSE_INVALID_UNICODE_HEX;
+            }
+        } else {
+            return Json::PARSE_INVALID_STRING_ESCAPE;
+        }
     }
+}
 
-    ++(m_context->curr_pos);
-    m_context->curr_pos = str.find_first_not_of(" \t\r\n", m_context->curr_pos);
+Json::STATUS Json::parse_str(const std::string& str, JsonContxt& ctx) const {
+    PROFILE_PARSE(string);
+    return decode_string(str, ctx.curr_pos, ctx.scratch);
+}
 
-    json_value->set_obj(std::unordered_map<std::string, JsonValue::ptr>());
+Json::STATUS Json::parse_str_view(const std::string& str, bool& escaped,
+                                  JsonContxt& ctx) const {
+    PROFILE_PARSE(string);
+    return scan_string(str, ctx.curr_pos, escaped);
+}
 
-    if (str[m_context->curr_pos] == '}') {
-        ++(m_context->curr_pos);
-        return PARSE_OK;
+Json::STATUS Json::parse_str_raw(const std::string& str, std::string& ret,
+                                 JsonContxt& ctx) const {
+    if (str[ctx.curr_pos] != '\"') {
+        return Json::PARSE_MISS_KEY;
     }
 
-    while (m_context->curr_pos < sz) {
-        std::string tmp_key;
-        Json::STATUS ret = parse_str_raw(str, tmp_key);
-        if (ret != Json::PARSE_OK) {
-            json_value->set_type(JsonValue::JSON_NULL);
-            return ret;
-        }
-
-        m_context->curr_pos =
-            str.find_first_not_of(" \t\r\n", m_context->curr_pos);
-
-        if (str[m_context->curr_pos] != ':') {
-            json_value->set_type(JsonValue::JSON_NULL);
-            return Json::PARSE_MISS_COLON;
-        }
+    PROFILE_PARSE(string);
+    return decode_string(str, ctx.curr_pos, ret);
+}
 
-        ++(m_context->curr_pos);
-        m_context->curr_pos =
-            str.find_first_not_of(" \t\r\n", m_context->curr_pos);
-        JsonValue::ptr tmp_json_value = JsonValue::ptr(new JsonValue);
-        ret = parse_value(str, tmp_json_value);
-        if (ret != Json::PARSE_OK) {
-            json_value->set_type(JsonValue::JSON_NULL);
-            return ret;
-        }
+/* member = string ws ':' ws, 结束时 curr_pos 指向成员的值 */
+Json::STATUS Json::parse_member_key(const std::string& str, std::string& key,
+                                    JsonContxt& ctx) const {
+    if (ctx.curr_pos == str.npos) {
+        return Json::PARSE_MISS_KEY;
+    }
 
-        json_value->insert_obj(tmp_key, tmp_json_value);
+    Json::STATUS ret = parse_str_raw(str, key, ctx);
+    if (ret != Json::PARSE_OK) {
+        return ret;
+    }
 
-        m_context->curr_pos =
-            str.find_first_not_of(" \t\r\n", m_context->curr_pos);
-        if (str[m_context->curr_pos] == ',') {
-            ++(m_context->curr_pos);
-            m_context->curr_pos =
-                str.find_first_not_of(" \t\r\n", m_context->curr_pos);
-        } else if (str[m_context->curr_pos] == '}') {
-            ++(m_context->curr_pos);
-            return PARSE_OK;
-        }
+    SKIP_WS;
+    if (ctx.curr_pos == str.npos || str[ctx.curr_pos] != ':') {
+        return Json::PARSE_MISS_COLON;
     }
 
-    json_value->set_type(JsonValue::JSON_NULL);
-    return Json::PARSE_MISS_COMMA_OR_CURLY_BRACKET;
+    ++(ctx.curr_pos);
+    SKIP_WS;
+    return Json::PARSE_OK;
 }
+
 }  // end of namespace tihi
\ No newline at end of file
@@ -1,6 +1,11 @@
 #ifndef TIHIJSON_TIHIJSON_H_
 #define TIHIJSON_TIHIJSON_H_
 
+#include <stdint.h>
+#include <sys/uio.h>
+
+#include <atomic>
+#include <functional>
 #include <iostream>
 #include <memory>
 #include <string>
@@ -9,10 +14,178 @@
 
 namespace tihi {
 
-struct JsonContxt {
-    using ptr = std::shared_ptr<JsonContxt>;
+// 内存分配统计, 由 JsonAllocator 自动维护
+struct JsonAllocStats {
+    uint64_t allocations = 0;    // 分配次数
+    uint64_t deallocations = 0;  // 释放次数
+    uint64_t bytes = 0;          // 累计分配字节数
+    uint64_t live_bytes = 0;     // 当前未释放的字节数
+    uint64_t peak_live_bytes = 0;
+};
 
-    size_t curr_pos = 0;
+/*
+ * 可替换的内存分配器. 子类实现 do_allocate/do_deallocate, 返回的内存需要
+ * 按 alignof(std::max_align_t) 对齐. 统计数据不加锁, 同一个分配器同一时刻
+ * 只能被一个线程使用; 分配器必须比用它创建的所有 JsonValue 活得更久.
+ */
+class JsonAllocator {
+public:
+    virtual ~JsonAllocator() {}
+
+    void* allocate(size_t n) {
+        void* p = do_allocate(n);
+        ++m_stats.allocations;
+        m_stats.bytes += n;
+        m_stats.live_bytes += n;
+        if (m_stats.live_bytes > m_stats.peak_live_bytes) {
+            m_stats.peak_live_bytes = m_stats.live_bytes;
+        }
+        return p;
+    }
+
+    void deallocate(void* p, size_t n) {
+        ++m_stats.deallocations;
+        m_stats.live_bytes -= n;
+        do_deallocate(p, n);
+    }
+
+    const JsonAllocStats& stats() const { return m_stats; }
+    // 统计单个文档时, 在解析前调用; 峰值从当前存活字节数重新开始计
+    void reset_stats() {
+        uint64_t live = m_stats.live_bytes;
+        m_stats = JsonAllocStats();
+        m_stats.live_bytes = m_stats.peak_live_bytes = live;
+    }
+
+protected:
+    virtual void* do_allocate(size_t n) = 0;
+    virtual void do_deallocate(void* p, size_t n) = 0;
+
+private:
+    JsonAllocStats m_stats;
+};
+
+// 基于 malloc/free
+class JsonMallocAllocator : public JsonAllocator {
+protected:
+    void* do_allocate(size_t n) override;
+    void do_deallocate(void* p, size_t n) override;
+};
+
+// C 风格的分配函数表, user 原样传回给两个回调
+struct JsonAllocVTable {
+    void* (*allocate)(void* user, size_t n);
+    void (*deallocate)(void* user, void* p, size_t n);
+    void* user;
+};
+
+class JsonVTableAllocator : public JsonAllocator {
+public:
+    explicit JsonVTableAllocator(const JsonAllocVTable& vtable)
+        : m_vtable(vtable) {}
+
+protected:
+    void* do_allocate(size_t n) override;
+    void do_deallocate(void* p, size_t n) override;
+
+private:
+    JsonAllocVTable m_vtable;
+};
+
+// 包装任意标准库风格的分配器 (按字节分配)
+template <class Alloc>
+class JsonStdAllocator : public JsonAllocator {
+public:
+    using char_alloc =
+        typename std::allocator_traits<Alloc>::template rebind_alloc<char>;
+
+    explicit JsonStdAllocator(const Alloc& alloc = Alloc()) : m_alloc(alloc) {}
+
+protected:
+    void* do_allocate(size_t n) override {
+        return std::allocator_traits<char_alloc>::allocate(m_alloc, n);
+    }
+    void do_deallocate(void* p, size_t n) override {
+        std::allocator_traits<char_alloc>::deallocate(
+            m_alloc, static_cast<char*>(p), n);
+    }
+
+private:
+    char_alloc m_alloc;
+};
+
+// 把 JsonAllocator 适配成标准库分配器, 用于 std::allocate_shared 等
+template <class T>
+class JsonStlAllocator {
+public:
+    using value_type = T;
+
+    explicit JsonStlAllocator(JsonAllocator* alloc) : m_alloc(alloc) {}
+    template <class U>
+    JsonStlAllocator(const JsonStlAllocator<U>& other)
+        : m_alloc(other.get()) {}
+
+    T* allocate(size_t n) {
+        return static_cast<T*>(m_alloc->allocate(n * sizeof(T)));
+    }
+    void deallocate(T* p, size_t n) { m_alloc->deallocate(p, n * sizeof(T)); }
+
+    JsonAllocator* get() const { return m_alloc; }
+
+private:
+    JsonAllocator* m_alloc;
+};
+
+template <class T, class U>
+bool operator==(const JsonStlAllocator<T>& a, const JsonStlAllocator<U>& b) {
+    return a.get() == b.get();
+}
+
+template <class T, class U>
+bool operator!=(const JsonStlAllocator<T>& a, const JsonStlAllocator<U>& b) {
+    return a.get() != b.get();
+}
+
+/*
+ * 只构造一次的对象键, 适合反复查找的常量键. 查找时不再构造临时字符串,
+ * 返回引用而不复制 shared_ptr; 与 get_value_from_obj_by_string 一样每次
+ * 都对键求哈希:
+ *
+ *     static const JsonKey kUserId("user_id");
+ *     const JsonValue::ptr& id = request->get(kUserId);
+ */
+class JsonKey {
+public:
+    explicit JsonKey(const std::string& s) : m_str(s) {}
+    explicit JsonKey(std::string&& s) : m_str(std::move(s)) {}
+    explicit JsonKey(const char* s) : m_str(s) {}
+
+    const std::string& str() const { return m_str; }
+
+private:
+    std::string m_str;
+};
+
+class JsonHandler;
+
+/*
+ * 一棵树占用的堆内存, 按类别统计 (字节). 被多个父节点共享的子树只计
+ * 一次. 哈希表节点和 shared_ptr 控制块的大小按常见实现估算, 其余为
+ * 实际的容量.
+ */
+struct JsonMemoryUsage {
+    size_t nodes = 0;        // JsonValue 及其控制块
+    size_t strings = 0;      // 字符串值和对象 key 的堆内存 (已用部分)
+    size_t containers = 0;   // 数组的元素指针和打包的数字 (已用部分)
+    size_t hash_tables = 0;  // 对象的桶 (已用部分) 和哈希表节点
+    size_t caches = 0;       // 序列化缓存和 get_vec() 展开的结果
+    // 以上各类中分配了但未使用的容量: 字符串和数组多出的容量, 空桶
+    size_t slack = 0;
+    size_t node_count = 0;
+
+    size_t total() const {
+        return nodes + strings + containers + hash_tables + caches + slack;
+    }
 };
 
 class JsonValue {
@@ -30,35 +203,429 @@ public:
         JSON_OBJECT = 7
     };
 
+    JsonValue() = default;
+    // 复制出的节点没有父节点, 子节点与原节点共享
+    JsonValue(const JsonValue& other);
+    JsonValue& operator=(const JsonValue& other);
+    ~JsonValue();
+
+    // 创建节点; alloc 不为空时节点和引用计数块都从 alloc 分配
+    static ptr create(JsonAllocator* alloc = nullptr);
+
     int get_type() const;
     void set_type(Type v);
 
     double get_number() const;
     void set_number(double v);
 
+    // 借用输入的字符串 (见 JsonContxt::borrow_strings) 第一次调用时另外
+    // 复制一份返回, 含转义的同时解码; 节点本身仍然借用
     const std::string& get_str() const;
-    void set_str(const std::string v);
+    void set_str(const std::string& v);
+    void set_str(std::string&& v);
     size_t get_str_size() const;
+    // 字符串的字节, 不一定以 '\0' 结尾; 借用且不含转义时直接指向输入,
+    // 不复制. get_str_size() 同样不复制
+    const char* get_str_data() const;
+    // 字符串仍然指向解析时的输入
+    bool is_borrowed() const;
 
+    // 打包的数组 (见 JsonContxt::pack_numbers) 第一次调用时另外展开一份
+    // 子节点返回, 数组本身仍然打包; 修改这些子节点不会改变数组
     const std::vector<ptr>& get_vec() const;
-    void set_vec(const std::vector<ptr> v);
+    void set_vec(const std::vector<ptr>& v);
+    void set_vec(std::vector<ptr>&& v);
     size_t get_vec_size() const;
     void push_back_vec(JsonValue::ptr v);
+    void reserve_vec(size_t n);
+    // 在数组末尾原地创建一个 null 子节点并返回其引用, 由调用方继续设置;
+    // 引用在数组下次被修改前有效
+    JsonValue& emplace_back(JsonAllocator* alloc = nullptr);
+
+    // 元素全是数字的数组可以不为每个元素创建节点, 而把数字连续存放在
+    // 本节点中 (打包). get_packed() 直接返回这些数字; 增删元素时展开为
+    // 普通的子节点, 之后不再打包. 空数组不算打包
+    bool is_packed() const;
+    const std::vector<double>& get_packed() const;
+    void set_packed(const std::vector<double>& v);
+    void set_packed(std::vector<double>&& v);
 
     const std::unordered_map<std::string, ptr>& get_obj() const;
-    void set_obj(const std::unordered_map<std::string, ptr> v);
+    void set_obj(const std::unordered_map<std::string, ptr>& v);
+    void set_obj(std::unordered_map<std::string, ptr>&& v);
     size_t get_obj_size() const;
     void insert_obj(const std::string& k, JsonValue::ptr v);
-    const ptr get_value_from_obj_by_string(const std::string& s);
+    void insert_obj(std::string&& k, JsonValue::ptr v);
+    void reserve_obj(size_t n);
+    // 以 k 为键原地创建一个 null 子节点并返回其引用, 键已存在时替换原节点
+    JsonValue& emplace(const std::string& k, JsonAllocator* alloc = nullptr);
+    JsonValue& emplace(std::string&& k, JsonAllocator* alloc = nullptr);
+    const ptr get_value_from_obj_by_string(const std::string& s) const;
+    // 查找成员, 不构造临时字符串也不复制 shared_ptr; 找不到时返回空指针
+    const ptr& get(const JsonKey& key) const;
+    // 批量查找 n 个键, out[i] 为 keys[i] 对应的成员, 找不到时为 nullptr;
+    // 返回找到的个数. 指针在本对象被修改前有效
+    size_t get(const JsonKey* keys, size_t n, JsonValue** out) const;
+
+    // 结构哈希: 相等 (equals) 的值哈希相同, 对象与成员顺序无关.
+    // 结果缓存在节点上, 修改节点或其子孙后重新计算
+    size_t hash() const;
+    // 深度比较, 先比较哈希, 遇到同一个子节点时直接跳过
+    bool equals(const JsonValue& other) const;
+
+    // 按解析时的顺序把本节点作为事件序列交给 handler, handler 返回
+    // false 时停止并返回 false
+    bool accept(JsonHandler& handler) const;
+
+    // 本节点及子孙占用的内存
+    JsonMemoryUsage memory_usage() const;
+    // 收缩子树中字符串, 数组和哈希表多分配的容量, 并把只被父节点持有的
+    // 子孙节点按深度优先的顺序重新分配 (alloc 为空时使用全局 new), 长期
+    // 保存的树由此集中到一起. 借用输入的字符串被复制, 之后输入可以释放.
+    // 值不变, 对象成员的遍历顺序可能改变; 调用方另外持有的子节点不会移动
+    void compact(JsonAllocator* alloc = nullptr);
+
+private:
+    friend class Json;
+    friend class JsonDocument;
+    friend class TreeBuilder;
+
+    // 把含有子节点的子容器移入 out, 供析构时逐层释放
+    void take_children(std::vector<ptr>& out);
+    // 节点内容即将改变: 使本节点及祖先节点的序列化缓存失效
+    void touch();
+    // 清除仍指向本节点的子节点父指针, 在子节点离开本节点前调用
+    void release_children();
+    // 把 slot 中的子节点替换为 v
+    void replace_child(ptr& slot, ptr v);
+    // 把打包的数字展开为子节点
+    void unpack();
+    // 释放 const 成员函数展开的结果, 在节点内容改变前调用
+    void drop_expanded();
+    // 收缩本节点自身的容量
+    void shrink();
+    // 子节点的哈希都已有效时计算本节点的哈希
+    void compute_hash() const;
+    // 比较本节点, 需要继续比较的子节点对加入 pending
+    bool equals_node(
+        const JsonValue& other,
+        std::vector<std::pair<const JsonValue*, const JsonValue*>>& pending)
+        const;
+    // 把借用的字符串复制到 m_str 中
+    void own_str();
+    // 字符串的字节, 不修改节点; 借用且含转义时解码到 tmp 中
+    const char* str_bytes(std::string& tmp, size_t& size) const;
 
 private:
     Type m_type;
+    // 子树自上次开启缓存的 stringify 以来未被修改; 为 true 时所有子节点
+    // 也为 true
+    mutable bool m_cache_valid = false;
+    // m_hash 有效; 同样保证为 true 时所有子节点也为 true
+    mutable bool m_hash_valid = false;
+    // 借用的字符串含有转义, 取值时需要解码
+    bool m_view_escaped = false;
     double m_number;
     std::string m_str;
+    // 借用的字符串: 输入中两个引号之间的原始字节, 非空时 m_str 为空
+    const char* m_view = nullptr;
+    size_t m_view_size = 0;
     std::vector<ptr> m_vec; 
+    // 打包的数组元素, 非空时 m_vec 为空
+    std::vector<double> m_packed;
     std::unordered_map<std::string, ptr> m_obj;
+
+    // 最近一次插入本节点的容器, 只用于向上传播缓存失效; 节点被多个容器
+    // 共享时只记录其中一个, 这类节点须经 JsonDocument 修改
+    JsonValue* m_parent = nullptr;
+    // 容器序列化结果的缓存, 只在 m_cache_valid 时有效
+    mutable std::unique_ptr<std::string> m_cache;
+    mutable size_t m_hash = 0;
+
+    // const 成员函数展开的结果, 不改变节点的值. 多个线程同时创建时只有
+    // 一个被保存, 之后不再修改, 节点内容改变时释放
+    struct Expanded {
+        std::vector<ptr> vec;  // 打包数组的子节点
+        std::string str;       // 借用的字符串, 已解码
+    };
+    // 返回展开的结果, 第一次调用时创建
+    const Expanded& expanded() const;
+    mutable std::atomic<Expanded*> m_expanded{nullptr};
+};
+
+/*
+ * 写时复制的文档. 复制 JsonDocument (或 clone()) 只复制根指针, 多个文档
+ * 共享同一棵树; 通过 mutate()/set() 修改时, 只复制从根到目标节点路径上
+ * 被共享的节点, 其余子树继续共享.
+ *
+ * 路径使用 JSON Pointer (RFC 6901), 例如 "/servers/0/port", "" 表示根.
+ * 共享中的节点不能绕过 JsonDocument 直接修改; 调用方额外持有的节点指针
+ * 也算作共享, 会使 mutate() 复制该节点.
+ */
+class JsonDocument {
+public:
+    using ptr = std::shared_ptr<JsonDocument>;
+
+    JsonDocument() : m_root(JsonValue::create()) {
+        m_root->set_type(JsonValue::JSON_NULL);
+    }
+    explicit JsonDocument(JsonValue::ptr root) : m_root(root) {}
+
+    JsonDocument clone() const { return *this; }
+
+    // 只读访问, 不能通过返回的指针修改
+    const JsonValue::ptr& root() const { return m_root; }
+    // 找不到时返回 nullptr; 不修改树, 打包数组的元素见 JsonValue::get_vec()
+    JsonValue::ptr find(const std::string& pointer) const;
+
+    JsonMemoryUsage memory_usage() const { return m_root->memory_usage(); }
+    // 见 JsonValue::compact; 与其他文档共享的节点同样只收缩容量, 不移动
+    void compact(JsonAllocator* alloc = nullptr) { m_root->compact(alloc); }
+
+    // 返回 pointer 指向节点的独占副本, 可以直接调用其 set_* 修改;
+    // 找不到时返回 nullptr
+    JsonValue::ptr mutate(const std::string& pointer);
+    // 把 pointer 指向的位置设为 value: 对象成员不存在时插入, 数组下标
+    // 为 "-" 时追加; 父节点不存在或类型不符时返回 false
+    bool set(const std::string& pointer, JsonValue::ptr value);
+
+private:
+    // 保证 slot 中的节点只被 parent 持有, 必要时复制
+    static void make_unique(JsonValue::ptr& slot, JsonValue* parent);
+
+private:
+    JsonValue::ptr m_root;
+};
+
+/*
+ * 流式构建器, 按顺序描述文档即可直接在目标容器中创建节点:
+ *
+ *     JsonBuilder b;
+ *     b.start_object().key("id").number(1)
+ *      .key("tags").start_array().string("a").string("b").end_array()
+ *      .end_object();
+ *     JsonValue::ptr v = b.take();
+ *
+ * 字符串和键可以按右值传入以避免复制. 调用顺序错误 (对象中缺少键,
+ * 括号不匹配, 文档未完成就 take() 等) 触发断言.
+ */
+class JsonBuilder {
+public:
+    explicit JsonBuilder(JsonAllocator* alloc = nullptr);
+
+    JsonBuilder& null();
+    JsonBuilder& boolean(bool v);
+    JsonBuilder& number(double v);
+    JsonBuilder& string(const std::string& v);
+    JsonBuilder& string(std::string&& v);
+
+    // reserve 为预计的元素个数, 0 表示不预留
+    JsonBuilder& start_array(size_t reserve = 0);
+    JsonBuilder& end_array();
+    JsonBuilder& start_object(size_t reserve = 0);
+    JsonBuilder& end_object();
+    JsonBuilder& key(const std::string& k);
+    JsonBuilder& key(std::string&& k);
+
+    // 取出构建好的文档, 构建器恢复为初始状态可继续使用
+    JsonValue::ptr take();
+
+private:
+    // 在当前容器中 (或作为根) 创建下一个值
+    JsonValue& next();
+
+private:
+    JsonAllocator* m_alloc;
+    JsonValue::ptr m_root;
+    std::vector<JsonValue*> m_stack;  // 尚未结束的容器
+    std::string m_key;
+    bool m_has_key;
+};
+
+/*
+ * 解析事件 (SAX) 接口. Json::parse(str, handler, ctx) 只产生事件,
+ * 不构造 JsonValue; 也可以设为 JsonContxt::observer, 在构造树的同时
+ * 观察事件. 任一回调返回 false 时解析中止, 返回 PARSE_REJECTED.
+ *
+ * 对象成员的顺序为 start_object, (key, 值)..., end_object; string 与
+ * key 的参数只在回调期间有效.
+ */
+class JsonHandler {
+public:
+    virtual ~JsonHandler() {}
+
+    // Json::parse 开始解析一个文档时调用
+    virtual void start_document() {}
+    virtual bool null() { return true; }
+    virtual bool boolean(bool) { return true; }
+    virtual bool number(double) { return true; }
+    virtual bool string(const std::string&) { return true; }
+    virtual bool start_object() { return true; }
+    virtual bool key(const std::string&) { return true; }
+    virtual bool end_object() { return true; }
+    virtual bool start_array() { return true; }
+    virtual bool end_array() { return true; }
 };
 
+// 单个阶段的耗时统计
+struct JsonPhaseStats {
+    uint64_t ns = 0;     // 累计耗时 (纳秒)
+    uint64_t bytes = 0;  // 处理的字节数
+    uint64_t calls = 0;  // 调用次数
+};
+
+/*
+ * 解析/序列化各阶段的统计, 只有定义了 TIHIJSON_PROFILE (cmake
+ * -DTIHIJSON_PROFILE=ON) 时才会记录, 否则始终为 0.
+ */
+struct JsonStats {
+    JsonPhaseStats whitespace;  // 跳过空白
+    JsonPhaseStats string;      // 字符串 (含对象的 key) 解码
+    JsonPhaseStats number;      // 数字转换
+    JsonPhaseStats alloc;       // 节点分配, bytes 为节点大小之和
+    JsonPhaseStats insert;      // 挂到数组/对象上
+    JsonPhaseStats stringify;   // 序列化, bytes 为输出长度
+
+    void reset() { *this = JsonStats(); }
+};
+
+struct JsonContxt {
+    using ptr = std::shared_ptr<JsonContxt>;
+
+    // 解析栈中的一层: 数组还是对象, 对象当前成员的 key, 以及构造树时
+    // 正在构造的容器节点
+    struct Frame {
+        Frame(JsonValue::ptr v) : value(v) {}
+
+        JsonValue::ptr value;
+        std::string key;
+        bool array = false;
+    };
+
+    JsonContxt() { stack.reserve(32); }
+
+    // 栈只增不减, 弹出的 Frame 保留 key 的内存供下次复用
+    Frame& push_frame(JsonValue::ptr v) {
+        if (depth == stack.size()) {
+            stack.emplace_back(v);
+        } else {
+            stack[depth].value = v;
+        }
+        return stack[depth++];
+    }
+    void pop_frame() { stack[--depth].value.reset(); }
+    Frame& top_frame() { return stack[depth - 1]; }
+    void clear_stack() {
+        while (depth > 0) {
+            pop_frame();
+        }
+    }
+
+    size_t curr_pos = 0;
+    // 允许的最大嵌套层数, 超过返回 PARSE_DEPTH_EXCEEDED
+    size_t max_depth = 1024;
+    // 显式解析栈及其当前深度, 在多次解析之间复用
+    std::vector<Frame> stack;
+    size_t depth = 0;
+    // 解析字符串时的临时缓冲区
+    std::string scratch;
+    // 解析前先检查整个输入是否为合法 UTF-8
+    bool validate_utf8 = false;
+    // 解析时创建节点使用的分配器, 为空时使用全局 new
+    JsonAllocator* allocator = nullptr;
+    // 开启 TIHIJSON_PROFILE 时的各阶段统计, 跨多次调用累加
+    JsonStats stats;
+    // stringify 时在容器节点上缓存序列化结果, 之后只重新生成被修改过的
+    // 子树. 缓存额外占用的内存约为输出大小乘以嵌套层数
+    bool cache_subtrees = false;
+    // 序列化结果短于该长度的容器不保存缓存
+    size_t cache_min_bytes = 64;
+    // 解析时相等的子树 (包括标量) 只保存一份, 由多个父节点共享.
+    // 这样的文档必须通过 JsonDocument 修改
+    bool dedup = false;
+    // 去重时按结构哈希索引已解析的节点, 每次解析结束后清空
+    std::unordered_multimap<size_t, JsonValue::ptr> dedup_table;
+    // 构造树时同时接收解析事件, 例如 schema 校验; 返回 false 时解析中止
+    JsonHandler* observer = nullptr;
+    // stringify 使用的线程数. 大于 1 时, 子节点不少于
+    // parallel_min_children 的数组/对象分块交给多个线程序列化, 输出与
+    // 单线程完全相同. 开启 cache_subtrees 时不并行
+    size_t stringify_threads = 1;
+    size_t parallel_min_children = 4096;
+    // 构造树时把元素全是数字的数组打包存放 (JsonValue::get_packed),
+    // 每个元素只占 8 字节, 不再是一个节点
+    bool pack_numbers = false;
+    // 构造树时字符串值不复制, 节点直接指向输入中的字节, 含转义的字符串
+    // 在第一次取值 (get_str) 时才解码. 输入必须在树 (或 compact 之前)
+    // 一直有效且不被修改; JsonStreamReader 会复用输入缓冲区, 解析前总是
+    // 关闭它. 对象的 key 总是复制
+    bool borrow_strings = false;
+};
+
+/*
+ * 分散输出 (scatter-gather) 的序列化结果, 可以直接交给 writev/sendmsg.
+ * 结构字符, 数字和短字符串写入内部缓冲区; 长度不小于 min_ref_bytes 且
+ * 不需要转义的字符串值不复制, iovec 直接指向节点中的字节, 因此结果只在
+ * 树被修改或销毁前有效.
+ *
+ *     JsonIovec out;
+ *     json.stringify(out, value, ctx);
+ *     out.write(fd);   // 或 writev(fd, out.iov().data(), ...)
+ */
+class JsonIovec {
+public:
+    // 不短于该长度的字符串值以引用方式输出
+    size_t min_ref_bytes = 1024;
+
+    const std::vector<struct iovec>& iov() const { return m_iov; }
+    // 输出的总字节数, 以及其中引用而未复制的字节数
+    size_t size() const { return m_size; }
+    size_t referenced_bytes() const { return m_referenced; }
+    // 拼接为一个字符串
+    std::string to_string() const;
+    // 写入 fd, 按 IOV_MAX 分批并处理部分写入; 失败时返回 false, 保留 errno
+    bool write(int fd) const;
+    void clear();
+
+private:
+    friend class Json;
+
+    // 引用的字节插在缓冲区的 pos 处
+    struct Ref {
+        size_t pos;
+        const char* data;
+        size_t size;
+    };
+
+    void add_ref(const char* data, size_t size);
+    // 序列化结束后生成 m_iov
+    void finish();
+
+    std::string m_buffer;
+    std::vector<Ref> m_refs;
+    std::vector<struct iovec> m_iov;
+    size_t m_size = 0;
+    size_t m_referenced = 0;
+};
+
+/*
+ * 线程安全约定:
+ * - JsonValue 的 const 成员函数可以被多个线程同时调用, 非 const 成员函数
+ *   需要调用方自行同步.
+ * - JsonContxt 保存一次解析的全部可变状态, 同一时刻只能被一个线程使用.
+ * - Json 本身只保存配置, parse(str, value, ctx) 与 stringify 为 const,
+ *   多个线程可以共享同一个 Json, 每个线程传入自己的 JsonContxt
+ *   (例如 thread_local). parse(str, value) 使用构造时传入的 JsonContxt,
+ *   因此同一个 Json 不能在多个线程中同时调用这个重载. 开启
+ *   TIHIJSON_PROFILE 时 stringify(str, value) 同样会写这个上下文.
+ * - 开启 JsonContxt::cache_subtrees 时 stringify 会写节点上的缓存,
+ *   同一棵树不能同时在多个线程中以这种方式序列化. JsonValue::hash()
+ *   和 equals() 同样会写缓存的哈希, 哈希已经算好的树 (如 JsonParseCache
+ *   返回的树) 只读取.
+ * - 对打包的数组调用 get_vec() 不会修改数组, 可以与其他线程同时进行.
+ * - 对借用输入的字符串调用 get_str(), get_str_data() 和 get_str_size()
+ *   同样不修改节点, 可以与其他线程同时进行.
+ */
 class Json {
 public:
     using ptr = std::shared_ptr<Json>;
@@ -82,22 +649,66 @@ public:
 
         STRINGIFY_OK = 14,
         STRINGIFY_ERROR = 14,
+
+        PARSE_DEPTH_EXCEEDED = 15,    // 嵌套层数超过 max_depth
+        PARSE_INVALID_UTF8 = 16,      // 输入不是合法的 UTF-8
+        PARSE_READ_ERROR = 17,        // 读取输入失败
+        PARSE_REJECTED = 18,          // JsonHandler 中止了解析
     };
 
     STATUS parse(const std::string& str, JsonValue::ptr json_value);
-    int stringify(std::string& str, JsonValue::ptr json_value);
+    // 使用调用方提供的上下文解析, 可在多个线程中并发调用
+    STATUS parse(const std::string& str, JsonValue::ptr json_value,
+                 JsonContxt& context) const;
+    // 只把解析事件交给 handler, 不构造 JsonValue
+    STATUS parse(const std::string& str, JsonHandler& handler,
+                 JsonContxt& context) const;
+    int stringify(std::string& str, JsonValue::ptr json_value) const;
+    int stringify(std::string& str, JsonValue::ptr json_value,
+                  JsonContxt& context) const;
+    // 输出为 iovec 列表, 见 JsonIovec. 不使用 cache_subtrees 和
+    // stringify_threads
+    int stringify(JsonIovec& out, JsonValue::ptr json_value) const;
+    int stringify(JsonIovec& out, JsonValue::ptr json_value,
+                  JsonContxt& context) const;
+
+    // 构造时传入的上下文中累计的统计
+    const JsonStats& stats() const { return m_context->stats; }
+    void reset_stats() { m_context->stats.reset(); }
 
 private:
-    STATUS parse_value(const std::string& str, JsonValue::ptr json_value);
-    STATUS parse_null(const std::string& str, JsonValue::ptr json_value);
-    STATUS parse_false(const std::string& str, JsonValue::ptr json_value);
-    STATUS parse_true(const std::string& str, JsonValue::ptr json_value);
-    bool is_number(const std::string& str);
-    STATUS parse_number(const std::string& str, JsonValue::ptr json_value);
-    STATUS parse_str(const std::string& str, JsonValue::ptr json_value);
-    STATUS parse_str_raw(const std::string& str, std::string& ret);
-    STATUS parse_vec(const std::string& str, JsonValue::ptr json_value);
-    STATUS parse_obj(const std::string& str, JsonValue::ptr json_value);
+    // 把 value 序列化后追加到 str; iov 不为空时长字符串记为引用
+    int stringify_value(std::string& str, const JsonValue& value,
+                        JsonContxt& ctx, JsonIovec* iov = nullptr) const;
+    // 用 threads 个线程序列化 value 的子节点, 再按顺序拼接到 str
+    int stringify_parallel(std::string& str, const JsonValue& value,
+                           size_t threads) const;
+
+    // 解析整个输入 (跳过首尾空白, 检查 UTF-8 与多余字符), 事件交给 h.
+    // Handler 为 .cc 中的树构造器或 JsonHandler 的适配器
+    template <class Handler>
+    STATUS parse_document(const std::string& str, Handler& h,
+                          JsonContxt& ctx) const;
+    template <class Handler>
+    STATUS parse_value(const std::string& str, Handler& h,
+                       JsonContxt& ctx) const;
+    template <class Handler>
+    STATUS parse_scalar(const std::string& str, Handler& h,
+                        JsonContxt& ctx) const;
+    STATUS parse_literal(const std::string& str, const char* literal,
+                         size_t len, JsonContxt& ctx) const;
+    bool is_number(const std::string& str, JsonContxt& ctx) const;
+    STATUS parse_number(const std::string& str, double& number,
+                        JsonContxt& ctx) const;
+    // 字符串解码到 ctx.scratch
+    STATUS parse_str(const std::string& str, JsonContxt& ctx) const;
+    // 只检查字符串而不解码, 供 JsonContxt::borrow_strings 使用
+    STATUS parse_str_view(const std::string& str, bool& escaped,
+                          JsonContxt& ctx) const;
+    STATUS parse_str_raw(const std::string& str, std::string& ret,
+                         JsonContxt& ctx) const;
+    STATUS parse_member_key(const std::string& str, std::string& key,
+                            JsonContxt& ctx) const;
 
 private:
     JsonContxt::ptr m_context;
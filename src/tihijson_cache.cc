@@ -0,0 +1,135 @@
+#include "tihijson_cache.h"
+
+namespace tihi {
+
+Json::STATUS JsonParseCache::parse(const std::string& str, JsonDocument& out,
+                                   JsonContxt& ctx) {
+    if (ctx.observer != nullptr) {
+        // 命中时没有解析事件, observer 的检查会被绕过
+        JsonValue::ptr root = JsonValue::create(ctx.allocator);
+        Json::STATUS ret = m_json.parse(str, root, ctx);
+        if (ret == Json::PARSE_OK) {
+            out = JsonDocument(root);
+        }
+        return ret;
+    }
+
+    size_t hash = std::hash<std::string>()(str);
+    Options options(ctx);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        const Entry* e = find(hash, str, options);
+        if (e != nullptr) {
+            ++m_hits;
+            out = e->doc;
+            return Json::PARSE_OK;
+        }
+        ++m_misses;
+    }
+
+    // 缓存的树被共享且长期保存, 不能指向调用方的输入或使用调用方的分配器
+    bool pack_numbers = ctx.pack_numbers;
+    bool borrow_strings = ctx.borrow_strings;
+    JsonAllocator* allocator = ctx.allocator;
+    ctx.pack_numbers = false;
+    ctx.borrow_strings = false;
+    ctx.allocator = nullptr;
+    JsonValue::ptr root = JsonValue::create();
+    Json::STATUS ret = m_json.parse(str, root, ctx);
+    ctx.pack_numbers = pack_numbers;
+    ctx.borrow_strings = borrow_strings;
+    ctx.allocator = allocator;
+    if (ret != Json::PARSE_OK) {
+        return ret;
+    }
+
+    // 命中者会在各自的线程中调用 hash()/equals(), 插入前算好哈希,
+    // 之后它们只读取
+    root->hash();
+    JsonDocument doc(root);
+    size_t bytes = sizeof(Entry) + str.size() + doc.memory_usage().total();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    // 解析期间其他线程可能已经缓存了相同的输入
+    const Entry* e = find(hash, str, options);
+    if (e != nullptr) {
+        out = e->doc;
+        return Json::PARSE_OK;
+    }
+    out = doc;
+    if (bytes > m_max_bytes) {
+        return Json::PARSE_OK;
+    }
+    m_lru.push_front(Entry{hash, str, options, std::move(doc), bytes});
+    m_index.emplace(hash, m_lru.begin());
+    m_bytes += bytes;
+    evict();
+    return Json::PARSE_OK;
+}
+
+const JsonParseCache::Entry* JsonParseCache::find(size_t hash,
+                                                  const std::string& str,
+                                                  const Options& options) {
+    auto range = m_index.equal_range(hash);
+    for (auto it = range.first; it != range.second; ++it) {
+        if (it->second->options == options && it->second->input == str) {
+            m_lru.splice(m_lru.begin(), m_lru, it->second);
+            return &*it->second;
+        }
+    }
+    return nullptr;
+}
+
+void JsonParseCache::evict() {
+    while (m_bytes > m_max_bytes && !m_lru.empty()) {
+        Entry& e = m_lru.back();
+        auto range = m_index.equal_range(e.hash);
+        for (auto it = range.first; it != range.second; ++it) {
+            if (&*it->second == &e) {
+                m_index.erase(it);
+                break;
+            }
+        }
+        m_bytes -= e.bytes;
+        m_lru.pop_back();
+    }
+}
+
+void JsonParseCache::set_max_bytes(size_t n) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_max_bytes = n;
+    evict();
+}
+
+size_t JsonParseCache::max_bytes() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_max_bytes;
+}
+
+void JsonParseCache::clear() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_index.clear();
+    m_lru.clear();
+    m_bytes = 0;
+}
+
+size_t JsonParseCache::size() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_lru.size();
+}
+
+size_t JsonParseCache::bytes() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_bytes;
+}
+
+size_t JsonParseCache::hits() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_hits;
+}
+
+size_t JsonParseCache::misses() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_misses;
+}
+
+}  // end of namespace tihi
@@ -0,0 +1,99 @@
+#ifndef TIHIJSON_TIHIJSON_CACHE_H_
+#define TIHIJSON_TIHIJSON_CACHE_H_
+
+#include <stddef.h>
+
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "tihijson.h"
+
+namespace tihi {
+
+/*
+ * 按内容缓存的解析结果. 输入与之前某次成功解析的输入逐字节相同时不再
+ * 解析, 直接返回与之前的结果共享同一棵树的 JsonDocument. 以输入的哈希
+ * 索引, 哈希相同时再完整比较输入. 占用的内存 (输入加上树) 超过
+ * max_bytes 时淘汰最近最少使用的结果:
+ *
+ *     static JsonParseCache cache(64 << 20);
+ *     thread_local JsonContxt ctx;
+ *     JsonDocument doc;
+ *     if (cache.parse(body, doc, ctx) == Json::PARSE_OK) ...
+ *
+ * 可以被多个线程同时使用, 解析在锁外进行. 返回的树被所有命中者共享, 只能
+ * 读取或经 JsonDocument::mutate()/set() 写时复制地修改, 不能 compact(),
+ * 也不能用开启 cache_subtrees 的上下文 stringify (会写节点上的缓存).
+ * 哈希在缓存前已经算好, hash() 和 equals() 只读取, 可以同时调用.
+ * 缓存的树不借用字符串 (输入属于调用方), 不打包数字, 也不使用 ctx 中
+ * 的分配器. 影响解析结果的选项 (max_depth, validate_utf8, dedup) 是
+ * 缓存键的一部分, 选项不同的调用方不会命中彼此的结果. 设置了
+ * ctx.observer 时 (例如 schema 校验) 总是直接解析, 不读也不写缓存.
+ * 解析失败的输入不缓存.
+ */
+class JsonParseCache {
+public:
+    explicit JsonParseCache(size_t max_bytes = 64 << 20)
+        : m_max_bytes(max_bytes) {}
+
+    Json::STATUS parse(const std::string& str, JsonDocument& out,
+                       JsonContxt& ctx);
+
+    // 调整上限, 立即淘汰超出的部分; 单个结果超过上限时不缓存
+    void set_max_bytes(size_t n);
+    size_t max_bytes() const;
+    void clear();
+
+    size_t size() const;   // 缓存的结果数
+    size_t bytes() const;  // 占用的内存
+    size_t hits() const;
+    size_t misses() const;
+
+private:
+    // 影响解析结果的选项
+    struct Options {
+        size_t max_depth;
+        bool validate_utf8;
+        bool dedup;
+
+        explicit Options(const JsonContxt& ctx)
+            : max_depth(ctx.max_depth),
+              validate_utf8(ctx.validate_utf8),
+              dedup(ctx.dedup) {}
+        bool operator==(const Options& other) const {
+            return max_depth == other.max_depth &&
+                   validate_utf8 == other.validate_utf8 &&
+                   dedup == other.dedup;
+        }
+    };
+
+    struct Entry {
+        size_t hash;
+        std::string input;
+        Options options;
+        JsonDocument doc;
+        size_t bytes;
+    };
+    using List = std::list<Entry>;
+
+    // 以下需持有 m_mutex
+    // 查找并移到表头, 找不到时返回 nullptr
+    const Entry* find(size_t hash, const std::string& str,
+                      const Options& options);
+    void evict();
+
+    mutable std::mutex m_mutex;
+    Json m_json;
+    size_t m_max_bytes;
+    size_t m_bytes = 0;
+    size_t m_hits = 0;
+    size_t m_misses = 0;
+    List m_lru;  // 表头为最近使用的结果
+    std::unordered_multimap<size_t, List::iterator> m_index;
+};
+
+}  // end of namespace tihi
+
+#endif  // TIHIJSON_TIHIJSON_CACHE_H_
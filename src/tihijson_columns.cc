@@ -0,0 +1,298 @@
+#include "tihijson_columns.h"
+
+#include <math.h>
+
+namespace tihi {
+
+static void append_null(JsonColumns::Column& col) {
+    switch (col.type) {
+        case JsonColumns::DOUBLE:
+            col.doubles.push_back(0);
+            break;
+        case JsonColumns::INT64:
+            col.ints.push_back(0);
+            break;
+        case JsonColumns::BOOL:
+            col.bools.push_back(0);
+            break;
+        case JsonColumns::STRING:
+            col.offsets.push_back(col.bytes.size());
+            break;
+    }
+}
+
+// 去掉当前行已写入的值, 用于重复的 key
+static void drop_last(JsonColumns::Column& col) {
+    switch (col.type) {
+        case JsonColumns::DOUBLE:
+            col.doubles.pop_back();
+            break;
+        case JsonColumns::INT64:
+            col.ints.pop_back();
+            break;
+        case JsonColumns::BOOL:
+            col.bools.pop_back();
+            break;
+        case JsonColumns::STRING:
+            col.offsets.pop_back();
+            col.bytes.resize(col.offsets.back());
+            break;
+    }
+}
+
+static void set_valid(JsonColumns::Column& col, size_t row, bool valid) {
+    if ((row & 7) == 0) {
+        col.validity.push_back(0);
+    }
+    if (valid) {
+        col.validity.back() |= 1u << (row & 7);
+    } else {
+        ++col.null_count;
+    }
+}
+
+size_t JsonColumns::add_column(const std::string& name, Type type) {
+    auto it = m_index.find(name);
+    if (it != m_index.end()) {
+        return it->second;
+    }
+    m_columns.emplace_back();
+    Column& col = m_columns.back();
+    col.name = name;
+    col.type = type;
+    if (type == STRING) {
+        col.offsets.push_back(0);
+    }
+    for (size_t row = 0; row < m_rows; ++row) {
+        append_null(col);
+        set_valid(col, row, false);
+    }
+    m_cells.emplace_back();
+    m_index[name] = m_columns.size() - 1;
+    return m_columns.size() - 1;
+}
+
+const JsonColumns::Column* JsonColumns::column(const std::string& name) const {
+    auto it = m_index.find(name);
+    return it == m_index.end() ? nullptr : &m_columns[it->second];
+}
+
+void JsonColumns::clear() {
+    for (auto& col : m_columns) {
+        col.doubles.clear();
+        col.ints.clear();
+        col.bools.clear();
+        col.offsets.clear();
+        if (col.type == STRING) {
+            col.offsets.push_back(0);
+        }
+        col.bytes.clear();
+        col.validity.clear();
+        col.null_count = 0;
+    }
+    for (auto& cell : m_cells) {
+        cell = Cell();
+    }
+    m_rows = 0;
+    m_error.clear();
+}
+
+bool JsonColumns::extract(const JsonValue& value) {
+    start_document();
+    return value.accept(*this);
+}
+
+void JsonColumns::start_document() {
+    m_depth = 0;
+    m_row_depth = 0;
+    m_key = SIZE_MAX;
+    m_error.clear();
+}
+
+bool JsonColumns::not_object() {
+    m_error = "row " + std::to_string(m_rows) + " is not an object";
+    return false;
+}
+
+bool JsonColumns::fail(const Column& col, const char* expect) {
+    m_error = "row " + std::to_string(m_rows) + ": field \"" + col.name +
+              "\" must be " + expect;
+    return false;
+}
+
+bool JsonColumns::begin_cell(Column*& col) {
+    col = nullptr;
+    if (m_depth == 0 || m_depth < m_row_depth) {
+        return not_object();
+    }
+    if (m_depth > m_row_depth || m_key == SIZE_MAX) {
+        return true;
+    }
+    col = &m_columns[m_key];
+    Cell& cell = m_cells[m_key];
+    if (cell.row == m_rows) {
+        if (!cell.null) {
+            drop_last(*col);
+        }
+    } else {
+        cell.row = m_rows;
+    }
+    cell.null = false;
+    return true;
+}
+
+bool JsonColumns::null() {
+    Column* col;
+    if (!begin_cell(col)) {
+        return false;
+    }
+    if (col != nullptr) {
+        m_cells[m_key].null = true;
+    }
+    return true;
+}
+
+bool JsonColumns::boolean(bool b) {
+    Column* col;
+    if (!begin_cell(col)) {
+        return false;
+    }
+    if (col == nullptr) {
+        return true;
+    }
+    if (col->type != BOOL) {
+        return fail(*col, col->type == STRING ? "a string" : "a number");
+    }
+    col->bools.push_back(b);
+    return true;
+}
+
+bool JsonColumns::number(double d) {
+    Column* col;
+    if (!begin_cell(col)) {
+        return false;
+    }
+    if (col == nullptr) {
+        return true;
+    }
+    switch (col->type) {
+        case DOUBLE:
+            col->doubles.push_back(d);
+            return true;
+        case INT64:
+            // 数字经 double 传入, 绝对值达到 2^53 时可能已经被舍入
+            if (d != floor(d) || d <= -9007199254740992.0 ||
+                d >= 9007199254740992.0) {
+                return fail(*col, "an integer with magnitude below 2^53");
+            }
+            col->ints.push_back(static_cast<int64_t>(d));
+            return true;
+        case BOOL:
+            return fail(*col, "a boolean");
+        case STRING:
+            break;
+    }
+    return fail(*col, "a string");
+}
+
+bool JsonColumns::string(const std::string& s) {
+    Column* col;
+    if (!begin_cell(col)) {
+        return false;
+    }
+    if (col == nullptr) {
+        return true;
+    }
+    switch (col->type) {
+        case DOUBLE:
+        case INT64:
+            return fail(*col, "a number");
+        case BOOL:
+            return fail(*col, "a boolean");
+        case STRING:
+            break;
+    }
+    col->bytes.append(s);
+    col->offsets.push_back(col->bytes.size());
+    return true;
+}
+
+// 行之外或字段值中的容器
+bool JsonColumns::container() {
+    if (m_depth < m_row_depth) {
+        return not_object();
+    }
+    if (m_depth == m_row_depth && m_key != SIZE_MAX) {
+        const Column& col = m_columns[m_key];
+        switch (col.type) {
+            case DOUBLE:
+            case INT64:
+                return fail(col, "a number");
+            case BOOL:
+                return fail(col, "a boolean");
+            case STRING:
+                return fail(col, "a string");
+        }
+    }
+    ++m_depth;
+    return true;
+}
+
+void JsonColumns::start_row() {
+    ++m_depth;
+    m_key = SIZE_MAX;
+}
+
+void JsonColumns::end_row() {
+    for (size_t i = 0; i < m_columns.size(); ++i) {
+        Column& col = m_columns[i];
+        const Cell& cell = m_cells[i];
+        bool seen = cell.row == m_rows;
+        if (!seen || cell.null) {
+            append_null(col);
+        }
+        set_valid(col, m_rows, seen && !cell.null);
+    }
+    ++m_rows;
+}
+
+bool JsonColumns::start_object() {
+    if (m_depth == 0) {
+        m_row_depth = 1;
+    } else if (m_depth != 1 || m_row_depth != 2) {
+        return container();
+    }
+    start_row();
+    return true;
+}
+
+bool JsonColumns::key(const std::string& k) {
+    if (m_depth == m_row_depth) {
+        auto it = m_index.find(k);
+        m_key = it == m_index.end() ? SIZE_MAX : it->second;
+    }
+    return true;
+}
+
+bool JsonColumns::end_object() {
+    if (--m_depth == m_row_depth - 1) {
+        end_row();
+    }
+    return true;
+}
+
+bool JsonColumns::start_array() {
+    if (m_depth == 0) {
+        m_row_depth = 2;
+        ++m_depth;
+        return true;
+    }
+    return container();
+}
+
+bool JsonColumns::end_array() {
+    --m_depth;
+    return true;
+}
+
+}  // end of namespace tihi
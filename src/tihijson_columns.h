@@ -0,0 +1,120 @@
+#ifndef TIHIJSON_TIHIJSON_COLUMNS_H_
+#define TIHIJSON_TIHIJSON_COLUMNS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "tihijson.h"
+
+namespace tihi {
+
+/*
+ * 把由对象组成的数组按字段拆成列, 每个单元格不构造 JsonValue.
+ * 作为 JsonHandler 交给 Json::parse 或 JsonStreamReader, 或用
+ * extract() 从已有的树中提取:
+ *
+ *     JsonColumns cols;
+ *     size_t price = cols.add_column("price", JsonColumns::DOUBLE);
+ *     size_t name = cols.add_column("name", JsonColumns::STRING);
+ *     json.parse(str, cols, ctx);   // [{"price": 1.5, "name": "a"}, ...]
+ *     const double* p = cols.column(price).doubles.data();
+ *
+ * 文档的根是对象数组时每个元素为一行, 根是对象时整个对象为一行
+ * (适合 NDJSON). 多个文档的行依次追加, clear() 清空.
+ *
+ * 缺少的字段和 null 记为空值: 有效位清 0, 数据取 0 或空串. 重复的 key
+ * 以最后一个为准 (与构造树一致). 未请求的字段被跳过; 请求的字段类型
+ * 不符 (包括数组和对象) 时中止解析, Json::parse 返回 PARSE_REJECTED,
+ * 此时最后一行不完整, 需要 clear() 后才能继续使用.
+ */
+class JsonColumns : public JsonHandler {
+public:
+    enum Type {
+        DOUBLE,
+        // 必须是整数且绝对值小于 2^53: 数字按 double 解析, 更大的整数
+        // 可能已被舍入, 无法保证精确
+        INT64,
+        BOOL,
+        STRING,
+    };
+
+    struct Column {
+        std::string name;
+        Type type;
+        std::vector<double> doubles;  // DOUBLE
+        std::vector<int64_t> ints;    // INT64
+        std::vector<uint8_t> bools;   // BOOL, 0 或 1
+        // STRING: 第 i 行为 bytes[offsets[i], offsets[i + 1])
+        std::vector<size_t> offsets;
+        std::string bytes;
+        // 有效位, 第 i 行为 validity[i / 8] 的第 i % 8 位 (低位在前)
+        std::vector<uint8_t> validity;
+        size_t null_count = 0;
+
+        bool is_null(size_t row) const {
+            return (validity[row >> 3] & (1u << (row & 7))) == 0;
+        }
+    };
+
+    // 返回列的下标; 已有行时新列的这些行为空值, 同名的列返回已有的下标
+    size_t add_column(const std::string& name, Type type);
+    size_t columns() const { return m_columns.size(); }
+    size_t rows() const { return m_rows; }
+    const Column& column(size_t i) const { return m_columns[i]; }
+    // 不存在时返回 nullptr
+    const Column* column(const std::string& name) const;
+
+    // 清空数据, 保留列的定义
+    void clear();
+    // 从已有的树中提取, 失败时返回 false
+    bool extract(const JsonValue& value);
+
+    // 最近一次失败的原因, 未失败时为空
+    const std::string& error() const { return m_error; }
+    bool failed() const { return !m_error.empty(); }
+
+    void start_document() override;
+    bool null() override;
+    bool boolean(bool b) override;
+    bool number(double d) override;
+    bool string(const std::string& s) override;
+    bool start_object() override;
+    bool key(const std::string& k) override;
+    bool end_object() override;
+    bool start_array() override;
+    bool end_array() override;
+
+private:
+    // 当前行中每一列的状态
+    struct Cell {
+        size_t row = SIZE_MAX;  // 本行已出现时等于 m_rows
+        bool null = false;
+    };
+
+    // 标量值对应的列, 出错时返回 false; 不在行内或未请求的字段 col 为
+    // nullptr
+    bool begin_cell(Column*& col);
+    bool container();
+    void start_row();
+    void end_row();
+    bool not_object();
+    bool fail(const Column& col, const char* expect);
+
+    std::vector<Column> m_columns;
+    std::vector<Cell> m_cells;
+    std::unordered_map<std::string, size_t> m_index;
+    size_t m_rows = 0;
+
+    size_t m_depth = 0;  // 当前所在的容器层数
+    size_t m_row_depth = 0;  // 行对象的层数: 根是数组时为 2, 是对象时为 1
+    size_t m_key = SIZE_MAX;  // 当前 key 对应的列
+    std::string m_error;
+};
+
+}  // end of namespace tihi
+
+#endif  // TIHIJSON_TIHIJSON_COLUMNS_H_
@@ -0,0 +1,238 @@
+#include "tihijson_frozen.h"
+
+#include <assert.h>
+#include <string.h>
+
+#include <algorithm>
+
+namespace tihi {
+
+// 按字节比较, 短的前缀排在前面
+static int compare_key(const char* a, size_t an, const char* b, size_t bn) {
+    int c = memcmp(a, b, std::min(an, bn));
+    if (c != 0) {
+        return c;
+    }
+    return an < bn ? -1 : (an > bn ? 1 : 0);
+}
+
+JsonFrozen::ptr JsonFrozen::freeze(const JsonValue& value) {
+    std::shared_ptr<JsonFrozen> doc = std::make_shared<JsonFrozen>();
+    std::vector<Node>& nodes = doc->m_nodes;
+    std::string& chars = doc->m_chars;
+
+    // 按层序生成节点: 处理第 i 个节点时把它的子节点追加到末尾,
+    // sources[i] 为第 i 个节点对应的原节点
+    std::vector<const JsonValue*> sources(1, &value);
+    nodes.emplace_back();
+    nodes[0].key = 0;
+    nodes[0].key_size = 0;
+
+    using Member = std::pair<const std::string, JsonValue::ptr>;
+    std::vector<const Member*> members;
+    auto add_child = [&](const JsonValue* source, size_t key, size_t key_size) {
+        sources.push_back(source);
+        nodes.emplace_back();
+        nodes.back().key = key;
+        nodes.back().key_size = static_cast<uint32_t>(key_size);
+    };
+
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        if (sources[i] == nullptr) {
+            continue;  // 打包数组的元素, 已经写好
+        }
+        const JsonValue& v = *sources[i];
+        int type = v.get_type();
+        size_t size = 0;
+        size_t offset = 0;
+        double number = 0;
+        switch (type) {
+            case JsonValue::JSON_NUMBER:
+                number = v.get_number();
+                break;
+            case JsonValue::JSON_STRING:
+                offset = chars.size();
+                chars.append(v.get_str_data(), v.get_str_size());
+                size = chars.size() - offset;
+                chars.push_back('\0');
+                break;
+            case JsonValue::JSON_ARRAY:
+                offset = nodes.size();
+                if (v.is_packed()) {
+                    // 打包的数字直接生成数字节点, 不展开原数组
+                    for (double d : v.get_packed()) {
+                        add_child(nullptr, 0, 0);
+                        nodes.back().type = JsonValue::JSON_NUMBER;
+                        nodes.back().size = 0;
+                        nodes.back().number = d;
+                    }
+                    size = v.get_packed().size();
+                    break;
+                }
+                for (const auto& c : v.get_vec()) {
+                    add_child(c.get(), 0, 0);
+                }
+                size = v.get_vec_size();
+                break;
+            case JsonValue::JSON_OBJECT:
+                members.clear();
+                for (const auto& p : v.get_obj()) {
+                    members.push_back(&p);
+                }
+                std::sort(members.begin(), members.end(),
+                          [](const Member* a, const Member* b) {
+                              return compare_key(a->first.data(),
+                                                 a->first.size(),
+                                                 b->first.data(),
+                                                 b->first.size()) < 0;
+                          });
+                offset = nodes.size();
+                for (const Member* m : members) {
+                    add_child(m->second.get(), chars.size(), m->first.size());
+                    chars.append(m->first);
+                    chars.push_back('\0');
+                }
+                size = members.size();
+                break;
+            default:
+                break;
+        }
+        // add_child 可能使 nodes 重新分配, 最后再写入第 i 个节点
+        Node& node = nodes[i];
+        node.type = type;
+        node.size = size;
+        if (type == JsonValue::JSON_NUMBER) {
+            node.number = number;
+        } else {
+            node.offset = offset;
+        }
+    }
+
+    nodes.shrink_to_fit();
+    chars.shrink_to_fit();
+    return doc;
+}
+
+size_t JsonFrozen::memory_usage() const {
+    return m_nodes.capacity() * sizeof(Node) + m_chars.capacity() + 1;
+}
+
+double JsonFrozen::Value::get_number() const {
+    assert(m_node->type == JsonValue::JSON_NUMBER);
+    return m_node->number;
+}
+
+const char* JsonFrozen::Value::get_str() const {
+    assert(m_node->type == JsonValue::JSON_STRING);
+    return m_doc->m_chars.data() + m_node->offset;
+}
+
+size_t JsonFrozen::Value::get_str_size() const {
+    assert(m_node->type == JsonValue::JSON_STRING);
+    return m_node->size;
+}
+
+size_t JsonFrozen::Value::size() const {
+    assert(m_node->type == JsonValue::JSON_ARRAY ||
+           m_node->type == JsonValue::JSON_OBJECT);
+    return m_node->size;
+}
+
+const JsonFrozen::Node* JsonFrozen::Value::child(size_t i) const {
+    return &m_doc->m_nodes[m_node->offset + i];
+}
+
+JsonFrozen::Value JsonFrozen::Value::operator[](size_t i) const {
+    if (i >= size()) {
+        return Value();
+    }
+    return Value(m_doc, child(i));
+}
+
+const char* JsonFrozen::Value::key(size_t i) const {
+    assert(m_node->type == JsonValue::JSON_OBJECT && i < m_node->size);
+    return m_doc->m_chars.data() + child(i)->key;
+}
+
+size_t JsonFrozen::Value::key_size(size_t i) const {
+    assert(m_node->type == JsonValue::JSON_OBJECT && i < m_node->size);
+    return child(i)->key_size;
+}
+
+JsonFrozen::Value JsonFrozen::Value::get(const char* key, size_t n) const {
+    if (m_node == nullptr || m_node->type != JsonValue::JSON_OBJECT ||
+        m_node->size == 0) {
+        return Value();
+    }
+    const char* chars = m_doc->m_chars.data();
+    const Node* first = child(0);
+    const Node* last = first + m_node->size;
+    const Node* it = std::lower_bound(
+        first, last, 0, [&](const Node& node, int) {
+            return compare_key(chars + node.key, node.key_size, key, n) < 0;
+        });
+    if (it == last ||
+        compare_key(chars + it->key, it->key_size, key, n) != 0) {
+        return Value();
+    }
+    return Value(m_doc, it);
+}
+
+JsonValue::ptr JsonFrozen::Value::thaw() const {
+    JsonBuilder b;
+    // 用显式的栈代替递归, 深层嵌套的文档不会耗尽调用栈;
+    // 每层记录一个容器和下一个要复制的子节点
+    std::vector<std::pair<Value, size_t>> stack;
+    Value v = *this;
+    while (v) {
+        switch (v.get_type()) {
+            case JsonValue::JSON_NULL:
+                b.null();
+                break;
+            case JsonValue::JSON_FALSE:
+                b.boolean(false);
+                break;
+            case JsonValue::JSON_TRUE:
+                b.boolean(true);
+                break;
+            case JsonValue::JSON_NUMBER:
+                b.number(v.get_number());
+                break;
+            case JsonValue::JSON_STRING:
+                b.string(std::string(v.get_str(), v.get_str_size()));
+                break;
+            case JsonValue::JSON_ARRAY:
+                b.start_array(v.size());
+                stack.emplace_back(v, 0);
+                break;
+            case JsonValue::JSON_OBJECT:
+                b.start_object(v.size());
+                stack.emplace_back(v, 0);
+                break;
+        }
+
+        // 找到下一个子节点, 关闭已经复制完的容器
+        v = Value();
+        while (!stack.empty()) {
+            const Value& parent = stack.back().first;
+            size_t i = stack.back().second;
+            if (i < parent.size()) {
+                if (parent.get_type() == JsonValue::JSON_OBJECT) {
+                    b.key(std::string(parent.key(i), parent.key_size(i)));
+                }
+                v = parent[i];
+                ++stack.back().second;
+                break;
+            }
+            if (parent.get_type() == JsonValue::JSON_ARRAY) {
+                b.end_array();
+            } else {
+                b.end_object();
+            }
+            stack.pop_back();
+        }
+    }
+    return b.take();
+}
+
+}  // end of namespace tihi
@@ -0,0 +1,106 @@
+#ifndef TIHIJSON_TIHIJSON_FROZEN_H_
+#define TIHIJSON_TIHIJSON_FROZEN_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "tihijson.h"
+
+namespace tihi {
+
+/*
+ * 冻结的只读文档. freeze() 把一棵 JsonValue 树复制为两块连续的内存:
+ * 节点数组 (按层序排列, 每个容器的子节点相邻) 和字符串区 (字符串值与
+ * key, 各自以 '\0' 结尾). 对象成员按 key 排序, 查找为二分查找.
+ *
+ * 访问通过 Value 句柄进行, 句柄只是两个指针, 所有操作都是 const 且不
+ * 修改任何引用计数或缓存, 多个线程可以无锁地同时读取同一个文档:
+ *
+ *     JsonFrozen::ptr config = JsonFrozen::freeze(*value);
+ *     // 各个线程
+ *     JsonFrozen::Value port = config->root().get("db").get("port");
+ *     if (port && port.get_type() == JsonValue::JSON_NUMBER) ...
+ *
+ * 句柄在文档销毁前有效. 被多个父节点共享的子树 (如去重解析的结果)
+ * 冻结后各自保存一份.
+ */
+class JsonFrozen {
+public:
+    using ptr = std::shared_ptr<const JsonFrozen>;
+
+private:
+    struct Node {
+        int type;
+        uint32_t key_size;  // 作为对象成员时 key 的长度
+        size_t key;         // key 在字符串区中的位置
+        size_t size;        // 字符串长度, 或子节点数
+        union {
+            double number;
+            size_t offset;  // 字符串在字符串区中的位置, 或第一个子节点的下标
+        };
+    };
+
+public:
+    class Value {
+    public:
+        Value() = default;
+
+        // 句柄是否指向一个值; 查找失败时返回无效的句柄
+        explicit operator bool() const { return m_node != nullptr; }
+
+        int get_type() const { return m_node->type; }
+        double get_number() const;
+        // 指向文档内的存储, 以 '\0' 结尾
+        const char* get_str() const;
+        size_t get_str_size() const;
+
+        // 数组的元素数或对象的成员数
+        size_t size() const;
+        // 数组的第 i 个元素, 或按 key 排序后对象的第 i 个成员的值;
+        // 越界时返回无效的句柄
+        Value operator[](size_t i) const;
+        // 对象第 i 个成员的 key, 以 '\0' 结尾
+        const char* key(size_t i) const;
+        size_t key_size(size_t i) const;
+
+        // 按 key 查找对象成员, 不是对象或找不到时返回无效的句柄
+        Value get(const char* key, size_t n) const;
+        Value get(const char* key) const { return get(key, strlen(key)); }
+        Value get(const std::string& key) const {
+            return get(key.data(), key.size());
+        }
+
+        // 复制为普通的 JsonValue 树
+        JsonValue::ptr thaw() const;
+
+    private:
+        friend class JsonFrozen;
+
+        Value(const JsonFrozen* doc, const Node* node)
+            : m_doc(doc), m_node(node) {}
+        const Node* child(size_t i) const;
+
+        const JsonFrozen* m_doc = nullptr;
+        const Node* m_node = nullptr;
+    };
+
+    static ptr freeze(const JsonValue& value);
+
+    Value root() const { return Value(this, m_nodes.data()); }
+    size_t node_count() const { return m_nodes.size(); }
+    // 占用的堆内存 (字节)
+    size_t memory_usage() const;
+
+private:
+    std::vector<Node> m_nodes;  // m_nodes[0] 为根
+    std::string m_chars;
+};
+
+}  // end of namespace tihi
+
+#endif  // TIHIJSON_TIHIJSON_FROZEN_H_
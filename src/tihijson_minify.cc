@@ -0,0 +1,595 @@
+#include "tihijson_minify.h"
+
+#include "tihijson_utf8.h"
+
+#include <errno.h>
+#include <stdlib.h>
+
+namespace tihi {
+
+// 字符串中需要单独处理的字节: '"', '\\' 和控制字符
+struct MinifyTables {
+    MinifyTables() {
+        for (int c = 0; c < 256; ++c) {
+            special[c] = c < 0x20 || c == '\"' || c == '\\';
+            digit[c] = c >= '0' && c <= '9';
+            hex[c] = -1;
+        }
+        for (int c = '0'; c <= '9'; ++c) {
+            hex[c] = c - '0';
+        }
+        for (int c = 'a'; c <= 'f'; ++c) {
+            hex[c] = c - 'a' + 10;
+            hex[c - 'a' + 'A'] = c - 'a' + 10;
+        }
+    }
+
+    bool special[256];
+    bool digit[256];
+    int8_t hex[256];
+};
+
+static const MinifyTables TABLES;
+
+static inline bool is_ws(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static inline void emit(std::string* out, char c) {
+    if (out != nullptr) {
+        out->push_back(c);
+    }
+}
+
+static inline void emit(std::string* out, const char* begin, const char* end) {
+    if (out != nullptr) {
+        out->append(begin, end - begin);
+    }
+}
+
+// 以 lead 开头的 UTF-8 序列的长度, 非法的首字节按 1 计, 由校验报错
+static size_t utf8_length(uint8_t lead) {
+    if (lead >= 0xF0) {
+        return lead <= 0xF4 ? 4 : 1;
+    }
+    if (lead >= 0xE0) {
+        return 3;
+    }
+    return lead >= 0xC2 ? 2 : 1;
+}
+
+void JsonMinifier::reset() {
+    m_status = Json::PARSE_OK;
+    m_state = DOC_START;
+    m_number = N_MINUS;
+    m_key = m_low = false;
+    m_hex = 0;
+    m_code = 0;
+    m_high = 0;
+    m_literal = nullptr;
+    m_literal_pos = 0;
+    m_stack.clear();
+    m_utf8_tail.clear();
+    m_token.clear();
+    m_offset = 0;
+    m_documents = 0;
+}
+
+Json::STATUS JsonMinifier::fail(Json::STATUS status, size_t offset) {
+    m_status = status;
+    m_offset = offset;
+    return status;
+}
+
+// 按段校验 UTF-8: 末尾不完整的序列留到下一段, 与下一段的开头拼起来校验
+bool JsonMinifier::check_utf8(const char* data, size_t size) {
+    size_t begin = 0;
+    if (!m_utf8_tail.empty()) {
+        size_t need = utf8_length(m_utf8_tail[0]) - m_utf8_tail.size();
+        begin = need < size ? need : size;
+        m_utf8_tail.append(data, begin);
+        if (begin < need) {
+            return true;
+        }
+        if (!utf8::validate(m_utf8_tail.data(), m_utf8_tail.size())) {
+            return false;
+        }
+        m_utf8_tail.clear();
+    }
+
+    size_t end = size;
+    for (size_t i = size; i > begin && size - i < 4; --i) {
+        uint8_t c = data[i - 1];
+        if (c < 0x80) {
+            break;
+        }
+        if (c >= 0xC0) {
+            if (i - 1 + utf8_length(c) > size) {
+                end = i - 1;
+            }
+            break;
+        }
+    }
+    m_utf8_tail.assign(data + end, size - end);
+    return utf8::validate(data + begin, end - begin);
+}
+
+bool JsonMinifier::begin_value(char c) {
+    if (handler != nullptr && m_stack.empty()) {
+        handler->start_document();
+    }
+    switch (c) {
+        case '\"':
+            m_state = STRING;
+            m_key = false;
+            m_token.clear();
+            break;
+        case '[':
+        case '{':
+            if (m_stack.size() >= max_depth) {
+                m_status = Json::PARSE_DEPTH_EXCEEDED;
+                return false;
+            }
+            m_stack.push_back(c);
+            m_state = c == '[' ? ARRAY_FIRST : OBJECT_FIRST;
+            if (handler != nullptr) {
+                return accepted(c == '[' ? handler->start_array()
+                                         : handler->start_object());
+            }
+            break;
+        case 't':
+            m_literal = "true";
+            break;
+        case 'f':
+            m_literal = "false";
+            break;
+        case 'n':
+            m_literal = "null";
+            break;
+        case '-':
+            m_state = NUMBER;
+            m_number = N_MINUS;
+            m_token.assign(1, c);
+            break;
+        default:
+            if (!TABLES.digit[static_cast<uint8_t>(c)]) {
+                m_status = Json::PARSE_INVALID_VALUE;
+                return false;
+            }
+            m_state = NUMBER;
+            m_number = c == '0' ? N_ZERO : N_INT;
+            m_token.assign(1, c);
+            break;
+    }
+    if (c == 't' || c == 'f' || c == 'n') {
+        m_state = LITERAL;
+        m_literal_pos = 1;
+    }
+    return true;
+}
+
+void JsonMinifier::end_value() {
+    if (!m_stack.empty()) {
+        m_state = AFTER_VALUE;
+        return;
+    }
+    ++m_documents;
+    m_state = DOC_END;
+}
+
+bool JsonMinifier::accepted(bool ok) {
+    if (!ok) {
+        m_status = Json::PARSE_REJECTED;
+    }
+    return ok;
+}
+
+void JsonMinifier::end_container(bool array) {
+    m_stack.pop_back();
+    if (handler == nullptr ||
+        accepted(array ? handler->end_array() : handler->end_object())) {
+        end_value();
+    }
+}
+
+bool JsonMinifier::end_number() {
+    if (handler != nullptr) {
+        errno = 0;
+        double d = strtod(m_token.c_str(), nullptr);
+        if (errno == ERANGE) {
+            m_status = Json::PARSE_NUMBER_OUT_OF_RANGE;
+            return false;
+        }
+        if (!accepted(handler->number(d))) {
+            return false;
+        }
+    }
+    end_value();
+    return true;
+}
+
+void JsonMinifier::end_literal() {
+    if (handler == nullptr ||
+        accepted(m_literal[0] == 'n' ? handler->null()
+                                     : handler->boolean(m_literal[0] == 't'))) {
+        end_value();
+    }
+}
+
+// '\\' 之后的字符 -> 转义结果
+static char unescape(char c) {
+    switch (c) {
+        case 'b':
+            return '\b';
+        case 'f':
+            return '\f';
+        case 'n':
+            return '\n';
+        case 'r':
+            return '\r';
+        case 't':
+            return '\t';
+        default:
+            return c;
+    }
+}
+
+/*
+ * 输出就是去掉了字符串之外的空白的输入, 所以只在跳过空白时把之前的
+ * 一段 [run, p) 整块追加到 out, 其余字节不逐个复制
+ */
+Json::STATUS JsonMinifier::feed(const char* data, size_t size,
+                                std::string* out) {
+    if (m_status != Json::PARSE_OK) {
+        return m_status;
+    }
+    if (validate_utf8 && !check_utf8(data, size)) {
+        return fail(Json::PARSE_INVALID_UTF8, m_offset);
+    }
+
+    const char* p = data;
+    const char* end = data + size;
+    const char* run = p;
+    while (p < end) {
+        State state = m_state;
+        if (state <= AFTER_VALUE) {
+            if (is_ws(*p)) {
+                emit(out, run, p);
+                while (p < end && is_ws(*p)) {
+                    ++p;
+                }
+                run = p;
+                if (p == end) {
+                    break;
+                }
+            }
+        }
+
+        char c = *p;
+        switch (state) {
+            case DOC_END:
+                if (!multiple) {
+                    m_status = Json::PARSE_ROOT_NOT_SINGULAR;
+                    break;
+                }
+                begin_value(c);
+                break;
+            case DOC_START:
+            case VALUE:
+                begin_value(c);
+                break;
+            case ARRAY_FIRST:
+                if (c == ']') {
+                    end_container(true);
+                } else {
+                    begin_value(c);
+                }
+                break;
+            case OBJECT_FIRST:
+            case KEY:
+                if (c == '\"') {
+                    m_state = STRING;
+                    m_key = true;
+                    m_token.clear();
+                } else if (c == '}' && state == OBJECT_FIRST) {
+                    end_container(false);
+                } else {
+                    m_status = Json::PARSE_MISS_KEY;
+                }
+                break;
+            case COLON:
+                if (c == ':') {
+                    m_state = VALUE;
+                } else {
+                    m_status = Json::PARSE_MISS_COLON;
+                }
+                break;
+            case AFTER_VALUE: {
+                bool array = m_stack.back() == '[';
+                if (c == ',') {
+                    m_state = array ? VALUE : KEY;
+                } else if (c == (array ? ']' : '}')) {
+                    end_container(array);
+                } else {
+                    m_status = array ? Json::PARSE_MISS_COMMA_OR_SQUARE_BRACKET
+                                     : Json::PARSE_MISS_COMMA_OR_CURLY_BRACKET;
+                }
+                break;
+            }
+            case STRING: {
+                const char* begin = p;
+                while (p < end && !TABLES.special[static_cast<uint8_t>(*p)]) {
+                    ++p;
+                }
+                if (handler != nullptr) {
+                    m_token.append(begin, p - begin);
+                }
+                if (p == end) {
+                    continue;
+                }
+                c = *p;
+                if (c == '\"') {
+                    if (m_key) {
+                        if (handler == nullptr ||
+                            accepted(handler->key(m_token))) {
+                            m_state = COLON;
+                        }
+                    } else if (handler == nullptr ||
+                               accepted(handler->string(m_token))) {
+                        end_value();
+                    }
+                } else if (c == '\\') {
+                    m_state = ESCAPE;
+                } else {
+                    m_status = Json::PARSE_INVALID_STRING_CHAR;
+                }
+                break;
+            }
+            case ESCAPE:
+                if (c == 'u') {
+                    m_state = UNICODE;
+                    m_hex = 0;
+                    m_code = 0;
+                } else if (c == '\"' || c == '\\' || c == '/' || c == 'b' ||
+                           c == 'f' || c == 'n' || c == 'r' || c == 't') {
+                    m_state = STRING;
+                    if (handler != nullptr) {
+                        m_token.push_back(unescape(c));
+                    }
+                } else {
+                    m_status = Json::PARSE_INVALID_STRING_ESCAPE;
+                }
+                break;
+            case UNICODE: {
+                int8_t h = TABLES.hex[static_cast<uint8_t>(c)];
+                if (h < 0) {
+                    m_status = Json::PARSE_INVALID_UNICODE_HEX;
+                    break;
+                }
+                m_code = (m_code << 4) | h;
+                if (++m_hex < 4) {
+                    break;
+                }
+                if (m_low) {
+                    m_low = false;
+                    if (m_code < 0xdc00 || m_code > 0xdfff) {
+                        m_status = Json::PARSE_INVALID_UNICODE_HEX;
+                        break;
+                    }
+                    m_state = STRING;
+                    if (handler != nullptr) {
+                        utf8::append(0x10000 + ((m_high - 0xd800) << 10) +
+                                         (m_code - 0xdc00),
+                                     m_token);
+                    }
+                } else if (m_code >= 0xd800 && m_code <= 0xdbff) {
+                    m_state = LOW_BACKSLASH;
+                    m_high = m_code;
+                } else {
+                    m_state = STRING;
+                    if (handler != nullptr) {
+                        utf8::append(m_code, m_token);
+                    }
+                }
+                break;
+            }
+            case LOW_BACKSLASH:
+            case LOW_U:
+                if (c != (state == LOW_BACKSLASH ? '\\' : 'u')) {
+                    m_status = Json::PARSE_INVALID_UNICODE_HEX;
+                } else if (state == LOW_BACKSLASH) {
+                    m_state = LOW_U;
+                } else {
+                    m_state = UNICODE;
+                    m_low = true;
+                    m_hex = 0;
+                    m_code = 0;
+                }
+                break;
+            case NUMBER: {
+                const char* begin = p;
+                bool done = false;
+                for (; p < end && !done; ++p) {
+                    bool digit = TABLES.digit[static_cast<uint8_t>(*p)];
+                    char d = *p;
+                    switch (m_number) {
+                        case N_MINUS:
+                            if (!digit) {
+                                m_status = Json::PARSE_INVALID_VALUE;
+                            }
+                            m_number = d == '0' ? N_ZERO : N_INT;
+                            break;
+                        case N_ZERO:
+                        case N_INT:
+                        case N_FRAC:
+                            if (digit && m_number != N_ZERO) {
+                                break;
+                            }
+                            if (d == '.' && m_number != N_FRAC) {
+                                m_number = N_DOT;
+                            } else if (d == 'e' || d == 'E') {
+                                m_number = N_E;
+                            } else {
+                                done = true;
+                            }
+                            break;
+                        case N_DOT:
+                            if (!digit) {
+                                m_status = Json::PARSE_INVALID_VALUE;
+                            }
+                            m_number = N_FRAC;
+                            break;
+                        case N_E:
+                            if (d == '+' || d == '-') {
+                                m_number = N_E_SIGN;
+                                break;
+                            }
+                            // fallthrough
+                        case N_E_SIGN:
+                            if (!digit) {
+                                m_status = Json::PARSE_INVALID_VALUE;
+                            }
+                            m_number = N_EXP;
+                            break;
+                        case N_EXP:
+                            done = !digit;
+                            break;
+                    }
+                    if (m_status != Json::PARSE_OK) {
+                        break;
+                    }
+                }
+                if (m_status != Json::PARSE_OK) {
+                    break;
+                }
+                if (done) {
+                    --p;
+                }
+                if (handler != nullptr) {
+                    m_token.append(begin, p - begin);
+                }
+                if (done) {
+                    // 数字之后只能是空白, ',', ']' 或 '}' (与 Json::parse
+                    // 一致); 多个文档时顶层数字之后可以直接开始下一个文档
+                    char next = *p;
+                    if (!is_ws(next) && next != ',' && next != ']' &&
+                        next != '}' &&
+                        !(multiple && m_stack.empty() &&
+                          (next == '[' || next == '{' || next == '\"'))) {
+                        m_status = Json::PARSE_INVALID_VALUE;
+                        break;
+                    }
+                    if (!end_number()) {
+                        break;
+                    }
+                }
+                continue;
+            }
+            case LITERAL:
+                while (p < end && m_literal[m_literal_pos] != '\0' &&
+                       *p == m_literal[m_literal_pos]) {
+                    ++p;
+                    ++m_literal_pos;
+                }
+                if (m_literal[m_literal_pos] == '\0') {
+                    end_literal();
+                    if (m_status != Json::PARSE_OK) {
+                        break;
+                    }
+                } else if (p < end) {
+                    m_status = Json::PARSE_INVALID_VALUE;
+                    break;
+                }
+                continue;
+        }
+
+        if (m_status != Json::PARSE_OK) {
+            emit(out, run, p);
+            return fail(m_status, m_offset + (p - data));
+        }
+        ++p;
+        // 多个文档: 上一个文档之后换行
+        if (state == DOC_END) {
+            emit(out, run, p - 1);
+            emit(out, '\n');
+            run = p - 1;
+        }
+    }
+
+    emit(out, run, p);
+    m_offset += size;
+    return Json::PARSE_OK;
+}
+
+Json::STATUS JsonMinifier::finish(std::string* out) {
+    if (m_status != Json::PARSE_OK) {
+        return m_status;
+    }
+    if (!m_utf8_tail.empty()) {
+        return fail(Json::PARSE_INVALID_UTF8, m_offset);
+    }
+
+    // 输入末尾可以直接结束数字
+    if (m_state == NUMBER) {
+        if (m_number != N_ZERO && m_number != N_INT && m_number != N_FRAC &&
+            m_number != N_EXP) {
+            return fail(Json::PARSE_INVALID_VALUE, m_offset);
+        }
+        if (!end_number()) {
+            return fail(m_status, m_offset);
+        }
+    }
+
+    Json::STATUS status = Json::PARSE_OK;
+    switch (m_state) {
+        case DOC_START:
+            if (m_documents == 0 && !multiple) {
+                status = Json::PARSE_EXPECT_VALUE;
+            }
+            break;
+        case DOC_END:
+            if (multiple) {
+                emit(out, '\n');
+            }
+            break;
+        case VALUE:
+            status = m_stack.back() == '['
+                         ? Json::PARSE_MISS_COMMA_OR_SQUARE_BRACKET
+                         : Json::PARSE_EXPECT_VALUE;
+            break;
+        case ARRAY_FIRST:
+            status = Json::PARSE_MISS_COMMA_OR_SQUARE_BRACKET;
+            break;
+        case OBJECT_FIRST:
+            status = Json::PARSE_MISS_COMMA_OR_CURLY_BRACKET;
+            break;
+        case KEY:
+            status = Json::PARSE_MISS_KEY;
+            break;
+        case COLON:
+            status = Json::PARSE_MISS_COLON;
+            break;
+        case AFTER_VALUE:
+            status = m_stack.back() == '['
+                         ? Json::PARSE_MISS_COMMA_OR_SQUARE_BRACKET
+                         : Json::PARSE_MISS_COMMA_OR_CURLY_BRACKET;
+            break;
+        case LITERAL:
+            status = Json::PARSE_INVALID_VALUE;
+            break;
+        default:
+            status = Json::PARSE_MISS_QUOTATION_MARK;
+            break;
+    }
+    return status == Json::PARSE_OK ? status : fail(status, m_offset);
+}
+
+Json::STATUS JsonMinifier::minify(const std::string& in, std::string& out) {
+    JsonMinifier m;
+    out.clear();
+    out.reserve(in.size());
+    Json::STATUS ret = m.feed(in.data(), in.size(), &out);
+    return ret == Json::PARSE_OK ? m.finish(&out) : ret;
+}
+
+}  // end of namespace tihi
@@ -0,0 +1,118 @@
+#ifndef TIHIJSON_TIHIJSON_MINIFY_H_
+#define TIHIJSON_TIHIJSON_MINIFY_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "tihijson.h"
+
+namespace tihi {
+
+/*
+ * 去掉 JSON 中无意义的空白, 同时检查语法, 不构造树也不解码字符串和
+ * 数字: 字符串 (含转义) 与数字按原样输出, 对象成员保持原来的顺序.
+ *
+ * 输入可以分段交给 feed, 段的边界可以落在任意位置 (字符串, 数字或
+ * \uXXXX 转义的中间), 输出追加到 out, out 为 nullptr 时只检查语法.
+ * 出错时返回与 Json::parse 相同含义的状态, 之后的调用返回同一状态,
+ * 直到 reset(). 由于不解码数字, 超出 double 范围的数字不报错.
+ *
+ * 设置 handler 时同时产生与 Json::parse(str, handler, ctx) 相同的解析
+ * 事件 (每个文档开始时调用 start_document), 为此要解码字符串和数字,
+ * 超出范围的数字返回 PARSE_NUMBER_OUT_OF_RANGE, handler 返回 false 时
+ * 返回 PARSE_REJECTED. 占用的内存只与最长的字符串或数字有关, 与文档
+ * 大小无关.
+ *
+ *     JsonMinifier m;
+ *     while ((n = read(fd, buf, sizeof(buf))) > 0)
+ *         m.feed(buf, n, &out);
+ *     m.finish(&out);
+ */
+class JsonMinifier {
+public:
+    JsonMinifier() { reset(); }
+
+    Json::STATUS feed(const char* data, size_t size, std::string* out);
+    // 输入结束, 检查最后一个文档是否完整
+    Json::STATUS finish(std::string* out);
+    void reset();
+
+    // 整段输入一次处理完
+    static Json::STATUS minify(const std::string& in, std::string& out);
+
+    // 已处理的字节数, 出错时为出错字节的位置
+    size_t offset() const { return m_offset; }
+    // 已完成的文档数
+    size_t documents() const { return m_documents; }
+
+    size_t max_depth = 1024;
+    bool validate_utf8 = false;
+    // 允许多个文档首尾相接 (如 NDJSON), 每个文档输出为一行
+    bool multiple = false;
+    // 非空时接收解析事件
+    JsonHandler* handler = nullptr;
+
+private:
+    enum State : uint8_t {
+        DOC_START,     // 文档之前
+        DOC_END,       // 文档之后
+        VALUE,         // ':' 或数组中的 ',' 之后
+        ARRAY_FIRST,   // '[' 之后
+        OBJECT_FIRST,  // '{' 之后
+        KEY,           // 对象中的 ',' 之后
+        COLON,         // key 之后
+        AFTER_VALUE,   // 容器中的值之后
+        STRING,
+        ESCAPE,        // '\\' 之后
+        UNICODE,       // \u 之后的十六进制数字
+        LOW_BACKSLASH, // 高代理之后, 期望 '\\'
+        LOW_U,         // 高代理之后, 期望 'u'
+        NUMBER,
+        LITERAL,
+    };
+    // 数字的语法状态
+    enum NumberState : uint8_t {
+        N_MINUS,
+        N_ZERO,
+        N_INT,
+        N_DOT,
+        N_FRAC,
+        N_E,
+        N_E_SIGN,
+        N_EXP,
+    };
+
+    bool begin_value(char c);
+    void end_value();
+    // 以下在 handler 非空时先把事件交给它, 被拒绝时不结束该值
+    void end_container(bool array);
+    bool end_number();
+    void end_literal();
+    // handler 返回 false 时设置 PARSE_REJECTED
+    bool accepted(bool ok);
+    bool check_utf8(const char* data, size_t size);
+    Json::STATUS fail(Json::STATUS status, size_t offset);
+
+    Json::STATUS m_status;
+    State m_state;
+    NumberState m_number;
+    bool m_key;      // 正在读的字符串是 key
+    bool m_low;      // 正在读低代理的 \uXXXX
+    uint8_t m_hex;   // 已读的十六进制数字个数
+    uint32_t m_code; // \uXXXX 的值
+    uint32_t m_high; // 高代理的值
+    const char* m_literal;
+    size_t m_literal_pos;
+    std::vector<char> m_stack;  // 未结束的容器, '[' 或 '{'
+    std::string m_utf8_tail;    // 上一段末尾不完整的 UTF-8 序列
+    std::string m_token;        // handler 非空时正在读的字符串或数字
+    size_t m_offset;
+    size_t m_documents;
+};
+
+}  // end of namespace tihi
+
+#endif  // TIHIJSON_TIHIJSON_MINIFY_H_
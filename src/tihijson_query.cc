@@ -0,0 +1,518 @@
+#include "tihijson_query.h"
+
+#include <ctype.h>
+#include <string.h>
+
+namespace tihi {
+
+// 查询表达式的递归下降解析
+class JsonQueryParser {
+public:
+    JsonQueryParser(const std::string& expr, JsonQuery& query)
+        : m_expr(expr), m_query(query) {}
+
+    bool run();
+    const std::string& error() const { return m_error; }
+
+private:
+    using Step = JsonQuery::Step;
+    using Stage = JsonQuery::Stage;
+
+    bool parse_stage(Stage& stage);
+    bool parse_path(JsonQuery::Path& path);
+    bool parse_bracket(Step& step);
+    bool parse_quoted(std::string& out);
+    bool parse_literal(JsonValue::ptr& value);
+
+    char peek() const { return m_pos < m_expr.size() ? m_expr[m_pos] : '\0'; }
+    void skip_ws() {
+        while (m_pos < m_expr.size() && isspace(uint8_t(m_expr[m_pos]))) {
+            ++m_pos;
+        }
+    }
+    bool consume(const char* token) {
+        size_t n = strlen(token);
+        if (m_expr.compare(m_pos, n, token) != 0) {
+            return false;
+        }
+        m_pos += n;
+        return true;
+    }
+    bool fail(const std::string& msg) {
+        m_error = msg + " at offset " + std::to_string(m_pos);
+        return false;
+    }
+
+    const std::string& m_expr;
+    JsonQuery& m_query;
+    size_t m_pos = 0;
+    std::string m_error;
+};
+
+static bool is_ident_start(char c) {
+    return isalpha(uint8_t(c)) || c == '_';
+}
+
+static bool is_ident(char c) { return isalnum(uint8_t(c)) || c == '_'; }
+
+bool JsonQueryParser::run() {
+    for (;;) {
+        skip_ws();
+        Stage stage;
+        if (!parse_stage(stage)) {
+            return false;
+        }
+        m_query.m_stages.push_back(std::move(stage));
+        skip_ws();
+        if (m_pos == m_expr.size()) {
+            break;
+        }
+        if (!consume("|")) {
+            return fail("expected '|'");
+        }
+    }
+
+    if (m_query.m_stages[0].op == Stage::PATH) {
+        m_query.m_prefix = m_query.m_stages[0].path;
+        m_query.m_first = 1;
+    }
+    return true;
+}
+
+bool JsonQueryParser::parse_stage(Stage& stage) {
+    if (!consume("select")) {
+        stage.op = Stage::PATH;
+        return parse_path(stage.path);
+    }
+
+    skip_ws();
+    if (!consume("(")) {
+        return fail("expected '('");
+    }
+    skip_ws();
+    if (!parse_path(stage.path)) {
+        return false;
+    }
+    skip_ws();
+
+    // 两个字符的运算符在前
+    static const struct {
+        const char* token;
+        Stage::Op op;
+    } OPS[] = {{"==", Stage::EQ}, {"!=", Stage::NE}, {"<=", Stage::LE},
+               {">=", Stage::GE}, {"<", Stage::LT},  {">", Stage::GT}};
+    stage.op = Stage::SELECT_TRUTHY;
+    for (const auto& o : OPS) {
+        if (consume(o.token)) {
+            stage.op = o.op;
+            break;
+        }
+    }
+    if (stage.op != Stage::SELECT_TRUTHY) {
+        skip_ws();
+        if (!parse_literal(stage.literal)) {
+            return false;
+        }
+        skip_ws();
+    }
+    if (!consume(")")) {
+        return fail("expected ')'");
+    }
+    return true;
+}
+
+/* path = '.' [step] (('.' step) | bracket)*, step = ident | quoted | bracket */
+bool JsonQueryParser::parse_path(JsonQuery::Path& path) {
+    if (!consume(".")) {
+        return fail("expected path");
+    }
+
+    bool need_step = false;  // '.' 之后必须有一步, 只有开头的 '.' 例外
+    for (;;) {
+        Step step;
+        step.index = 0;
+        char c = peek();
+        if (is_ident_start(c)) {
+            step.kind = Step::KEY;
+            size_t begin = m_pos;
+            while (is_ident(peek())) {
+                ++m_pos;
+            }
+            step.key = m_expr.substr(begin, m_pos - begin);
+        } else if (c == '\"') {
+            step.kind = Step::KEY;
+            if (!parse_quoted(step.key)) {
+                return false;
+            }
+        } else if (c == '[') {
+            if (!parse_bracket(step)) {
+                return false;
+            }
+        } else if (need_step) {
+            return fail("expected key after '.'");
+        } else {
+            return true;
+        }
+        path.push_back(std::move(step));
+
+        if (consume(".")) {
+            need_step = true;
+        } else if (peek() == '[') {
+            need_step = false;
+        } else {
+            return true;
+        }
+    }
+}
+
+/* '[' ']' | '[' 非负整数 ']' | '[' 字符串 ']' */
+bool JsonQueryParser::parse_bracket(Step& step) {
+    consume("[");
+    skip_ws();
+    char c = peek();
+    if (c == ']') {
+        step.kind = Step::ITERATE;
+    } else if (c == '\"') {
+        step.kind = Step::KEY;
+        if (!parse_quoted(step.key)) {
+            return false;
+        }
+    } else if (isdigit(uint8_t(c))) {
+        step.kind = Step::INDEX;
+        step.index = 0;
+        while (isdigit(uint8_t(peek()))) {
+            step.index = step.index * 10 + (m_expr[m_pos++] - '0');
+        }
+    } else {
+        return fail("expected index, string or ']'");
+    }
+    skip_ws();
+    if (!consume("]")) {
+        return fail("expected ']'");
+    }
+    return true;
+}
+
+// JSON 字符串, 按 JSON 的规则处理转义
+bool JsonQueryParser::parse_quoted(std::string& out) {
+    size_t begin = m_pos++;
+    bool escape = false;
+    while (m_pos < m_expr.size()) {
+        char c = m_expr[m_pos++];
+        if (escape) {
+            escape = false;
+        } else if (c == '\\') {
+            escape = true;
+        } else if (c == '\"') {
+            const Json json;
+            JsonContxt ctx;
+            JsonValue::ptr v = JsonValue::create();
+            if (json.parse(m_expr.substr(begin, m_pos - begin), v, ctx) !=
+                Json::PARSE_OK) {
+                m_pos = begin;
+                return fail("invalid string");
+            }
+            out = v->get_str();
+            return true;
+        }
+    }
+    m_pos = begin;
+    return fail("unterminated string");
+}
+
+bool JsonQueryParser::parse_literal(JsonValue::ptr& value) {
+    std::string text;
+    if (peek() == '\"') {
+        if (!parse_quoted(text)) {
+            return false;
+        }
+        value = JsonValue::create();
+        value->set_str(text);
+        return true;
+    }
+
+    size_t begin = m_pos;
+    while (m_pos < m_expr.size() &&
+           (isalnum(uint8_t(m_expr[m_pos])) || strchr("+-.", m_expr[m_pos]))) {
+        ++m_pos;
+    }
+    const Json json;
+    JsonContxt ctx;
+    value = JsonValue::create();
+    if (m_pos == begin ||
+        json.parse(m_expr.substr(begin, m_pos - begin), value, ctx) !=
+            Json::PARSE_OK) {
+        m_pos = begin;
+        return fail("expected number, string, true, false or null");
+    }
+    return true;
+}
+
+JsonQuery::ptr JsonQuery::compile(const std::string& expr,
+                                  std::string* error) {
+    std::shared_ptr<JsonQuery> ret(new JsonQuery);
+    JsonQueryParser parser(expr, *ret);
+    if (!parser.run()) {
+        if (error != nullptr) {
+            *error = parser.error();
+        }
+        return nullptr;
+    }
+    return ret;
+}
+
+bool JsonQuery::eval(const JsonValue::ptr& value,
+                     const Callback& callback) const {
+    return walk(value, m_prefix, 0, [&](const JsonValue::ptr& v) {
+        return eval(v, m_first, callback);
+    });
+}
+
+bool JsonQuery::eval(const JsonValue::ptr& value, size_t stage,
+                     const Callback& callback) const {
+    if (stage == m_stages.size()) {
+        return callback(value);
+    }
+    const Stage& st = m_stages[stage];
+    if (st.op == Stage::PATH) {
+        return walk(value, st.path, 0, [&](const JsonValue::ptr& v) {
+            return eval(v, stage + 1, callback);
+        });
+    }
+    return !test(st, value) || eval(value, stage + 1, callback);
+}
+
+bool JsonQuery::walk(const JsonValue::ptr& value, const Path& path,
+                     size_t step, const Callback& next) const {
+    if (step == path.size()) {
+        return next(value);
+    }
+    const Step& s = path[step];
+    int type = value->get_type();
+    if (s.kind == Step::KEY) {
+        if (type == JsonValue::JSON_OBJECT) {
+            const JsonValue::ptr child = value->get_value_from_obj_by_string(s.key);
+            if (child) {
+                return walk(child, path, step + 1, next);
+            }
+        }
+    } else if (s.kind == Step::INDEX) {
+        if (type == JsonValue::JSON_ARRAY && s.index < value->get_vec_size()) {
+            return walk(value->get_vec()[s.index], path, step + 1, next);
+        }
+    } else if (type == JsonValue::JSON_ARRAY) {
+        for (const auto& child : value->get_vec()) {
+            if (!walk(child, path, step + 1, next)) {
+                return false;
+            }
+        }
+    } else if (type == JsonValue::JSON_OBJECT) {
+        for (const auto& p : value->get_obj()) {
+            if (!walk(p.second, path, step + 1, next)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// 比较 a 与 b, 类型不同或不可比较 (数组/对象) 时 comparable 为 false
+static int compare_scalar(const JsonValue& a, const JsonValue& b,
+                          bool& comparable) {
+    int ta = a.get_type();
+    comparable = ta == b.get_type();
+    if (!comparable) {
+        return 1;
+    }
+    if (ta == JsonValue::JSON_NUMBER) {
+        double x = a.get_number(), y = b.get_number();
+        return x < y ? -1 : (x > y ? 1 : 0);
+    }
+    if (ta == JsonValue::JSON_STRING) {
+        return a.get_str().compare(b.get_str());
+    }
+    comparable = ta != JsonValue::JSON_ARRAY && ta != JsonValue::JSON_OBJECT;
+    return comparable ? 0 : 1;
+}
+
+bool JsonQuery::test(const Stage& stage, const JsonValue::ptr& value) const {
+    bool found = false;
+    walk(value, stage.path, 0, [&](const JsonValue::ptr& v) {
+        if (stage.op == Stage::SELECT_TRUTHY) {
+            found = v->get_type() != JsonValue::JSON_NULL &&
+                    v->get_type() != JsonValue::JSON_FALSE;
+        } else {
+            bool comparable = false;
+            int c = compare_scalar(*v, *stage.literal, comparable);
+            switch (stage.op) {
+                case Stage::EQ:
+                    found = comparable && c == 0;
+                    break;
+                case Stage::NE:
+                    found = !comparable || c != 0;
+                    break;
+                case Stage::LT:
+                    found = comparable && c < 0;
+                    break;
+                case Stage::LE:
+                    found = comparable && c <= 0;
+                    break;
+                case Stage::GT:
+                    found = comparable && c > 0;
+                    break;
+                default:
+                    found = comparable && c >= 0;
+                    break;
+            }
+        }
+        return !found;  // 找到后停止遍历
+    });
+    return found;
+}
+
+JsonQueryRunner::JsonQueryRunner(JsonQuery::ptr query,
+                                 const JsonQuery::Callback& callback)
+    : m_query(query), m_callback(callback) {}
+
+void JsonQueryRunner::start_document() {
+    m_depth = 0;
+    m_capturing = false;
+    m_capture_depth = 0;
+    m_builder = JsonBuilder();
+    m_stopped = false;
+}
+
+// 新值开始. 返回 true 表示该值属于需要构造的结果, 交给 m_builder;
+// 否则 m_matched 为该值是否匹配了前缀路径的前 m_depth 步
+bool JsonQueryRunner::enter_value() {
+    if (m_capturing) {
+        return true;
+    }
+
+    const JsonQuery::Path& prefix = m_query->m_prefix;
+    bool matched = true;
+    if (m_depth > 0) {
+        Frame& f = m_frames[m_depth - 1];
+        if (f.array) {
+            size_t index = f.index++;
+            matched = f.matched &&
+                      (prefix[m_depth - 1].kind == JsonQuery::Step::ITERATE ||
+                       (prefix[m_depth - 1].kind == JsonQuery::Step::INDEX &&
+                        prefix[m_depth - 1].index == index));
+        } else {
+            matched = f.matched && f.key_matched;
+        }
+    }
+
+    if (matched && m_depth == prefix.size()) {
+        m_capturing = true;
+        m_capture_depth = 0;
+        return true;
+    }
+    m_matched = matched;
+    return false;
+}
+
+bool JsonQueryRunner::null() {
+    if (enter_value()) {
+        m_builder.null();
+        return m_capture_depth > 0 || finish();
+    }
+    return true;
+}
+
+bool JsonQueryRunner::boolean(bool b) {
+    if (enter_value()) {
+        m_builder.boolean(b);
+        return m_capture_depth > 0 || finish();
+    }
+    return true;
+}
+
+bool JsonQueryRunner::number(double d) {
+    if (enter_value()) {
+        m_builder.number(d);
+        return m_capture_depth > 0 || finish();
+    }
+    return true;
+}
+
+bool JsonQueryRunner::string(const std::string& s) {
+    if (enter_value()) {
+        m_builder.string(s);
+        return m_capture_depth > 0 || finish();
+    }
+    return true;
+}
+
+bool JsonQueryRunner::start_object() { return start_container(false); }
+
+bool JsonQueryRunner::start_array() { return start_container(true); }
+
+bool JsonQueryRunner::end_object() { return end_container(false); }
+
+bool JsonQueryRunner::end_array() { return end_container(true); }
+
+bool JsonQueryRunner::key(const std::string& k) {
+    if (m_capturing) {
+        m_builder.key(k);
+        return true;
+    }
+    Frame& f = m_frames[m_depth - 1];
+    if (f.matched) {
+        const JsonQuery::Step& step = m_query->m_prefix[m_depth - 1];
+        f.key_matched = step.kind == JsonQuery::Step::ITERATE ||
+                        (step.kind == JsonQuery::Step::KEY && step.key == k);
+    }
+    return true;
+}
+
+bool JsonQueryRunner::start_container(bool array) {
+    if (enter_value()) {
+        if (array) {
+            m_builder.start_array();
+        } else {
+            m_builder.start_object();
+        }
+        ++m_capture_depth;
+        return true;
+    }
+
+    if (m_depth == m_frames.size()) {
+        m_frames.emplace_back();
+    }
+    Frame& f = m_frames[m_depth++];
+    f.matched = m_matched;
+    f.array = array;
+    f.index = 0;
+    f.key_matched = false;
+    return true;
+}
+
+bool JsonQueryRunner::end_container(bool array) {
+    if (!m_capturing) {
+        --m_depth;
+        return true;
+    }
+    if (array) {
+        m_builder.end_array();
+    } else {
+        m_builder.end_object();
+    }
+    return --m_capture_depth > 0 || finish();
+}
+
+// 一个匹配前缀路径的值已构造完成, 交给其余的阶段
+bool JsonQueryRunner::finish() {
+    m_capturing = false;
+    JsonValue::ptr value = m_builder.take();
+    bool ok = m_query->eval(value, m_query->m_first,
+                            [this](const JsonValue::ptr& v) {
+                                ++m_results;
+                                return m_callback(v);
+                            });
+    m_stopped = !ok;
+    return ok;
+}
+
+}  // end of namespace tihi
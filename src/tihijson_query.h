@@ -0,0 +1,131 @@
+#ifndef TIHIJSON_TIHIJSON_QUERY_H_
+#define TIHIJSON_TIHIJSON_QUERY_H_
+
+#include <stddef.h>
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "tihijson.h"
+
+namespace tihi {
+
+/*
+ * jq 风格的路径查询, 例如
+ *
+ *     .items[] | select(.price > 10) | .id
+ *
+ * 由 | 分隔的若干阶段组成, 每个阶段是:
+ *   - 路径: . .a ."a b" .["a b"] .[0] .[] 以及它们的组合 (.a[0].b[]);
+ *     [] 遍历数组元素或对象的值
+ *   - select(路径 运算符 字面量), 运算符为 == != < <= > >=, 字面量为
+ *     数字, 字符串, true, false 或 null; 或 select(路径), 路径存在且
+ *     不为 null/false 时成立. 路径产生多个值时任一满足即成立
+ *
+ * 路径不存在时不产生结果 (相当于 jq 的 .a?). 不同类型的值之间只有
+ * != 成立.
+ */
+class JsonQuery {
+public:
+    using ptr = std::shared_ptr<const JsonQuery>;
+    // 返回 false 时停止求值
+    using Callback = std::function<bool(const JsonValue::ptr&)>;
+
+    // 失败时返回 nullptr, error 非空时写入原因
+    static ptr compile(const std::string& expr, std::string* error = nullptr);
+
+    // 对已有的树求值, 每个结果调用一次 callback; 被 callback 停止时
+    // 返回 false
+    bool eval(const JsonValue::ptr& value, const Callback& callback) const;
+
+private:
+    friend class JsonQueryParser;
+    friend class JsonQueryRunner;
+
+    struct Step {
+        enum Kind { KEY, INDEX, ITERATE } kind;
+        std::string key;
+        size_t index;
+    };
+    using Path = std::vector<Step>;
+
+    struct Stage {
+        enum Op { PATH, SELECT_TRUTHY, EQ, NE, LT, LE, GT, GE } op;
+        Path path;
+        JsonValue::ptr literal;
+    };
+
+    // 从第 stage 个阶段开始对 value 求值
+    bool eval(const JsonValue::ptr& value, size_t stage,
+              const Callback& callback) const;
+    bool walk(const JsonValue::ptr& value, const Path& path, size_t step,
+              const Callback& next) const;
+    bool test(const Stage& stage, const JsonValue::ptr& value) const;
+
+    // 第一个阶段为路径时, 该路径在扫描输入时匹配 (m_prefix), 只有匹配
+    // 到的值才构造为 JsonValue, 再交给其余的阶段 (从 m_first 开始)
+    Path m_prefix;
+    std::vector<Stage> m_stages;
+    size_t m_first = 0;
+};
+
+/*
+ * 在解析过程中执行查询: 作为 JsonHandler 交给 Json::parse 或
+ * JsonStreamReader, 只为匹配前缀路径的值构造 JsonValue, 文档的其余
+ * 部分只扫描不保存. 交给 JsonStreamReader 时输入边读边解析, 查询
+ * .items[] 时除读缓冲区外同时占用的内存约为一个元素; Json::parse 则
+ * 需要调用方先把整个文档读入内存.
+ */
+class JsonQueryRunner : public JsonHandler {
+public:
+    JsonQueryRunner(JsonQuery::ptr query, const JsonQuery::Callback& callback);
+
+    // callback 返回 false 而中止了解析
+    bool stopped() const { return m_stopped; }
+    // 累计的结果数
+    size_t results() const { return m_results; }
+
+    void start_document() override;
+    bool null() override;
+    bool boolean(bool b) override;
+    bool number(double d) override;
+    bool string(const std::string& s) override;
+    bool start_object() override;
+    bool key(const std::string& k) override;
+    bool end_object() override;
+    bool start_array() override;
+    bool end_array() override;
+
+private:
+    struct Frame {
+        bool matched;  // 该容器匹配了前缀路径的前 depth 步
+        bool array;
+        size_t index;       // 数组中下一个元素的下标
+        bool key_matched;   // 对象中当前 key 匹配下一步
+    };
+
+    bool enter_value();
+    bool start_container(bool array);
+    bool end_container(bool array);
+    bool finish();
+
+    JsonQuery::ptr m_query;
+    JsonQuery::Callback m_callback;
+
+    std::vector<Frame> m_frames;  // 只增不减
+    size_t m_depth = 0;
+    bool m_matched = false;  // enter_value 的结果, 供 start_container 使用
+
+    bool m_capturing = false;
+    size_t m_capture_depth = 0;
+    JsonBuilder m_builder;
+
+    bool m_stopped = false;
+    size_t m_results = 0;
+};
+
+}  // end of namespace tihi
+
+#endif  // TIHIJSON_TIHIJSON_QUERY_H_
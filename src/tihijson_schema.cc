@@ -0,0 +1,811 @@
+#include "tihijson_schema.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+namespace tihi {
+
+// 把 schema 文档编译为 JsonSchema::m_nodes. 每个子 schema 按地址只编译
+// 一次, $ref 因此可以递归引用
+class JsonSchemaCompiler {
+public:
+    JsonSchemaCompiler(const JsonValue& root, JsonSchema& schema)
+        : m_root(root), m_schema(schema) {}
+
+    bool run() { return compile(m_root) >= 0 && check_cycles(); }
+    const std::string& error() const { return m_error; }
+
+private:
+    using Node = JsonSchema::Node;
+
+    int compile(const JsonValue& v);
+    bool compile_keyword(int idx, const std::string& key, const JsonValue& v);
+    bool compile_list(const JsonValue& v, const std::string& key,
+                      std::vector<int>& out);
+    const JsonValue* resolve(const std::string& ref);
+    bool check_cycles();
+    bool visit(int idx, std::vector<char>& state);
+
+    bool fail(const std::string& msg) {
+        if (m_error.empty()) {
+            m_error = msg;
+        }
+        return false;
+    }
+
+    const JsonValue& m_root;
+    JsonSchema& m_schema;
+    std::unordered_map<const JsonValue*, int> m_compiled;
+    std::string m_error;
+};
+
+static bool is_scalar(const JsonValue& v) {
+    return v.get_type() != JsonValue::JSON_ARRAY &&
+           v.get_type() != JsonValue::JSON_OBJECT;
+}
+
+static bool get_size(const JsonValue& v, size_t& out) {
+    if (v.get_type() != JsonValue::JSON_NUMBER || v.get_number() < 0 ||
+        v.get_number() != floor(v.get_number())) {
+        return false;
+    }
+    out = static_cast<size_t>(v.get_number());
+    return true;
+}
+
+static uint32_t type_bits(const std::string& name) {
+    if (name == "null") {
+        return JsonSchema::TYPE_NULL;
+    } else if (name == "boolean") {
+        return JsonSchema::TYPE_BOOLEAN;
+    } else if (name == "integer") {
+        return JsonSchema::TYPE_INTEGER;
+    } else if (name == "number") {
+        return JsonSchema::TYPE_NUMBER | JsonSchema::TYPE_INTEGER;
+    } else if (name == "string") {
+        return JsonSchema::TYPE_STRING;
+    } else if (name == "array") {
+        return JsonSchema::TYPE_ARRAY;
+    } else if (name == "object") {
+        return JsonSchema::TYPE_OBJECT;
+    }
+    return 0;
+}
+
+int JsonSchemaCompiler::compile(const JsonValue& v) {
+    auto it = m_compiled.find(&v);
+    if (it != m_compiled.end()) {
+        return it->second;
+    }
+
+    int idx = static_cast<int>(m_schema.m_nodes.size());
+    m_schema.m_nodes.emplace_back();
+    m_compiled[&v] = idx;
+
+    if (v.get_type() == JsonValue::JSON_TRUE) {
+        return idx;
+    }
+    if (v.get_type() == JsonValue::JSON_FALSE) {
+        m_schema.m_nodes[idx].reject = true;
+        return idx;
+    }
+    if (v.get_type() != JsonValue::JSON_OBJECT) {
+        fail("schema must be an object or a boolean");
+        return -1;
+    }
+
+    // draft 7: 有 $ref 时忽略同级的其他关键字
+    const JsonValue::ptr ref = v.get_value_from_obj_by_string("$ref");
+    if (ref) {
+        return compile_keyword(idx, "$ref", *ref) ? idx : -1;
+    }
+    for (const auto& p : v.get_obj()) {
+        if (!compile_keyword(idx, p.first, *p.second)) {
+            return -1;
+        }
+    }
+    return idx;
+}
+
+bool JsonSchemaCompiler::compile_keyword(int idx, const std::string& key,
+                                         const JsonValue& v) {
+    int type = v.get_type();
+    bool is_number = type == JsonValue::JSON_NUMBER;
+    double number = is_number ? v.get_number() : 0;
+    int child = -1;
+
+#define NODE (m_schema.m_nodes[idx])
+#define EXPECT(cond, what)                       \
+    do {                                         \
+        if (!(cond)) {                           \
+            return fail(key + " must be " what); \
+        }                                        \
+    } while (0)
+
+    if (key == "type") {
+        uint32_t bits = 0;
+        if (type == JsonValue::JSON_STRING) {
+            bits = type_bits(v.get_str());
+            EXPECT(bits != 0, "a JSON type name");
+        } else {
+            EXPECT(type == JsonValue::JSON_ARRAY, "a string or an array");
+            for (const auto& t : v.get_vec()) {
+                uint32_t b = t->get_type() == JsonValue::JSON_STRING
+                                 ? type_bits(t->get_str())
+                                 : 0;
+                EXPECT(b != 0, "a list of JSON type names");
+                bits |= b;
+            }
+        }
+        NODE.types = bits;
+    } else if (key == "enum" || key == "const") {
+        std::vector<JsonValue::ptr> values;
+        if (key == "enum") {
+            EXPECT(type == JsonValue::JSON_ARRAY, "an array");
+            values = v.get_vec();
+        } else {
+            values.push_back(JsonValue::ptr(new JsonValue(v)));
+        }
+        for (const auto& e : values) {
+            if (!is_scalar(*e)) {
+                return fail(key + " with arrays or objects is not supported");
+            }
+        }
+        NODE.has_enum = true;
+        NODE.enum_values = values;
+    } else if (key == "minimum") {
+        EXPECT(is_number, "a number");
+        NODE.has_minimum = true;
+        NODE.minimum = number;
+    } else if (key == "maximum") {
+        EXPECT(is_number, "a number");
+        NODE.has_maximum = true;
+        NODE.maximum = number;
+    } else if (key == "exclusiveMinimum") {
+        EXPECT(is_number, "a number");
+        NODE.has_exclusive_minimum = true;
+        NODE.exclusive_minimum = number;
+    } else if (key == "exclusiveMaximum") {
+        EXPECT(is_number, "a number");
+        NODE.has_exclusive_maximum = true;
+        NODE.exclusive_maximum = number;
+    } else if (key == "multipleOf") {
+        EXPECT(is_number && number > 0, "a positive number");
+        NODE.multiple_of = number;
+    } else if (key == "minLength") {
+        EXPECT(get_size(v, NODE.min_length), "a non-negative integer");
+    } else if (key == "maxLength") {
+        EXPECT(get_size(v, NODE.max_length), "a non-negative integer");
+    } else if (key == "pattern") {
+        EXPECT(type == JsonValue::JSON_STRING, "a string");
+        try {
+            NODE.pattern = std::make_shared<std::regex>(
+                v.get_str(), std::regex::ECMAScript | std::regex::optimize);
+        } catch (const std::regex_error&) {
+            return fail("invalid pattern: " + v.get_str());
+        }
+    } else if (key == "properties") {
+        EXPECT(type == JsonValue::JSON_OBJECT, "an object");
+        for (const auto& p : v.get_obj()) {
+            if ((child = compile(*p.second)) < 0) {
+                return false;
+            }
+            NODE.properties[p.first] = child;
+        }
+    } else if (key == "required") {
+        EXPECT(type == JsonValue::JSON_ARRAY, "an array of strings");
+        for (const auto& r : v.get_vec()) {
+            EXPECT(r->get_type() == JsonValue::JSON_STRING,
+                   "an array of strings");
+            size_t n = NODE.required.size();
+            NODE.required.emplace(r->get_str(), n);
+        }
+    } else if (key == "additionalProperties") {
+        if ((child = compile(v)) < 0) {
+            return false;
+        }
+        NODE.additional_properties = child;
+    } else if (key == "minProperties") {
+        EXPECT(get_size(v, NODE.min_properties), "a non-negative integer");
+    } else if (key == "maxProperties") {
+        EXPECT(get_size(v, NODE.max_properties), "a non-negative integer");
+    } else if (key == "items") {
+        if (type == JsonValue::JSON_ARRAY) {
+            std::vector<int> items;
+            if (!compile_list(v, key, items)) {
+                return false;
+            }
+            NODE.tuple = true;
+            NODE.tuple_items = items;
+        } else {
+            if ((child = compile(v)) < 0) {
+                return false;
+            }
+            NODE.items = child;
+        }
+    } else if (key == "additionalItems") {
+        if ((child = compile(v)) < 0) {
+            return false;
+        }
+        NODE.additional_items = child;
+    } else if (key == "minItems") {
+        EXPECT(get_size(v, NODE.min_items), "a non-negative integer");
+    } else if (key == "maxItems") {
+        EXPECT(get_size(v, NODE.max_items), "a non-negative integer");
+    } else if (key == "allOf" || key == "anyOf" || key == "oneOf") {
+        std::vector<int> list;
+        if (!compile_list(v, key, list)) {
+            return false;
+        }
+        EXPECT(!list.empty(), "a non-empty array");
+        std::vector<int>& out = key == "allOf"   ? NODE.all_of
+                                : key == "anyOf" ? NODE.any_of
+                                                 : NODE.one_of;
+        out.insert(out.end(), list.begin(), list.end());
+    } else if (key == "not") {
+        if ((child = compile(v)) < 0) {
+            return false;
+        }
+        NODE.not_schema = child;
+    } else if (key == "$ref") {
+        EXPECT(type == JsonValue::JSON_STRING, "a string");
+        const JsonValue* target = resolve(v.get_str());
+        if (target == nullptr) {
+            return fail("cannot resolve $ref: " + v.get_str());
+        }
+        if ((child = compile(*target)) < 0) {
+            return false;
+        }
+        NODE.all_of.push_back(child);
+    } else if (key == "patternProperties" || key == "dependencies" ||
+               key == "propertyNames" || key == "if" || key == "then" ||
+               key == "else" || key == "contains" || key == "uniqueItems" ||
+               key == "contentEncoding" || key == "contentMediaType") {
+        return fail("unsupported keyword: " + key);
+    }
+    // 其他关键字 (title, description, format, definitions ...) 不参与校验
+    return true;
+
+#undef EXPECT
+#undef NODE
+}
+
+bool JsonSchemaCompiler::compile_list(const JsonValue& v,
+                                      const std::string& key,
+                                      std::vector<int>& out) {
+    if (v.get_type() != JsonValue::JSON_ARRAY) {
+        return fail(key + " must be an array of schemas");
+    }
+    for (const auto& e : v.get_vec()) {
+        int child = compile(*e);
+        if (child < 0) {
+            return false;
+        }
+        out.push_back(child);
+    }
+    return true;
+}
+
+// 只支持指向本文档的 JSON Pointer: "#" 或 "#/a/b"
+const JsonValue* JsonSchemaCompiler::resolve(const std::string& ref) {
+    if (ref.empty() || ref[0] != '#') {
+        return nullptr;
+    }
+    const JsonValue* v = &m_root;
+    size_t pos = 1;
+    while (pos < ref.size()) {
+        if (ref[pos] != '/') {
+            return nullptr;
+        }
+        size_t end = ref.find('/', pos + 1);
+        if (end == std::string::npos) {
+            end = ref.size();
+        }
+        std::string token;
+        for (size_t i = pos + 1; i < end; ++i) {
+            if (ref[i] == '~' && i + 1 < end &&
+                (ref[i + 1] == '0' || ref[i + 1] == '1')) {
+                token += ref[++i] == '0' ? '~' : '/';
+            } else {
+                token += ref[i];
+            }
+        }
+        pos = end;
+
+        if (v->get_type() == JsonValue::JSON_OBJECT) {
+            const JsonValue::ptr next = v->get_value_from_obj_by_string(token);
+            v = next.get();
+        } else if (v->get_type() == JsonValue::JSON_ARRAY) {
+            char* stop = nullptr;
+            unsigned long i = strtoul(token.c_str(), &stop, 10);
+            bool ok = !token.empty() && *stop == '\0' &&
+                      i < v->get_vec_size();
+            v = ok ? v->get_vec()[i].get() : nullptr;
+        } else {
+            v = nullptr;
+        }
+        if (v == nullptr) {
+            return nullptr;
+        }
+    }
+    return v;
+}
+
+// allOf/anyOf/oneOf/not/$ref 组成的环 (如 {"$ref": "#"}) 不消耗输入,
+// 校验时会无限展开
+bool JsonSchemaCompiler::check_cycles() {
+    std::vector<char> state(m_schema.m_nodes.size(), 0);
+    for (size_t i = 0; i < state.size(); ++i) {
+        if (!visit(static_cast<int>(i), state)) {
+            return fail("$ref cycle without consuming input");
+        }
+    }
+    return true;
+}
+
+bool JsonSchemaCompiler::visit(int idx, std::vector<char>& state) {
+    if (state[idx] == 2) {
+        return true;
+    }
+    if (state[idx] == 1) {
+        return false;
+    }
+    state[idx] = 1;
+    const Node& n = m_schema.m_nodes[idx];
+    for (const std::vector<int>* list : {&n.all_of, &n.any_of, &n.one_of}) {
+        for (int c : *list) {
+            if (!visit(c, state)) {
+                return false;
+            }
+        }
+    }
+    if (n.not_schema >= 0 && !visit(n.not_schema, state)) {
+        return false;
+    }
+    state[idx] = 2;
+    return true;
+}
+
+JsonSchema::ptr JsonSchema::compile(const JsonValue& schema,
+                                    std::string* error) {
+    std::shared_ptr<JsonSchema> ret(new JsonSchema);
+    JsonSchemaCompiler compiler(schema, *ret);
+    if (!compiler.run()) {
+        if (error != nullptr) {
+            *error = compiler.error();
+        }
+        return nullptr;
+    }
+    return ret;
+}
+
+JsonSchemaValidator::JsonSchemaValidator(JsonSchema::ptr schema)
+    : m_schema(schema) {
+    reset();
+}
+
+void JsonSchemaValidator::reset() {
+    m_instances.clear();
+    m_slots.clear();
+    m_groups.clear();
+    m_seen.clear();
+    m_depth = 0;
+    m_slots.push_back(Slot{-1, false});
+    m_failed = false;
+    m_error.clear();
+    m_error_path.clear();
+}
+
+bool JsonSchemaValidator::validate(const JsonValue& value) {
+    reset();
+    value.accept(*this);
+    return !m_failed;
+}
+
+void JsonSchemaValidator::start_document() { reset(); }
+
+bool JsonSchemaValidator::null() {
+    return scalar(JsonSchema::TYPE_NULL, 0, nullptr);
+}
+
+bool JsonSchemaValidator::boolean(bool b) {
+    return scalar(JsonSchema::TYPE_BOOLEAN, b ? 1 : 0, nullptr);
+}
+
+bool JsonSchemaValidator::number(double d) {
+    uint32_t type = JsonSchema::TYPE_NUMBER;
+    if (d == floor(d)) {
+        type |= JsonSchema::TYPE_INTEGER;
+    }
+    return scalar(type, d, nullptr);
+}
+
+bool JsonSchemaValidator::string(const std::string& s) {
+    return scalar(JsonSchema::TYPE_STRING, 0, &s);
+}
+
+bool JsonSchemaValidator::start_object() { return start_container(false); }
+
+bool JsonSchemaValidator::start_array() { return start_container(true); }
+
+bool JsonSchemaValidator::end_object() { return end_container(); }
+
+bool JsonSchemaValidator::end_array() { return end_container(); }
+
+bool JsonSchemaValidator::key(const std::string& k) {
+    const std::vector<JsonSchema::Node>& nodes = m_schema->m_nodes;
+    Frame& f = m_frames[m_depth - 1];
+    f.key = k;
+    ++f.count;
+    m_path_frames = m_depth;
+
+    for (size_t i = f.instances; i < f.children; ++i) {
+        const Instance inst = m_instances[i];
+        if (dead(inst.slot)) {
+            continue;
+        }
+        const JsonSchema::Node& n = nodes[inst.node];
+        if (f.count > n.max_properties) {
+            fail(inst.slot, "maxProperties");
+            continue;
+        }
+        if (!n.required.empty()) {
+            auto r = n.required.find(k);
+            if (r != n.required.end()) {
+                m_seen[inst.seen + r->second] = 1;
+            }
+        }
+        auto p = n.properties.find(k);
+        if (p != n.properties.end()) {
+            m_instances.push_back(Instance{p->second, inst.slot, 0});
+        } else if (n.additional_properties >= 0) {
+            if (nodes[n.additional_properties].reject) {
+                fail(inst.slot, "additionalProperties: unexpected key");
+                continue;
+            }
+            m_instances.push_back(
+                Instance{n.additional_properties, inst.slot, 0});
+        }
+    }
+    return !m_failed;
+}
+
+// 确定新值需要满足的实例并展开组合关键字, 返回实例的起始下标;
+// groups/slots 为展开之前的位置, 值结束时回退到这里
+size_t JsonSchemaValidator::begin_value(size_t& groups, size_t& slots) {
+    size_t begin = m_instances.size();
+    if (m_depth == 0) {
+        reset();
+        begin = 0;
+        m_instances.push_back(Instance{0, 0, 0});
+    } else {
+        Frame& f = m_frames[m_depth - 1];
+        if (f.array) {
+            const std::vector<JsonSchema::Node>& nodes = m_schema->m_nodes;
+            size_t index = f.count++;
+            for (size_t i = f.instances; i < f.children; ++i) {
+                const Instance inst = m_instances[i];
+                if (dead(inst.slot)) {
+                    continue;
+                }
+                const JsonSchema::Node& n = nodes[inst.node];
+                if (f.count > n.max_items) {
+                    fail(inst.slot, "maxItems");
+                    continue;
+                }
+                int child = n.items;
+                if (n.tuple) {
+                    child = index < n.tuple_items.size()
+                                ? n.tuple_items[index]
+                                : n.additional_items;
+                    if (index >= n.tuple_items.size() && child >= 0 &&
+                        nodes[child].reject) {
+                        fail(inst.slot, "additionalItems: unexpected item");
+                        continue;
+                    }
+                }
+                if (child >= 0) {
+                    m_instances.push_back(Instance{child, inst.slot, 0});
+                }
+            }
+        } else {
+            begin = f.children;
+        }
+    }
+    m_path_frames = m_depth;
+    groups = m_groups.size();
+    slots = m_slots.size();
+    expand(begin);
+    return begin;
+}
+
+void JsonSchemaValidator::expand(size_t begin) {
+    const std::vector<JsonSchema::Node>& nodes = m_schema->m_nodes;
+    for (size_t i = begin; i < m_instances.size(); ++i) {
+        const Instance inst = m_instances[i];
+        if (dead(inst.slot)) {
+            continue;
+        }
+        const JsonSchema::Node& n = nodes[inst.node];
+        if (n.reject) {
+            fail(inst.slot, "false schema");
+            continue;
+        }
+        for (int c : n.all_of) {
+            m_instances.push_back(Instance{c, inst.slot, 0});
+        }
+        if (!n.any_of.empty()) {
+            add_branches(n.any_of, Group::ANY, inst.slot);
+        }
+        if (!n.one_of.empty()) {
+            add_branches(n.one_of, Group::ONE, inst.slot);
+        }
+        if (n.not_schema >= 0) {
+            add_branches(std::vector<int>(1, n.not_schema), Group::NOT,
+                         inst.slot);
+        }
+    }
+}
+
+void JsonSchemaValidator::add_branches(const std::vector<int>& nodes,
+                                       Group::Kind kind, int slot) {
+    int group = static_cast<int>(m_groups.size());
+    m_groups.push_back(Group{kind, slot, nodes.size(), 0});
+    for (int c : nodes) {
+        m_instances.push_back(
+            Instance{c, static_cast<int>(m_slots.size()), 0});
+        m_slots.push_back(Slot{group, false});
+    }
+}
+
+bool JsonSchemaValidator::scalar(uint32_t type, double d,
+                                 const std::string* s) {
+    size_t groups = 0, slots = 0;
+    size_t begin = begin_value(groups, slots);
+    for (size_t i = begin; i < m_instances.size() && !m_failed; ++i) {
+        if (!dead(m_instances[i].slot)) {
+            check_scalar(m_instances[i], type, d, s);
+        }
+    }
+    end_value(begin, groups, slots);
+    return !m_failed;
+}
+
+// 按 UTF-8 编码计算码点数
+static size_t code_points(const std::string& s) {
+    size_t n = 0;
+    for (unsigned char c : s) {
+        n += (c & 0xC0) != 0x80;
+    }
+    return n;
+}
+
+void JsonSchemaValidator::check_scalar(const Instance& inst, uint32_t type,
+                                       double d, const std::string* s) {
+    const JsonSchema::Node& n = m_schema->m_nodes[inst.node];
+    if (!(n.types & type)) {
+        fail(inst.slot, "type mismatch");
+        return;
+    }
+
+    if (n.has_enum) {
+        bool found = false;
+        for (const auto& e : n.enum_values) {
+            switch (e->get_type()) {
+                case JsonValue::JSON_NULL:
+                    found = type == JsonSchema::TYPE_NULL;
+                    break;
+                case JsonValue::JSON_FALSE:
+                case JsonValue::JSON_TRUE:
+                    found = type == JsonSchema::TYPE_BOOLEAN &&
+                            (d != 0) == (e->get_type() == JsonValue::JSON_TRUE);
+                    break;
+                case JsonValue::JSON_NUMBER:
+                    found = (type & JsonSchema::TYPE_NUMBER) &&
+                            e->get_number() == d;
+                    break;
+                case JsonValue::JSON_STRING:
+                    found = s != nullptr && e->get_str() == *s;
+                    break;
+                default:
+                    break;
+            }
+            if (found) {
+                break;
+            }
+        }
+        if (!found) {
+            fail(inst.slot, "not in enum");
+            return;
+        }
+    }
+
+    if (type & JsonSchema::TYPE_NUMBER) {
+        if ((n.has_minimum && d < n.minimum) ||
+            (n.has_exclusive_minimum && d <= n.exclusive_minimum)) {
+            fail(inst.slot, "below minimum");
+        } else if ((n.has_maximum && d > n.maximum) ||
+                   (n.has_exclusive_maximum && d >= n.exclusive_maximum)) {
+            fail(inst.slot, "above maximum");
+        } else if (n.multiple_of > 0) {
+            double q = d / n.multiple_of;
+            if (q != floor(q)) {
+                fail(inst.slot, "not a multiple of multipleOf");
+            }
+        }
+    } else if (s != nullptr) {
+        if (n.min_length > 0 || n.max_length != SIZE_MAX) {
+            size_t len = code_points(*s);
+            if (len < n.min_length) {
+                fail(inst.slot, "shorter than minLength");
+                return;
+            }
+            if (len > n.max_length) {
+                fail(inst.slot, "longer than maxLength");
+                return;
+            }
+        }
+        if (n.pattern && s->size() > max_pattern_bytes) {
+            fail(inst.slot, "too long to match pattern");
+        } else if (n.pattern && !std::regex_search(*s, *n.pattern)) {
+            fail(inst.slot, "does not match pattern");
+        }
+    }
+}
+
+bool JsonSchemaValidator::start_container(bool array) {
+    size_t groups = 0, slots = 0;
+    size_t begin = begin_value(groups, slots);
+    uint32_t type = array ? JsonSchema::TYPE_ARRAY : JsonSchema::TYPE_OBJECT;
+    size_t seen = m_seen.size();
+
+    for (size_t i = begin; i < m_instances.size(); ++i) {
+        Instance& inst = m_instances[i];
+        if (dead(inst.slot)) {
+            continue;
+        }
+        const JsonSchema::Node& n = m_schema->m_nodes[inst.node];
+        if (!(n.types & type)) {
+            fail(inst.slot, "type mismatch");
+            continue;
+        }
+        if (!array && !n.required.empty()) {
+            inst.seen = m_seen.size();
+            m_seen.resize(m_seen.size() + n.required.size(), 0);
+        }
+    }
+    if (m_failed) {
+        return false;
+    }
+
+    if (m_depth == m_frames.size()) {
+        m_frames.emplace_back();
+    }
+    Frame& f = m_frames[m_depth++];
+    f.array = array;
+    f.count = 0;
+    f.instances = begin;
+    f.children = m_instances.size();
+    f.groups = groups;
+    f.slots = slots;
+    f.seen = seen;
+    return true;
+}
+
+bool JsonSchemaValidator::end_container() {
+    const Frame& f = m_frames[m_depth - 1];
+    m_path_frames = m_depth - 1;
+    m_instances.resize(f.children);
+
+    for (size_t i = f.instances; i < f.children; ++i) {
+        const Instance inst = m_instances[i];
+        if (dead(inst.slot)) {
+            continue;
+        }
+        const JsonSchema::Node& n = m_schema->m_nodes[inst.node];
+        if (f.array) {
+            if (f.count < n.min_items) {
+                fail(inst.slot, "fewer items than minItems");
+            }
+            continue;
+        }
+        if (f.count < n.min_properties) {
+            fail(inst.slot, "fewer properties than minProperties");
+            continue;
+        }
+        for (const auto& r : n.required) {
+            if (!m_seen[inst.seen + r.second]) {
+                fail(inst.slot, "missing required property: " + r.first);
+                break;
+            }
+        }
+    }
+
+    m_seen.resize(f.seen);
+    --m_depth;
+    end_value(f.instances, f.groups, f.slots);
+    return !m_failed;
+}
+
+// 值结束: 按创建的逆序判定该值上的组合关键字 (内层先于外层), 然后丢弃
+// 该值的实例
+void JsonSchemaValidator::end_value(size_t instances, size_t groups,
+                                    size_t slots) {
+    for (size_t i = m_groups.size(); i > groups && !m_failed; --i) {
+        const Group& g = m_groups[i - 1];
+        size_t passed = g.branches - g.failed;
+        if (g.kind == Group::ONE && passed > 1) {
+            fail(g.slot, "oneOf: more than one schema matched");
+        } else if (g.kind == Group::NOT && passed > 0) {
+            fail(g.slot, "not: schema matched");
+        }
+    }
+    m_instances.resize(instances);
+    m_groups.resize(groups);
+    m_slots.resize(slots);
+}
+
+// slot 失败; 使 anyOf/oneOf 的最后一个分支失败时, 组合本身随即失败
+void JsonSchemaValidator::fail(int slot, const std::string& reason) {
+    std::string why = reason;
+    for (;;) {
+        if (slot == 0) {
+            if (!m_failed) {
+                m_failed = true;
+                m_error = why;
+                m_error_path = path();
+            }
+            return;
+        }
+        Slot& s = m_slots[slot];
+        if (s.failed) {
+            return;
+        }
+        s.failed = true;
+        Group& g = m_groups[s.group];
+        ++g.failed;
+        if (g.kind == Group::NOT || g.failed < g.branches) {
+            return;
+        }
+        why = g.kind == Group::ANY ? "anyOf: no schema matched"
+                                   : "oneOf: no schema matched";
+        slot = g.slot;
+    }
+}
+
+// 所在分支或其外层分支已经失败, 不必再检查
+bool JsonSchemaValidator::dead(int slot) const {
+    while (slot != 0) {
+        const Slot& s = m_slots[slot];
+        if (s.failed) {
+            return true;
+        }
+        slot = m_groups[s.group].slot;
+    }
+    return false;
+}
+
+// 出错位置的 JSON Pointer
+std::string JsonSchemaValidator::path() const {
+    std::string ret;
+    for (size_t i = 0; i < m_path_frames; ++i) {
+        const Frame& f = m_frames[i];
+        ret += '/';
+        if (f.array) {
+            ret += std::to_string(f.count - 1);
+            continue;
+        }
+        for (char c : f.key) {
+            if (c == '~') {
+                ret += "~0";
+            } else if (c == '/') {
+                ret += "~1";
+            } else {
+                ret += c;
+            }
+        }
+    }
+    return ret;
+}
+
+}  // end of namespace tihi
@@ -0,0 +1,195 @@
+#ifndef TIHIJSON_TIHIJSON_SCHEMA_H_
+#define TIHIJSON_TIHIJSON_SCHEMA_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+#include <regex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "tihijson.h"
+
+namespace tihi {
+
+/*
+ * 编译后的 JSON Schema (draft 7 子集).
+ *
+ * 支持的关键字: type, enum/const (仅标量), minimum, maximum,
+ * exclusiveMinimum, exclusiveMaximum, multipleOf, minLength, maxLength,
+ * pattern, properties, required, additionalProperties, minProperties,
+ * maxProperties, items (单个 schema 或元组), additionalItems, minItems,
+ * maxItems, allOf, anyOf, oneOf, not, 以及指向本文档内的 $ref
+ * ("#", "#/definitions/..."). true/false 可作为 schema.
+ *
+ * 其余会影响校验结果的关键字 (patternProperties, dependencies,
+ * propertyNames, if/then/else, contains, uniqueItems 等) 编译时报错;
+ * title, description, format 等注解被忽略.
+ */
+class JsonSchema {
+public:
+    using ptr = std::shared_ptr<const JsonSchema>;
+
+    // 失败时返回 nullptr, error 非空时写入原因
+    static ptr compile(const JsonValue& schema, std::string* error = nullptr);
+
+    // 类型位, "number" 同时包含 TYPE_INTEGER
+    enum {
+        TYPE_NULL = 1,
+        TYPE_BOOLEAN = 2,
+        TYPE_INTEGER = 4,
+        TYPE_NUMBER = 8,
+        TYPE_STRING = 16,
+        TYPE_ARRAY = 32,
+        TYPE_OBJECT = 64,
+        TYPE_ANY = 127,
+    };
+
+private:
+    friend class JsonSchemaValidator;
+    friend class JsonSchemaCompiler;
+
+    // 一个 schema 节点, 子 schema 以节点下标引用, -1 表示不限制
+    struct Node {
+        bool reject = false;  // false schema
+        uint32_t types = TYPE_ANY;
+
+        bool has_enum = false;
+        std::vector<JsonValue::ptr> enum_values;
+
+        bool has_minimum = false, has_maximum = false;
+        bool has_exclusive_minimum = false, has_exclusive_maximum = false;
+        double minimum = 0, maximum = 0;
+        double exclusive_minimum = 0, exclusive_maximum = 0;
+        double multiple_of = 0;
+
+        size_t min_length = 0, max_length = SIZE_MAX;
+        std::shared_ptr<std::regex> pattern;
+
+        std::unordered_map<std::string, int> properties;
+        // required 中的 key -> 下标, 用于标记已出现的 key
+        std::unordered_map<std::string, size_t> required;
+        int additional_properties = -1;
+        size_t min_properties = 0, max_properties = SIZE_MAX;
+
+        int items = -1;
+        bool tuple = false;
+        std::vector<int> tuple_items;
+        int additional_items = -1;
+        size_t min_items = 0, max_items = SIZE_MAX;
+
+        std::vector<int> all_of;  // allOf 与 $ref
+        std::vector<int> any_of;
+        std::vector<int> one_of;
+        int not_schema = -1;
+    };
+
+    std::vector<Node> m_nodes;  // m_nodes[0] 为根
+};
+
+/*
+ * 在解析过程中按 schema 校验. 作为 JsonHandler 使用:
+ *
+ *     JsonSchemaValidator validator(schema);
+ *     ctx.observer = &validator;        // 构造树的同时校验
+ *     json.parse(str, value, ctx);      // 不合法时返回 PARSE_REJECTED
+ *
+ * 或 json.parse(str, validator, ctx) 只校验不建树. 一旦能确定文档不
+ * 合法 (类型不符, additionalProperties 为 false 时出现多余的 key,
+ * 超出 maxItems 等) 就立即中止解析; anyOf/oneOf/not 在对应的值结束
+ * 时判定, 但所有分支都已失败的 anyOf/oneOf 会立即失败.
+ *
+ * 每次解析开始时重置, 可以复用于多个文档; 不是线程安全的.
+ *
+ * pattern 使用 std::regex, libstdc++ 的实现按字符递归回溯, 长字符串会
+ * 耗尽调用栈, 某些模式还需要指数时间. 因此长于 max_pattern_bytes 的
+ * 字符串直接判为不匹配. 模式本身来自 schema, 须是可信的.
+ */
+class JsonSchemaValidator : public JsonHandler {
+public:
+    explicit JsonSchemaValidator(JsonSchema::ptr schema);
+
+    // 校验已有的树
+    bool validate(const JsonValue& value);
+
+    // 最近一次失败的原因及位置 (JSON Pointer), 未失败时为空
+    const std::string& error() const { return m_error; }
+    const std::string& error_path() const { return m_error_path; }
+    bool failed() const { return m_failed; }
+    void reset();
+
+    // 交给 pattern 匹配的字符串的最大字节数, 更长的视为不匹配
+    size_t max_pattern_bytes = 4096;
+
+    void start_document() override;
+    bool null() override;
+    bool boolean(bool b) override;
+    bool number(double d) override;
+    bool string(const std::string& s) override;
+    bool start_object() override;
+    bool key(const std::string& k) override;
+    bool end_object() override;
+    bool start_array() override;
+    bool end_array() override;
+
+private:
+    // 某个值需要满足的一个 schema 节点, 结果记入 slot
+    struct Instance {
+        int node;
+        int slot;
+        size_t seen;  // 该实例 required 标记在 m_seen 中的起始位置
+    };
+    // 结果槽: 0 为整个文档, 其余为 anyOf/oneOf/not 的分支
+    struct Slot {
+        int group;
+        bool failed;
+    };
+    // 作用在某个值上的一个 anyOf/oneOf/not
+    struct Group {
+        enum Kind { ANY, ONE, NOT } kind;
+        int slot;  // 组合结果记入的槽
+        size_t branches;
+        size_t failed;
+    };
+    struct Frame {
+        bool array;
+        size_t count;  // 已出现的元素/成员数
+        size_t instances, children;  // 容器的实例为 [instances, children)
+        size_t groups, slots, seen;
+        std::string key;
+    };
+
+    size_t begin_value(size_t& groups, size_t& slots);
+    void expand(size_t begin);
+    void add_branches(const std::vector<int>& nodes, Group::Kind kind,
+                      int slot);
+    bool scalar(uint32_t type, double d, const std::string* s);
+    void check_scalar(const Instance& inst, uint32_t type, double d,
+                      const std::string* s);
+    bool start_container(bool array);
+    bool end_container();
+    void end_value(size_t instances, size_t groups, size_t slots);
+    void fail(int slot, const std::string& reason);
+    bool dead(int slot) const;
+    std::string path() const;
+
+    JsonSchema::ptr m_schema;
+    std::vector<Instance> m_instances;
+    std::vector<Slot> m_slots;
+    std::vector<Group> m_groups;
+    std::vector<char> m_seen;
+    std::vector<Frame> m_frames;  // 只增不减, 复用其中的 key
+    size_t m_depth = 0;
+    // 报错位置包含的层数: 值开始时包含所有层, 容器结束时不含自身
+    size_t m_path_frames = 0;
+
+    bool m_failed = false;
+    std::string m_error;
+    std::string m_error_path;
+};
+
+}  // end of namespace tihi
+
+#endif  // TIHIJSON_TIHIJSON_SCHEMA_H_
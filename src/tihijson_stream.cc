@@ -0,0 +1,511 @@
+#include "tihijson_stream.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <thread>
+
+#ifdef TIHIJSON_WITH_ZLIB
+#include <zlib.h>
+#endif
+#ifdef TIHIJSON_WITH_ZSTD
+#include <zstd.h>
+#endif
+
+namespace tihi {
+
+ssize_t JsonFdSource::read(char* buf, size_t n) {
+    for (;;) {
+        ssize_t ret = ::read(m_fd, buf, n);
+        if (ret >= 0 || errno != EINTR) {
+            return ret;
+        }
+    }
+}
+
+struct JsonDecompressSource::Impl {
+    explicit Impl(JsonChunkSource& s, size_t in_size)
+        : source(s), in(in_size < 16 ? 16 : in_size) {}
+    ~Impl();
+
+    // 压缩数据读完后重新读入一块, 出错返回 false
+    bool fill();
+    bool detect();
+    ssize_t read_gzip(char* buf, size_t n);
+    ssize_t read_zstd(char* buf, size_t n);
+
+    JsonChunkSource& source;
+    std::vector<char> in;
+    size_t in_pos = 0;
+    size_t in_len = 0;
+    bool eof = false;
+    bool detected = false;
+    bool done = false;  // 最后一个 gzip 成员或 zstd 帧已解压完
+    Codec codec = CODEC_NONE;
+#ifdef TIHIJSON_WITH_ZLIB
+    z_stream zs;
+    bool zs_init = false;
+#endif
+#ifdef TIHIJSON_WITH_ZSTD
+    ZSTD_DCtx* dctx = nullptr;
+#endif
+};
+
+JsonDecompressSource::Impl::~Impl() {
+#ifdef TIHIJSON_WITH_ZLIB
+    if (zs_init) {
+        inflateEnd(&zs);
+    }
+#endif
+#ifdef TIHIJSON_WITH_ZSTD
+    ZSTD_freeDCtx(dctx);
+#endif
+}
+
+bool JsonDecompressSource::Impl::fill() {
+    ssize_t n = source.read(in.data(), in.size());
+    if (n < 0) {
+        return false;
+    }
+    eof = n == 0;
+    in_pos = 0;
+    in_len = n;
+    return true;
+}
+
+bool JsonDecompressSource::Impl::detect() {
+    // 至少读入 4 字节才能判断魔数
+    while (in_len < 4 && !eof) {
+        ssize_t n = source.read(in.data() + in_len, in.size() - in_len);
+        if (n < 0) {
+            return false;
+        }
+        eof = n == 0;
+        in_len += n;
+    }
+    detected = true;
+
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(in.data());
+    if (in_len >= 2 && p[0] == 0x1f && p[1] == 0x8b) {
+        codec = CODEC_GZIP;
+    } else if (in_len >= 4 && p[0] == 0x28 && p[1] == 0xb5 && p[2] == 0x2f &&
+               p[3] == 0xfd) {
+        codec = CODEC_ZSTD;
+    } else {
+        codec = CODEC_NONE;
+        return true;
+    }
+    if (!supported(codec)) {
+        return false;
+    }
+
+#ifdef TIHIJSON_WITH_ZLIB
+    if (codec == CODEC_GZIP) {
+        memset(&zs, 0, sizeof(zs));
+        // 15 + 16: 只接受 gzip 头
+        if (inflateInit2(&zs, 15 + 16) != Z_OK) {
+            return false;
+        }
+        zs_init = true;
+    }
+#endif
+#ifdef TIHIJSON_WITH_ZSTD
+    if (codec == CODEC_ZSTD) {
+        dctx = ZSTD_createDCtx();
+        if (dctx == nullptr) {
+            return false;
+        }
+    }
+#endif
+    return true;
+}
+
+ssize_t JsonDecompressSource::Impl::read_gzip(char* buf, size_t n) {
+#ifdef TIHIJSON_WITH_ZLIB
+    // avail_out 是 32 位
+    if (n > (1u << 30)) {
+        n = 1u << 30;
+    }
+    for (;;) {
+        if (done) {
+            return 0;
+        }
+        if (in_pos == in_len && !eof && !fill()) {
+            return -1;
+        }
+        zs.next_in = reinterpret_cast<Bytef*>(in.data() + in_pos);
+        zs.avail_in = static_cast<uInt>(in_len - in_pos);
+        zs.next_out = reinterpret_cast<Bytef*>(buf);
+        zs.avail_out = static_cast<uInt>(n);
+        int ret = inflate(&zs, Z_NO_FLUSH);
+        in_pos = in_len - zs.avail_in;
+        size_t produced = n - zs.avail_out;
+
+        if (ret == Z_STREAM_END) {
+            // 后面还有数据时按下一个 gzip 成员继续
+            if (in_pos == in_len && !eof && !fill()) {
+                return -1;
+            }
+            if (in_pos == in_len) {
+                done = true;
+            } else if (inflateReset(&zs) != Z_OK) {
+                return -1;
+            }
+        } else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+            return -1;
+        } else if (produced == 0 && in_pos == in_len && eof) {
+            // 压缩数据被截断
+            return -1;
+        }
+        if (produced > 0) {
+            return produced;
+        }
+    }
+#else
+    (void)buf;
+    (void)n;
+    return -1;
+#endif
+}
+
+ssize_t JsonDecompressSource::Impl::read_zstd(char* buf, size_t n) {
+#ifdef TIHIJSON_WITH_ZSTD
+    for (;;) {
+        if (done) {
+            return 0;
+        }
+        if (in_pos == in_len && !eof && !fill()) {
+            return -1;
+        }
+        ZSTD_inBuffer input = {in.data(), in_len, in_pos};
+        ZSTD_outBuffer output = {buf, n, 0};
+        // 返回 0 表示刚好解压完一帧
+        size_t frame_left = ZSTD_decompressStream(dctx, &output, &input);
+        if (ZSTD_isError(frame_left)) {
+            return -1;
+        }
+        in_pos = input.pos;
+
+        if (frame_left == 0) {
+            if (in_pos == in_len && !eof && !fill()) {
+                return -1;
+            }
+            done = in_pos == in_len;
+        } else if (output.pos == 0 && in_pos == in_len && eof) {
+            return -1;
+        }
+        if (output.pos > 0) {
+            return output.pos;
+        }
+    }
+#else
+    (void)buf;
+    (void)n;
+    return -1;
+#endif
+}
+
+JsonDecompressSource::JsonDecompressSource(JsonChunkSource& source,
+                                           size_t in_size)
+    : m_impl(new Impl(source, in_size)) {}
+
+JsonDecompressSource::~JsonDecompressSource() {}
+
+ssize_t JsonDecompressSource::read(char* buf, size_t n) {
+    Impl& d = *m_impl;
+    if (!d.detected && !d.detect()) {
+        return -1;
+    }
+
+    switch (d.codec) {
+        case CODEC_GZIP:
+            return d.read_gzip(buf, n);
+        case CODEC_ZSTD:
+            return d.read_zstd(buf, n);
+        default:
+            break;
+    }
+
+    // 未压缩: 先交出识别格式时读入的数据, 之后直接读到调用方的缓冲区
+    if (d.in_pos < d.in_len) {
+        size_t len = std::min(n, d.in_len - d.in_pos);
+        memcpy(buf, d.in.data() + d.in_pos, len);
+        d.in_pos += len;
+        return len;
+    }
+    return d.eof ? 0 : d.source.read(buf, n);
+}
+
+JsonDecompressSource::Codec JsonDecompressSource::codec() const {
+    return m_impl->codec;
+}
+
+bool JsonDecompressSource::supported(Codec codec) {
+    switch (codec) {
+        case CODEC_NONE:
+            return true;
+#ifdef TIHIJSON_WITH_ZLIB
+        case CODEC_GZIP:
+            return true;
+#endif
+#ifdef TIHIJSON_WITH_ZSTD
+        case CODEC_ZSTD:
+            return true;
+#endif
+        default:
+            return false;
+    }
+}
+
+static bool is_ws(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+JsonStreamReader::JsonStreamReader(size_t chunk_size, size_t buffers)
+    : m_chunk_size(chunk_size == 0 ? 1 : chunk_size) {
+    // 至少两个缓冲区, 才能一边读一边解析
+    m_buffers.resize(buffers < 2 ? 2 : buffers);
+    for (auto& b : m_buffers) {
+        b.resize(m_chunk_size);
+    }
+}
+
+Json::STATUS JsonStreamReader::parse_file(const std::string& path,
+                                          const Callback& callback) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        m_documents = 0;
+        return Json::PARSE_READ_ERROR;
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    // 回调抛出异常时同样关闭
+    struct Closer {
+        int fd;
+        ~Closer() { ::close(fd); }
+    } closer{fd};
+    JsonFdSource fd_source(fd);
+    JsonDecompressSource source(fd_source);
+    return parse(source, callback);
+}
+
+// 在作用域内使用 handler, 离开时 (包括 handler 抛出异常) 恢复
+struct JsonStreamReader::HandlerScope {
+    HandlerScope(JsonStreamReader& r, JsonHandler& handler) : reader(r) {
+        reader.m_handler = &handler;
+    }
+    ~HandlerScope() {
+        reader.m_handler = nullptr;
+        reader.m_events.handler = nullptr;
+    }
+    JsonStreamReader& reader;
+};
+
+Json::STATUS JsonStreamReader::parse_file(const std::string& path,
+                                          JsonHandler& handler) {
+    HandlerScope scope(*this, handler);
+    return parse_file(path, Callback());
+}
+
+Json::STATUS JsonStreamReader::parse(JsonChunkSource& source,
+                                     JsonHandler& handler) {
+    HandlerScope scope(*this, handler);
+    return parse(source, Callback());
+}
+
+Json::STATUS JsonStreamReader::parse(JsonChunkSource& source,
+                                     const Callback& callback) {
+    m_documents = 0;
+    // 缓冲区会被复用, 文档解析完即清空, 节点不能借用其中的字符串
+    m_ctx.borrow_strings = false;
+    m_doc.clear();
+    m_active = m_in_str = m_escape = m_in_scalar = false;
+    m_depth = 0;
+    m_stop = false;
+    m_filled.clear();
+    m_free.clear();
+    for (size_t i = 0; i < m_buffers.size(); ++i) {
+        m_free.push_back(i);
+    }
+    if (m_handler != nullptr) {
+        m_events.reset();
+        m_events.multiple = true;
+        m_events.max_depth = m_ctx.max_depth;
+        m_events.validate_utf8 = m_ctx.validate_utf8;
+        m_events.handler = m_handler;
+    }
+
+    std::thread reader(&JsonStreamReader::read_loop, this, std::ref(source));
+    // 离开作用域时 (包括回调或 handler 抛出异常) 让读线程停止并等待它
+    // 退出, 否则 std::thread 析构时仍可 join 会调用 std::terminate
+    struct Joiner {
+        JsonStreamReader& self;
+        std::thread& thread;
+        ~Joiner() {
+            {
+                std::lock_guard<std::mutex> lock(self.m_mutex);
+                self.m_stop = true;
+            }
+            self.m_cond.notify_all();
+            thread.join();
+        }
+    } joiner{*this, reader};
+
+    Json::STATUS ret = Json::PARSE_OK;
+    bool stop = false;
+    while (ret == Json::PARSE_OK && !stop) {
+        Chunk chunk;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cond.wait(lock, [this] { return !m_filled.empty(); });
+            chunk = m_filled.front();
+            m_filled.pop_front();
+        }
+        if (chunk.size < 0) {
+            ret = Json::PARSE_READ_ERROR;
+            break;
+        }
+        if (chunk.size == 0) {
+            // 输入结束: 最后一个文档 (顶层标量或不完整的文档) 交给解析器
+            if (m_handler != nullptr) {
+                ret = m_events.finish(nullptr);
+            } else if (m_active) {
+                ret = emit(callback, stop);
+            }
+            break;
+        }
+
+        const char* data = m_buffers[chunk.index].data();
+        if (m_handler != nullptr) {
+            ret = m_events.feed(data, chunk.size, nullptr);
+        } else {
+            ret = split(data, chunk.size, callback, stop);
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_free.push_back(chunk.index);
+        }
+        m_cond.notify_all();
+    }
+
+    if (m_handler != nullptr) {
+        m_documents = m_events.documents();
+    }
+    return ret;
+}
+
+void JsonStreamReader::read_loop(JsonChunkSource& source) {
+    for (;;) {
+        size_t index;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cond.wait(lock, [this] { return m_stop || !m_free.empty(); });
+            if (m_stop) {
+                return;
+            }
+            index = m_free.front();
+            m_free.pop_front();
+        }
+
+        ssize_t n = -1;
+        try {
+            n = source.read(m_buffers[index].data(), m_chunk_size);
+        } catch (...) {
+            // 异常不能离开读线程, 按读取错误处理
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_filled.push_back(Chunk{index, n < 0 ? -1 : n});
+        }
+        m_cond.notify_all();
+        if (n <= 0) {
+            return;
+        }
+    }
+}
+
+Json::STATUS JsonStreamReader::split(const char* data, size_t size,
+                                     const Callback& callback, bool& stop) {
+    size_t begin = 0;  // 当前文档在本块中的起点
+    size_t i = 0;
+    while (i < size) {
+        char c = data[i];
+        if (!m_active) {
+            if (is_ws(c)) {
+                ++i;
+                continue;
+            }
+            m_active = true;
+            begin = i;
+        }
+
+        bool end = false;
+        if (m_in_str) {
+            if (m_escape) {
+                m_escape = false;
+            } else if (c == '\\') {
+                m_escape = true;
+            } else if (c == '\"') {
+                m_in_str = false;
+                end = m_depth == 0;
+            }
+        } else if (m_in_scalar) {
+            if (is_ws(c) || c == '{' || c == '[' || c == '\"') {
+                // 标量在 c 之前结束, c 属于下一个文档
+                m_doc.append(data + begin, i - begin);
+                Json::STATUS ret = emit(callback, stop);
+                if (ret != Json::PARSE_OK || stop) {
+                    return ret;
+                }
+                continue;
+            }
+        } else if (c == '\"') {
+            m_in_str = true;
+        } else if (c == '{' || c == '[') {
+            ++m_depth;
+        } else if (c == '}' || c == ']') {
+            // 多余的右括号单独成为一个文档, 由解析器报错
+            if (m_depth > 0) {
+                --m_depth;
+            }
+            end = m_depth == 0;
+        } else if (m_depth == 0) {
+            m_in_scalar = true;
+        }
+
+        ++i;
+        if (end) {
+            m_doc.append(data + begin, i - begin);
+            Json::STATUS ret = emit(callback, stop);
+            if (ret != Json::PARSE_OK || stop) {
+                return ret;
+            }
+        }
+    }
+
+    if (m_active) {
+        m_doc.append(data + begin, size - begin);
+    }
+    return Json::PARSE_OK;
+}
+
+Json::STATUS JsonStreamReader::emit(const Callback& callback, bool& stop) {
+    JsonValue::ptr value = JsonValue::create(m_ctx.allocator);
+    Json::STATUS ret = m_json.parse(m_doc, value, m_ctx);
+    m_doc.clear();
+    m_active = m_in_str = m_escape = m_in_scalar = false;
+    m_depth = 0;
+    if (ret != Json::PARSE_OK) {
+        return ret;
+    }
+
+    ++m_documents;
+    if (!callback(value)) {
+        stop = true;
+    }
+    return Json::PARSE_OK;
+}
+
+}  // end of namespace tihi
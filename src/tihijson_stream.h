@@ -0,0 +1,141 @@
+#ifndef TIHIJSON_TIHIJSON_STREAM_H_
+#define TIHIJSON_TIHIJSON_STREAM_H_
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "tihijson.h"
+#include "tihijson_minify.h"
+
+namespace tihi {
+
+// 顺序读取的数据来源, read 可能在后台线程中调用
+class JsonChunkSource {
+public:
+    virtual ~JsonChunkSource() {}
+    // 读取最多 n 字节到 buf, 返回读到的字节数; 0 表示结束, 负数表示出错
+    virtual ssize_t read(char* buf, size_t n) = 0;
+};
+
+// 从文件描述符读取, 不负责关闭 fd
+class JsonFdSource : public JsonChunkSource {
+public:
+    explicit JsonFdSource(int fd) : m_fd(fd) {}
+    ssize_t read(char* buf, size_t n) override;
+
+private:
+    int m_fd;
+};
+
+/*
+ * 透明解压: 根据开头的魔数识别 gzip (1f 8b) 和 zstd (28 b5 2f fd),
+ * 每次从 source 读入至多 in_size 字节压缩数据并解压到调用方的缓冲区,
+ * 不会把整个文件解压到内存; 其他输入原样透传. 多个 gzip 成员或 zstd
+ * 帧首尾相接时依次解压.
+ *
+ * 编译时没有找到对应的库 (TIHIJSON_WITH_ZLIB/TIHIJSON_WITH_ZSTD) 时,
+ * 遇到该格式的输入 read 返回 -1.
+ */
+class JsonDecompressSource : public JsonChunkSource {
+public:
+    enum Codec { CODEC_NONE = 0, CODEC_GZIP = 1, CODEC_ZSTD = 2 };
+
+    explicit JsonDecompressSource(JsonChunkSource& source,
+                                  size_t in_size = 1 << 16);
+    ~JsonDecompressSource();
+
+    ssize_t read(char* buf, size_t n) override;
+
+    // 识别出的格式, 第一次 read 之后有效
+    Codec codec() const;
+    static bool supported(Codec codec);
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> m_impl;
+};
+
+/*
+ * 解析由多个 JSON 文档拼接而成的输入 (NDJSON 或直接首尾相接).
+ *
+ * 后台线程把输入按 chunk_size 读入由 buffers 个缓冲区组成的环, 调用
+ * parse() 的线程同时切分并解析已读入的块, 读盘与解析互相重叠. 文档
+ * 可以跨越块边界. 每解析出一个文档调用一次回调, 回调返回 false 时
+ * 停止读取.
+ *
+ * 读取使用普通的 read(2); 回调在调用 parse() 的线程中执行.
+ */
+class JsonStreamReader {
+public:
+    using Callback = std::function<bool(JsonValue::ptr)>;
+
+    explicit JsonStreamReader(size_t chunk_size = 1 << 20,
+                              size_t buffers = 4);
+
+    // 返回 PARSE_OK 表示读完全部输入或被回调停止; 出错时返回第一个
+    // 出错文档的解析状态, 或 PARSE_READ_ERROR
+    Json::STATUS parse(JsonChunkSource& source, const Callback& callback);
+    // 压缩文件经 JsonDecompressSource 边读边解压, 解压在读线程中进行
+    Json::STATUS parse_file(const std::string& path, const Callback& callback);
+    // 不构造 JsonValue, 每个文档的解析事件交给 handler; handler 中止
+    // 解析时返回 PARSE_REJECTED. 事件在读入每个块时就产生, 不缓存整个
+    // 文档, 占用的内存与文档大小无关. 使用 context() 中的 max_depth 和
+    // validate_utf8
+    Json::STATUS parse(JsonChunkSource& source, JsonHandler& handler);
+    Json::STATUS parse_file(const std::string& path, JsonHandler& handler);
+
+    // 解析每个文档使用的上下文, 可以设置 max_depth, allocator 等;
+    // borrow_strings 在 parse() 时被关闭
+    JsonContxt& context() { return m_ctx; }
+    // 上次 parse() 交给回调的文档数; 出错时即出错文档的下标
+    size_t documents() const { return m_documents; }
+
+private:
+    struct HandlerScope;
+    struct Chunk {
+        size_t index;  // 缓冲区下标
+        ssize_t size;  // 读到的字节数, 0 为结束, 负数为出错
+    };
+
+    void read_loop(JsonChunkSource& source);
+    // 切分一个块, 对其中完整的文档调用 emit
+    Json::STATUS split(const char* data, size_t size,
+                       const Callback& callback, bool& stop);
+    Json::STATUS emit(const Callback& callback, bool& stop);
+
+private:
+    size_t m_chunk_size;
+    std::vector<std::vector<char>> m_buffers;
+    Json m_json;
+    JsonContxt m_ctx;
+    JsonHandler* m_handler = nullptr;  // 非空时不切分文档, 直接产生事件
+    JsonMinifier m_events;             // 产生事件的增量解析器
+    size_t m_documents = 0;
+
+    // 读线程与解析线程之间的队列
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    std::deque<size_t> m_free;
+    std::deque<Chunk> m_filled;
+    bool m_stop = false;
+
+    // 切分状态, 跨块保留
+    std::string m_doc;       // 当前文档已读到的部分
+    bool m_active = false;   // 正处在一个文档内
+    bool m_in_str = false;
+    bool m_escape = false;
+    bool m_in_scalar = false;  // 顶层的数字/true/false/null
+    size_t m_depth = 0;
+};
+
+}  // end of namespace tihi
+
+#endif  // TIHIJSON_TIHIJSON_STREAM_H_
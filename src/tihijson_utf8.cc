@@ -0,0 +1,312 @@
+#include "tihijson_utf8.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define TIHIJSON_UTF8_X86 1
+#include <immintrin.h>
+#endif
+
+namespace tihi {
+namespace utf8 {
+
+void append(uint32_t u, std::string& out) {
+    char buf[4];
+    if (u <= 0x7f) {
+        out.push_back(static_cast<char>(u));
+        return;
+    } else if (u <= 0x7ff) {
+        buf[0] = static_cast<char>(0xc0 | ((u >> 6) & 0x1f));
+        buf[1] = static_cast<char>(0x80 | (u & 0x3f));
+        out.append(buf, 2);
+    } else if (u <= 0xffff) {
+        buf[0] = static_cast<char>(0xe0 | ((u >> 12) & 0x0f));
+        buf[1] = static_cast<char>(0x80 | ((u >> 6) & 0x3f));
+        buf[2] = static_cast<char>(0x80 | (u & 0x3f));
+        out.append(buf, 3);
+    } else {
+        buf[0] = static_cast<char>(0xf0 | ((u >> 18) & 0x07));
+        buf[1] = static_cast<char>(0x80 | ((u >> 12) & 0x3f));
+        buf[2] = static_cast<char>(0x80 | ((u >> 6) & 0x3f));
+        buf[3] = static_cast<char>(0x80 | (u & 0x3f));
+        out.append(buf, 4);
+    }
+}
+
+bool validate_scalar(const char* data, size_t len) {
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(data);
+    const uint8_t* end = p + len;
+
+    while (p < end) {
+        // 8 字节一组跳过纯 ASCII
+        if (end - p >= 8) {
+            uint64_t w;
+            memcpy(&w, p, sizeof(w));
+            if ((w & 0x8080808080808080ULL) == 0) {
+                p += 8;
+                continue;
+            }
+        }
+
+        uint8_t c = *p;
+        if (c < 0x80) {
+            ++p;
+            continue;
+        }
+
+        size_t n = 0;
+        if (c >= 0xc2 && c <= 0xdf) {
+            n = 2;
+        } else if ((c & 0xf0) == 0xe0) {
+            n = 3;
+        } else if (c >= 0xf0 && c <= 0xf4) {
+            n = 4;
+        } else {
+            return false;
+        }
+
+        if (static_cast<size_t>(end - p) < n) {
+            return false;
+        }
+        for (size_t i = 1; i < n; ++i) {
+            if ((p[i] & 0xc0) != 0x80) {
+                return false;
+            }
+        }
+
+        if ((c == 0xe0 && p[1] < 0xa0) ||   /* 过长编码 */
+            (c == 0xed && p[1] >= 0xa0) ||  /* U+D800..U+DFFF */
+            (c == 0xf0 && p[1] < 0x90) ||   /* 过长编码 */
+            (c == 0xf4 && p[1] >= 0x90)) {  /* 大于 U+10FFFF */
+            return false;
+        }
+        p += n;
+    }
+
+    return true;
+}
+
+#ifdef TIHIJSON_UTF8_X86
+
+/*
+ * SIMD 实现采用查表法 (John Keiser, Daniel Lemire, "Validating UTF-8 In
+ * Less Than One Instruction Per Byte"): 用前一个字节的高/低 4 位和当前
+ * 字节的高 4 位查三张表, 三个结果按位与后非零即为错误; 多字节序列的第
+ * 3/4 字节单独检查.
+ */
+enum {
+    TOO_SHORT = 1 << 0,  // 11______ 0_______ / 11______ 11______
+    TOO_LONG = 1 << 1,   // 0_______ 10______
+    OVERLONG_3 = 1 << 2, // 11100000 100_____
+    TOO_LARGE = 1 << 3,  // 11110100 1001____ / 11110100 101_____ / ...
+    SURROGATE = 1 << 4,  // 11101101 101_____
+    OVERLONG_2 = 1 << 5, // 1100000_ 10______
+    TOO_LARGE_1000 = 1 << 6,  // 11110101 1000____ / ...
+    OVERLONG_4 = 1 << 6,      // 11110000 1000____
+    TWO_CONTS = 1 << 7,       // 10______ 10______
+    CARRY = TOO_SHORT | TOO_LONG | TWO_CONTS,
+};
+
+#define BYTE_1_HIGH_TABLE                                                  \
+    TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,  \
+        TOO_LONG, TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,              \
+        TOO_SHORT | OVERLONG_2, TOO_SHORT,                                 \
+        TOO_SHORT | OVERLONG_3 | SURROGATE,                                \
+        TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4
+
+#define BYTE_1_LOW_TABLE                                                   \
+    CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4, CARRY | OVERLONG_2,      \
+        CARRY, CARRY, CARRY | TOO_LARGE,                                   \
+        CARRY | TOO_LARGE | TOO_LARGE_1000,                                \
+        CARRY | TOO_LARGE | TOO_LARGE_1000,                                \
+        CARRY | TOO_LARGE | TOO_LARGE_1000,                                \
+        CARRY | TOO_LARGE | TOO_LARGE_1000,                                \
+        CARRY | TOO_LARGE | TOO_LARGE_1000,                                \
+        CARRY | TOO_LARGE | TOO_LARGE_1000,                                \
+        CARRY | TOO_LARGE | TOO_LARGE_1000,                                \
+        CARRY | TOO_LARGE | TOO_LARGE_1000,                                \
+        CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE,                    \
+        CARRY | TOO_LARGE | TOO_LARGE_1000,                                \
+        CARRY | TOO_LARGE | TOO_LARGE_1000
+
+#define BYTE_2_HIGH_TABLE                                                  \
+    TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,      \
+        TOO_SHORT, TOO_SHORT,                                              \
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 |  \
+            OVERLONG_4,                                                    \
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,        \
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,         \
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,         \
+        TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT
+
+// 每个块最后 3 个字节若是多字节序列的首字节, 序列一定延续到下一块
+#define INCOMPLETE_TAIL 0xef, 0xdf, 0xbf
+
+__attribute__((target("ssse3"))) static bool ssse3_impl(const char* data,
+                                                        size_t len) {
+    const __m128i byte_1_high = _mm_setr_epi8(BYTE_1_HIGH_TABLE);
+    const __m128i byte_1_low = _mm_setr_epi8(BYTE_1_LOW_TABLE);
+    const __m128i byte_2_high = _mm_setr_epi8(BYTE_2_HIGH_TABLE);
+    const __m128i low_nibble = _mm_set1_epi8(0x0f);
+    const __m128i max_value =
+        _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                      INCOMPLETE_TAIL);
+
+    __m128i error = _mm_setzero_si128();
+    __m128i prev_input = _mm_setzero_si128();
+    __m128i prev_incomplete = _mm_setzero_si128();
+
+    size_t i = 0;
+    uint8_t tail[16];
+    while (i < len) {
+        __m128i input;
+        if (len - i >= 16) {
+            input = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        } else {
+            // 不足一块时用 0 (ASCII) 补齐
+            memset(tail, 0, sizeof(tail));
+            memcpy(tail, data + i, len - i);
+            input = _mm_loadu_si128(reinterpret_cast<const __m128i*>(tail));
+        }
+        i += 16;
+
+        if (_mm_movemask_epi8(input) == 0) {
+            error = _mm_or_si128(error, prev_incomplete);
+        } else {
+            __m128i prev1 = _mm_alignr_epi8(input, prev_input, 15);
+            __m128i sc = _mm_and_si128(
+                _mm_and_si128(
+                    _mm_shuffle_epi8(byte_1_high,
+                                     _mm_and_si128(_mm_srli_epi16(prev1, 4),
+                                                   low_nibble)),
+                    _mm_shuffle_epi8(byte_1_low,
+                                     _mm_and_si128(prev1, low_nibble))),
+                _mm_shuffle_epi8(
+                    byte_2_high,
+                    _mm_and_si128(_mm_srli_epi16(input, 4), low_nibble)));
+
+            __m128i prev2 = _mm_alignr_epi8(input, prev_input, 14);
+            __m128i prev3 = _mm_alignr_epi8(input, prev_input, 13);
+            __m128i must23 = _mm_or_si128(
+                _mm_subs_epu8(prev2, _mm_set1_epi8(0xe0 - 0x80)),
+                _mm_subs_epu8(prev3, _mm_set1_epi8(0xf0 - 0x80)));
+            __m128i must23_80 =
+                _mm_and_si128(must23, _mm_set1_epi8(static_cast<char>(0x80)));
+            error = _mm_or_si128(error, _mm_xor_si128(must23_80, sc));
+            prev_incomplete = _mm_subs_epu8(input, max_value);
+        }
+        prev_input = input;
+    }
+
+    error = _mm_or_si128(error, prev_incomplete);
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(error, _mm_setzero_si128())) ==
+           0xffff;
+}
+
+__attribute__((target("avx2"))) static bool avx2_impl(const char* data,
+                                                      size_t len) {
+    const __m256i byte_1_high =
+        _mm256_setr_epi8(BYTE_1_HIGH_TABLE, BYTE_1_HIGH_TABLE);
+    const __m256i byte_1_low =
+        _mm256_setr_epi8(BYTE_1_LOW_TABLE, BYTE_1_LOW_TABLE);
+    const __m256i byte_2_high =
+        _mm256_setr_epi8(BYTE_2_HIGH_TABLE, BYTE_2_HIGH_TABLE);
+    const __m256i low_nibble = _mm256_set1_epi8(0x0f);
+    const __m256i max_value = _mm256_setr_epi8(
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, INCOMPLETE_TAIL);
+
+    __m256i error = _mm256_setzero_si256();
+    __m256i prev_input = _mm256_setzero_si256();
+    __m256i prev_incomplete = _mm256_setzero_si256();
+
+    size_t i = 0;
+    uint8_t tail[32];
+    while (i < len) {
+        __m256i input;
+        if (len - i >= 32) {
+            input =
+                _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        } else {
+            memset(tail, 0, sizeof(tail));
+            memcpy(tail, data + i, len - i);
+            input = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(tail));
+        }
+        i += 32;
+
+        if (_mm256_movemask_epi8(input) == 0) {
+            error = _mm256_or_si256(error, prev_incomplete);
+        } else {
+            // 跨 128 位通道取前 1/2/3 个字节
+            __m256i shifted = _mm256_permute2x128_si256(prev_input, input, 0x21);
+            __m256i prev1 = _mm256_alignr_epi8(input, shifted, 15);
+            __m256i prev2 = _mm256_alignr_epi8(input, shifted, 14);
+            __m256i prev3 = _mm256_alignr_epi8(input, shifted, 13);
+
+            __m256i sc = _mm256_and_si256(
+                _mm256_and_si256(
+                    _mm256_shuffle_epi8(
+                        byte_1_high,
+                        _mm256_and_si256(_mm256_srli_epi16(prev1, 4),
+                                         low_nibble)),
+                    _mm256_shuffle_epi8(byte_1_low,
+                                        _mm256_and_si256(prev1, low_nibble))),
+                _mm256_shuffle_epi8(
+                    byte_2_high,
+                    _mm256_and_si256(_mm256_srli_epi16(input, 4),
+                                     low_nibble)));
+
+            __m256i must23 = _mm256_or_si256(
+                _mm256_subs_epu8(prev2, _mm256_set1_epi8(0xe0 - 0x80)),
+                _mm256_subs_epu8(prev3, _mm256_set1_epi8(0xf0 - 0x80)));
+            __m256i must23_80 = _mm256_and_si256(
+                must23, _mm256_set1_epi8(static_cast<char>(0x80)));
+            error = _mm256_or_si256(error, _mm256_xor_si256(must23_80, sc));
+            prev_incomplete = _mm256_subs_epu8(input, max_value);
+        }
+        prev_input = input;
+    }
+
+    error = _mm256_or_si256(error, prev_incomplete);
+    return _mm256_testz_si256(error, error) != 0;
+}
+
+bool has_ssse3() { return __builtin_cpu_supports("ssse3"); }
+bool has_avx2() { return __builtin_cpu_supports("avx2"); }
+
+bool validate_ssse3(const char* data, size_t len) {
+    return has_ssse3() ? ssse3_impl(data, len) : validate_scalar(data, len);
+}
+bool validate_avx2(const char* data, size_t len) {
+    return has_avx2() ? avx2_impl(data, len) : validate_scalar(data, len);
+}
+
+#else
+
+bool validate_ssse3(const char* data, size_t len) {
+    return validate_scalar(data, len);
+}
+bool validate_avx2(const char* data, size_t len) {
+    return validate_scalar(data, len);
+}
+
+bool has_ssse3() { return false; }
+bool has_avx2() { return false; }
+
+#endif
+
+bool validate(const char* data, size_t len) {
+    typedef bool (*ValidateFunc)(const char*, size_t);
+#ifdef TIHIJSON_UTF8_X86
+    static const ValidateFunc impl = has_avx2()    ? avx2_impl
+                                     : has_ssse3() ? ssse3_impl
+                                                   : validate_scalar;
+#else
+    static const ValidateFunc impl = validate_scalar;
+#endif
+    return impl(data, len);
+}
+
+}  // end of namespace utf8
+}  // end of namespace tihi
@@ -0,0 +1,31 @@
+#ifndef TIHIJSON_TIHIJSON_UTF8_H_
+#define TIHIJSON_TIHIJSON_UTF8_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+
+namespace tihi {
+namespace utf8 {
+
+// 检查 [data, data + len) 是否为合法的 UTF-8 (拒绝过长编码, 代理区
+// 和超过 U+10FFFF 的码点), 运行时按 CPU 选择 AVX2/SSSE3/标量实现
+bool validate(const char* data, size_t len);
+
+// 各个实现, 供测试对比使用; 运行时检查 CPU, 不支持 (或不是 x86) 时
+// 退化为标量实现
+bool validate_scalar(const char* data, size_t len);
+bool validate_ssse3(const char* data, size_t len);
+bool validate_avx2(const char* data, size_t len);
+
+bool has_ssse3();
+bool has_avx2();
+
+// 把码点 u 编码为 UTF-8 追加到 out
+void append(uint32_t u, std::string& out);
+
+}  // end of namespace utf8
+}  // end of namespace tihi
+
+#endif  // TIHIJSON_TIHIJSON_UTF8_H_
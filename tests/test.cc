@@ -1,11 +1,25 @@
 #include <stdint.h>
+#include <unistd.h>
 
+#include <algorithm>
+#include <cstdlib>
 #include <cstring>
 #include <iostream>
 #include <sstream>
+#include <stdexcept>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include "../src/tihijson.h"
+#include "../src/tihijson_cache.h"
+#include "../src/tihijson_columns.h"
+#include "../src/tihijson_frozen.h"
+#include "../src/tihijson_minify.h"
+#include "../src/tihijson_query.h"
+#include "../src/tihijson_schema.h"
+#include "../src/tihijson_stream.h"
+#include "../src/tihijson_utf8.h"
 
 static int main_ret = 0;
 static uint32_t test_count = 0;
@@ -75,6 +89,16 @@ static void test_parse_value() {
 
     TEST_ERROR(tihi::Json::PARSE_INVALID_VALUE, "?");
     TEST_ERROR(tihi::Json::PARSE_INVALID_VALUE, "nul");
+
+    /* 数字之后可以跟任意空白 */
+    TEST_PARSE_VALUE(tihi::Json::PARSE_OK, tihi::JsonValue::JSON_ARRAY,
+                     "[1\n]");
+    TEST_PARSE_VALUE(tihi::Json::PARSE_OK, tihi::JsonValue::JSON_OBJECT,
+                     "{\"a\":1\t}");
+    TEST_PARSE_VALUE(tihi::Json::PARSE_OK, tihi::JsonValue::JSON_NUMBER,
+                     "1\r\n");
+    EXPECT_EQ_INT(true, (json_value->get_number() == 1.0));
+    TEST_ERROR(tihi::Json::PARSE_ROOT_NOT_SINGULAR, "1\r\nx");
 }
 
 
@@ -375,8 +399,7 @@ static void test_parse_miss_comma_or_square_bracket() {
     tihi::Json::ptr json = tihi::Json::ptr(new tihi::Json);
 
     TEST_ERROR(tihi::Json::PARSE_MISS_COMMA_OR_SQUARE_BRACKET, "[1");
-    //  TODO
-    // TEST_ERROR(tihi::Json::PARSE_MISS_COMMA_OR_SQUARE_BRACKET, "[1}");
+    TEST_ERROR(tihi::Json::PARSE_MISS_COMMA_OR_SQUARE_BRACKET, "[1}");
     TEST_ERROR(tihi::Json::PARSE_MISS_COMMA_OR_SQUARE_BRACKET, "[1 2");
     TEST_ERROR(tihi::Json::PARSE_MISS_COMMA_OR_SQUARE_BRACKET, "[[]");
 }
@@ -392,8 +415,7 @@ static void test_parse_miss_key() {
     TEST_ERROR(tihi::Json::PARSE_MISS_KEY, "{null:1,");
     TEST_ERROR(tihi::Json::PARSE_MISS_KEY, "{[]:1,");
     TEST_ERROR(tihi::Json::PARSE_MISS_KEY, "{{}:1,");
-    //  TODO
-    // TEST_ERROR(tihi::Json::PARSE_MISS_KEY, "{\"a\":1,");
+    TEST_ERROR(tihi::Json::PARSE_MISS_KEY, "{\"a\":1,");
 }
 
 static void test_parse_miss_colon() {
@@ -409,13 +431,2014 @@ static void test_parse_miss_comma_or_curly_bracket() {
     tihi::Json::ptr json = tihi::Json::ptr(new tihi::Json);
 
     TEST_ERROR(tihi::Json::PARSE_MISS_COMMA_OR_CURLY_BRACKET, "{\"a\":1");
-    //  TODO
-    // TEST_ERROR(tihi::Json::PARSE_MISS_COMMA_OR_CURLY_BRACKET, "{\"a\":1]");
-    // TEST_ERROR(tihi::Json::PARSE_MISS_COMMA_OR_CURLY_BRACKET, "{\"a\":1
-    // \"b\"");
+    TEST_ERROR(tihi::Json::PARSE_MISS_COMMA_OR_CURLY_BRACKET, "{\"a\":1]");
+    TEST_ERROR(tihi::Json::PARSE_MISS_COMMA_OR_CURLY_BRACKET,
+               "{\"a\":1 \"b\"");
     TEST_ERROR(tihi::Json::PARSE_MISS_COMMA_OR_CURLY_BRACKET, "{\"a\":{}");
 }
 
+static void test_parse_deep_nesting() {
+    tihi::JsonValue::ptr json_value = tihi::JsonValue::ptr(new tihi::JsonValue);
+    tihi::JsonContxt::ptr context = tihi::JsonContxt::ptr(new tihi::JsonContxt);
+    tihi::Json::ptr json = tihi::Json::ptr(new tihi::Json(context));
+
+    const size_t depth = 100000;
+    std::string deep = std::string(depth, '[') + std::string(depth, ']');
+    TEST_ERROR(tihi::Json::PARSE_DEPTH_EXCEEDED, deep);
+
+    context->max_depth = depth;
+    EXPECT_EQ_INT(tihi::Json::PARSE_OK, json->parse(deep, json_value));
+    tihi::JsonValue::ptr v = json_value;
+    size_t levels = 0;
+    while (v->get_vec_size() == 1) {
+        v = v->get_vec()[0];
+        ++levels;
+    }
+    EXPECT_EQ_SIZE_T(depth - 1, levels);
+
+    /* 哈希和比较同样不递归 */
+    tihi::JsonValue::ptr same = tihi::JsonValue::create();
+    tihi::JsonValue::ptr other = tihi::JsonValue::create();
+    EXPECT_EQ_INT(tihi::Json::PARSE_OK, json->parse(deep, same));
+    EXPECT_EQ_INT(tihi::Json::PARSE_OK,
+                  json->parse(std::string(depth - 1, '[') + "[1]" +
+                                  std::string(depth - 1, ']'),
+                              other));
+    EXPECT_EQ_SIZE_T(json_value->hash(), same->hash());
+    EXPECT_EQ_INT(true, json_value->equals(*same));
+    EXPECT_EQ_INT(false, json_value->equals(*other));
+    same.reset();
+    other.reset();
+
+    /* 冻结和复制回 JsonValue 同样不递归 */
+    tihi::JsonFrozen::ptr frozen = tihi::JsonFrozen::freeze(*json_value);
+    EXPECT_EQ_SIZE_T(depth, frozen->node_count());
+    tihi::JsonValue::ptr thawed = frozen->root().thaw();
+    EXPECT_EQ_INT(true, thawed->equals(*json_value));
+    thawed.reset();
+    json_value.reset();
+
+    json_value = tihi::JsonValue::ptr(new tihi::JsonValue);
+    TEST_ERROR(tihi::Json::PARSE_MISS_COMMA_OR_SQUARE_BRACKET,
+               std::string(depth, '['));
+}
+
+static void test_parse_concurrent() {
+    const tihi::Json json;
+    const std::string doc = "{\"a\":[1,2,{\"b\":\"x\\ny\"}],\"c\":true}";
+    const size_t threads = 4;
+    std::vector<int> ok(threads, 0);
+
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t]() {
+            tihi::JsonContxt context;
+            int n = 0;
+            for (int i = 0; i < 200; ++i) {
+                tihi::JsonValue::ptr v(new tihi::JsonValue);
+                if (json.parse(doc, v, context) == tihi::Json::PARSE_OK &&
+                    v->get_obj_size() == 2 &&
+                    v->get_value_from_obj_by_string("a")
+                            ->get_vec()[2]
+                            ->get_value_from_obj_by_string("b")
+                            ->get_str() == "x\ny") {
+                    ++n;
+                }
+            }
+            ok[t] = n;
+        });
+    }
+    for (auto& w : workers) {
+        w.join();
+    }
+    for (size_t t = 0; t < threads; ++t) {
+        EXPECT_EQ_INT(200, ok[t]);
+    }
+}
+
+struct CountingHeap {
+    size_t live = 0;
+};
+
+static void* counting_allocate(void* user, size_t n) {
+    static_cast<CountingHeap*>(user)->live += n;
+    return malloc(n);
+}
+
+static void counting_deallocate(void* user, void* p, size_t n) {
+    static_cast<CountingHeap*>(user)->live -= n;
+    free(p);
+}
+
+static void test_parse_allocator() {
+    tihi::JsonMallocAllocator alloc;
+    tihi::JsonContxt context;
+    context.allocator = &alloc;
+    const tihi::Json json;
+
+    tihi::JsonValue::ptr json_value = tihi::JsonValue::create(&alloc);
+    EXPECT_EQ_INT(1u, alloc.stats().allocations);
+    alloc.reset_stats();
+    EXPECT_EQ_INT(tihi::Json::PARSE_OK,
+                  json.parse("[1, [2], {\"a\": 3}]", json_value, context));
+    /* 1, [2], 2, {"a":3}, 3 */
+    EXPECT_EQ_INT(5u, alloc.stats().allocations);
+    EXPECT_EQ_INT(true, (alloc.stats().peak_live_bytes >=
+                         alloc.stats().live_bytes));
+    json_value.reset();
+    EXPECT_EQ_INT(0u, alloc.stats().live_bytes);
+    EXPECT_EQ_INT(6u, alloc.stats().deallocations);
+
+    CountingHeap heap;
+    tihi::JsonAllocVTable vtable = {counting_allocate, counting_deallocate,
+                                    &heap};
+    tihi::JsonVTableAllocator vtable_alloc(vtable);
+    context.allocator = &vtable_alloc;
+    json_value = tihi::JsonValue::ptr(new tihi::JsonValue);
+    EXPECT_EQ_INT(tihi::Json::PARSE_OK,
+                  json.parse("{\"a\": [true, null]}", json_value, context));
+    EXPECT_EQ_INT(3u, vtable_alloc.stats().allocations);
+    EXPECT_EQ_INT(true, (heap.live > 0));
+    json_value.reset();
+    EXPECT_EQ_INT(0u, heap.live);
+
+    tihi::JsonStdAllocator<std::allocator<int> > std_alloc;
+    context.allocator = &std_alloc;
+    json_value = tihi::JsonValue::ptr(new tihi::JsonValue);
+    EXPECT_EQ_INT(tihi::Json::PARSE_OK,
+                  json.parse("[\"x\"]", json_value, context));
+    EXPECT_EQ_INT(1u, std_alloc.stats().allocations);
+    json_value.reset();
+    EXPECT_EQ_INT(0u, std_alloc.stats().live_bytes);
+}
+
+static void test_profile_stats() {
+#ifdef TIHIJSON_PROFILE
+    tihi::JsonValue::ptr json_value = tihi::JsonValue::ptr(new tihi::JsonValue);
+    tihi::Json::ptr json = tihi::Json::ptr(new tihi::Json);
+
+    json->reset_stats();
+    EXPECT_EQ_INT(tihi::Json::PARSE_OK,
+                  json->parse("[ \"ab\", 1.5, {\"k\": \"v\"} ]", json_value));
+    const tihi::JsonStats& stats = json->stats();
+    EXPECT_EQ_INT(3u, stats.string.calls);
+    EXPECT_EQ_INT(10u, stats.string.bytes);
+    EXPECT_EQ_INT(1u, stats.number.calls);
+    EXPECT_EQ_INT(3u, stats.number.bytes);
+    EXPECT_EQ_INT(4u, stats.alloc.calls);
+    EXPECT_EQ_INT(4u, stats.insert.calls);
+    EXPECT_EQ_INT(true, (stats.whitespace.calls > 0));
+
+    std::string out;
+    json->stringify(out, json_value);
+    EXPECT_EQ_INT(1u, stats.stringify.calls);
+    EXPECT_EQ_INT(out.size(), stats.stringify.bytes);
+
+    json->reset_stats();
+    EXPECT_EQ_INT(0u, json->stats().string.calls);
+#endif
+}
+
+#define TEST_UTF8(expect, str)                                     \
+    do {                                                           \
+        std::string s(str, sizeof(str) - 1);                       \
+        EXPECT_EQ_INT(expect,                                      \
+                      tihi::utf8::validate_scalar(s.data(), s.size())); \
+        EXPECT_EQ_INT(expect,                                      \
+                      tihi::utf8::validate_ssse3(s.data(), s.size()));  \
+        EXPECT_EQ_INT(expect,                                      \
+                      tihi::utf8::validate_avx2(s.data(), s.size()));   \
+    } while (0)
+
+static void test_utf8_validate() {
+    TEST_UTF8(true, "");
+    TEST_UTF8(true, "hello");
+    TEST_UTF8(true, "\xC2\xA2 \xE2\x82\xAC \xF0\x9D\x84\x9E \xF4\x8F\xBF\xBF");
+    TEST_UTF8(true, "\xED\x9F\xBF \xEE\x80\x80");
+    TEST_UTF8(false, "\x80");                 /* 单独的后续字节 */
+    TEST_UTF8(false, "\xC3\x28");             /* 后续字节不合法 */
+    TEST_UTF8(false, "\xC0\xAF");             /* 过长编码 */
+    TEST_UTF8(false, "\xE0\x80\xAF");
+    TEST_UTF8(false, "\xF0\x80\x80\xAF");
+    TEST_UTF8(false, "\xED\xA0\x80");         /* 代理区 */
+    TEST_UTF8(false, "\xF4\x90\x80\x80");     /* 大于 U+10FFFF */
+    TEST_UTF8(false, "\xF5\x80\x80\x80");
+    TEST_UTF8(false, "\xFF");
+    TEST_UTF8(false, "abc\xE2\x82");           /* 结尾截断 */
+    TEST_UTF8(false, "0123456789abcde\xE2\x82\xAC\x80");
+
+    /* 随机拼接合法/非法片段, 对比各实现 (跨越 16/32 字节块边界) */
+    static const char* pieces[] = {"a",        "0123456",    "\xC2\xA2",
+                                   "\xE2\x82\xAC", "\xF0\x9D\x84\x9E", "\x80",
+                                   "\xE2\x82",    "\xED\xA0\x80", "\xC0\xAF",
+                                   "\xF4\x90\x80\x80"};
+    const size_t n_pieces = sizeof(pieces) / sizeof(pieces[0]);
+    uint32_t seed = 12345;
+    size_t mismatches = 0;
+    for (int round = 0; round < 2000; ++round) {
+        std::string s;
+        int n = round % 40;
+        for (int i = 0; i < n; ++i) {
+            seed = seed * 1103515245 + 12345;
+            /* 大部分选前 5 个合法片段 */
+            size_t k = (seed >> 16) % (n_pieces * 4);
+            s += pieces[k < n_pieces ? k : (k % 5)];
+        }
+        bool expect = tihi::utf8::validate_scalar(s.data(), s.size());
+        if (tihi::utf8::validate_ssse3(s.data(), s.size()) != expect ||
+            tihi::utf8::validate_avx2(s.data(), s.size()) != expect ||
+            tihi::utf8::validate(s.data(), s.size()) != expect) {
+            ++mismatches;
+        }
+    }
+    EXPECT_EQ_SIZE_T(0, mismatches);
+
+    tihi::JsonValue::ptr json_value = tihi::JsonValue::ptr(new tihi::JsonValue);
+    tihi::JsonContxt::ptr context = tihi::JsonContxt::ptr(new tihi::JsonContxt);
+    tihi::Json::ptr json = tihi::Json::ptr(new tihi::Json(context));
+    TEST_PARSE_STR("\xC3\xA9t\xC3\xA9", "\"\xC3\xA9t\xC3\xA9\"");
+    TEST_PARSE_STR("\xC3\x28", "\"\xC3\x28\"");
+    context->validate_utf8 = true;
+    TEST_PARSE_STR("\xC3\xA9t\xC3\xA9", "\"\xC3\xA9t\xC3\xA9\"");
+    TEST_ERROR(tihi::Json::PARSE_INVALID_UTF8, "\"\xC3\x28\"");
+    TEST_ERROR(tihi::Json::PARSE_INVALID_UTF8, "[\"a\", \"\xED\xA0\x80\"]");
+}
+
+static void test_document_cow() {
+    tihi::JsonValue::ptr json_value = tihi::JsonValue::ptr(new tihi::JsonValue);
+    tihi::Json::ptr json = tihi::Json::ptr(new tihi::Json);
+    EXPECT_EQ_INT(tihi::Json::PARSE_OK,
+                  json->parse("{\"db\": {\"port\": 5432, \"hosts\": [\"a\", "
+                              "\"b\"]}, \"log\": {\"level\": \"info\"}, "
+                              "\"a/b\": 1}",
+                              json_value));
+
+    tihi::JsonDocument base(json_value);
+    json_value.reset();
+    tihi::JsonDocument tenant = base.clone();
+    EXPECT_EQ_INT(true, (base.root() == tenant.root()));
+
+    tenant.mutate("/db/port")->set_number(6543);
+    EXPECT_EQ_DOUBLE(5432.0, base.find("/db/port")->get_number());
+    EXPECT_EQ_DOUBLE(6543.0, tenant.find("/db/port")->get_number());
+    /* 路径上的节点被复制, 其余子树仍然共享 */
+    EXPECT_EQ_INT(false, (base.root() == tenant.root()));
+    EXPECT_EQ_INT(false, (base.find("/db") == tenant.find("/db")));
+    EXPECT_EQ_INT(true, (base.find("/log") == tenant.find("/log")));
+    EXPECT_EQ_INT(true,
+                  (base.find("/db/hosts") == tenant.find("/db/hosts")));
+
+    /* 独占的节点再次修改时不再复制 */
+    tihi::JsonValue* db = tenant.find("/db").get();
+    tenant.mutate("/db/port")->set_number(7000);
+    EXPECT_EQ_INT(true, (db == tenant.find("/db").get()));
+
+    tihi::JsonValue::ptr v = tihi::JsonValue::ptr(new tihi::JsonValue);
+    v->set_str("c");
+    EXPECT_EQ_INT(true, tenant.set("/db/hosts/-", v));
+    EXPECT_EQ_INT(true, tenant.set("/log/file", v));
+    EXPECT_EQ_INT(true, tenant.set("/db/hosts/0", v));
+    EXPECT_EQ_INT(false, tenant.set("/db/hosts/9", v));
+    EXPECT_EQ_INT(false, tenant.set("/nope/x", v));
+    EXPECT_EQ_SIZE_T(2, base.find("/db/hosts")->get_vec_size());
+    EXPECT_EQ_SIZE_T(3, tenant.find("/db/hosts")->get_vec_size());
+    EXPECT_EQ_STR("a", base.find("/db/hosts/0")->get_str(), 1);
+    EXPECT_EQ_STR("c", tenant.find("/db/hosts/0")->get_str(), 1);
+    EXPECT_EQ_SIZE_T(1, base.find("/log")->get_obj_size());
+    EXPECT_EQ_SIZE_T(2, tenant.find("/log")->get_obj_size());
+
+    EXPECT_EQ_DOUBLE(1.0, base.find("/a~1b")->get_number());
+    EXPECT_EQ_INT(true, (base.find("/db/hosts/01") == nullptr));
+    EXPECT_EQ_INT(true, (base.find("db") == nullptr));
+    EXPECT_EQ_INT(true, (tenant.mutate("/missing") == nullptr));
+
+    /* 多个线程各自修改共享同一棵树的文档, 不写共享的节点 */
+    std::vector<std::thread> threads;
+    std::vector<int> ports(4, 0);
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&base, &ports, t]() {
+            tihi::JsonDocument mine = base.clone();
+            for (int i = 0; i <= t; ++i) {
+                mine.mutate("/db/port")->set_number(8000 + t);
+                mine.mutate("/log/level")->set_str("debug");
+            }
+            ports[t] = int(mine.find("/db/port")->get_number());
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    for (int t = 0; t < 4; ++t) {
+        EXPECT_EQ_INT(8000 + t, ports[t]);
+    }
+    EXPECT_EQ_DOUBLE(5432.0, base.find("/db/port")->get_number());
+    EXPECT_EQ_STR("info", base.find("/log/level")->get_str(), 4);
+}
+
+static void test_builder() {
+    tihi::JsonBuilder b;
+    std::string tag = "moved";
+    b.start_object(2)
+        .key("id")
+        .number(7)
+        .key("tags")
+        .start_array(4)
+        .string("a")
+        .string(std::move(tag))
+        .boolean(true)
+        .null()
+        .end_array()
+        .end_object();
+    tihi::JsonValue::ptr v = b.take();
+    EXPECT_EQ_INT(tihi::JsonValue::JSON_OBJECT, v->get_type());
+    EXPECT_EQ_SIZE_T(2, v->get_obj_size());
+    EXPECT_EQ_DOUBLE(7.0, v->get_value_from_obj_by_string("id")->get_number());
+    const tihi::JsonValue::ptr tags = v->get_value_from_obj_by_string("tags");
+    EXPECT_EQ_SIZE_T(4, tags->get_vec_size());
+    EXPECT_EQ_STR("moved", tags->get_vec()[1]->get_str(), 5);
+    EXPECT_EQ_INT(tihi::JsonValue::JSON_TRUE, tags->get_vec()[2]->get_type());
+    EXPECT_EQ_INT(tihi::JsonValue::JSON_NULL, tags->get_vec()[3]->get_type());
+
+    /* take() 之后构建器可以继续使用 */
+    b.start_array().number(1).start_array().end_array().end_array();
+    std::string out;
+    tihi::Json json;
+    EXPECT_EQ_INT(tihi::Json::STRINGIFY_OK, json.stringify(out, b.take()));
+    EXPECT_EQ_STR("[1,[]]", out, 6);
+
+    /* 原地创建子节点 */
+    tihi::JsonValue::ptr arr = tihi::JsonValue::create();
+    arr->reserve_vec(2);
+    arr->emplace_back().set_number(1);
+    arr->emplace_back().set_str(std::string("x"));
+    EXPECT_EQ_INT(tihi::JsonValue::JSON_ARRAY, arr->get_type());
+    EXPECT_EQ_SIZE_T(2, arr->get_vec_size());
+    EXPECT_EQ_STR("x", arr->get_vec()[1]->get_str(), 1);
+
+    tihi::JsonValue::ptr obj = tihi::JsonValue::create();
+    obj->emplace("k").set_number(1);
+    obj->emplace("k").set_number(2);
+    std::string key = "m";
+    obj->insert_obj(std::move(key), arr);
+    EXPECT_EQ_SIZE_T(2, obj->get_obj_size());
+    EXPECT_EQ_DOUBLE(2.0, obj->get_value_from_obj_by_string("k")->get_number());
+    EXPECT_EQ_INT(true, (obj->get_value_from_obj_by_string("m") == arr));
+}
+
+static void test_stringify_cache() {
+    tihi::JsonContxt ctx;
+    ctx.cache_subtrees = true;
+    ctx.cache_min_bytes = 0;
+    tihi::JsonContxt plain;
+    const tihi::Json json;
+    tihi::JsonValue::ptr v = tihi::JsonValue::create();
+    EXPECT_EQ_INT(tihi::Json::PARSE_OK,
+                  json.parse("[[1,2,[3]],[\"a\",{\"k\":[4]}],5]", v, ctx));
+
+    std::string cached, expect;
+    EXPECT_EQ_INT(tihi::Json::STRINGIFY_OK, json.stringify(cached, v, ctx));
+    EXPECT_EQ_STR("[[1,2,[3]],[\"a\",{\"k\":[4]}],5]", cached, cached.size());
+    EXPECT_EQ_INT(tihi::Json::STRINGIFY_OK, json.stringify(cached, v, ctx));
+    EXPECT_EQ_STR("[[1,2,[3]],[\"a\",{\"k\":[4]}],5]", cached, cached.size());
+
+    /* 修改叶子节点后只有其所在路径失效 */
+    v->get_vec()[0]->get_vec()[2]->get_vec()[0]->set_number(6);
+    json.stringify(cached, v, ctx);
+    EXPECT_EQ_STR("[[1,2,[6]],[\"a\",{\"k\":[4]}],5]", cached, cached.size());
+
+    tihi::JsonValue::ptr k =
+        v->get_vec()[1]->get_vec()[1]->get_value_from_obj_by_string("k");
+    k->push_back_vec(v->get_vec()[2]);
+    v->get_vec()[1]->get_vec()[1]->insert_obj("k", k);
+    v->get_vec()[1]->get_vec()[0]->set_str("b");
+    json.stringify(cached, v, ctx);
+    json.stringify(expect, v, plain);
+    EXPECT_EQ_INT(true, (expect == cached));
+
+    /* 被替换的子节点不再影响原来的父节点 */
+    tihi::JsonValue::ptr old = v->get_vec()[0];
+    tihi::JsonValue::ptr n = tihi::JsonValue::create();
+    n->set_type(tihi::JsonValue::JSON_NULL);
+    tihi::JsonValue::ptr arr = v->get_vec()[1];
+    arr->set_vec({n});
+    json.stringify(cached, v, ctx);
+    EXPECT_EQ_STR("[[1,2,[6]],[null],5]", cached, cached.size());
+
+    /* 通过 JsonDocument 修改共享的树, 两个文档的缓存互不影响 */
+    tihi::JsonDocument base(v);
+    v.reset();
+    tihi::JsonDocument copy = base.clone();
+    copy.mutate("/0/2/0")->set_number(7);
+    std::string a, b;
+    json.stringify(a, base.root(), ctx);
+    json.stringify(b, copy.root(), ctx);
+    EXPECT_EQ_STR("[[1,2,[6]],[null],5]", a, a.size());
+    EXPECT_EQ_STR("[[1,2,[7]],[null],5]", b, b.size());
+    EXPECT_EQ_INT(true, copy.set("/1/0", old));
+    json.stringify(b, copy.root(), ctx);
+    EXPECT_EQ_STR("[[1,2,[7]],[[1,2,[6]]],5]", b, b.size());
+    json.stringify(a, base.root(), ctx);
+    EXPECT_EQ_STR("[[1,2,[6]],[null],5]", a, a.size());
+}
+
+static void test_hash_equals() {
+    const tihi::Json json;
+    tihi::JsonContxt ctx;
+    tihi::JsonValue::ptr a = tihi::JsonValue::create();
+    tihi::JsonValue::ptr b = tihi::JsonValue::create();
+    EXPECT_EQ_INT(tihi::Json::PARSE_OK,
+                  json.parse("{\"x\":[1,\"s\",null],\"y\":{\"z\":0}}", a, ctx));
+    EXPECT_EQ_INT(tihi::Json::PARSE_OK,
+                  json.parse("{\"y\":{\"z\":-0},\"x\":[1,\"s\",null]}", b, ctx));
+    EXPECT_EQ_INT(true, (a->hash() == b->hash()));
+    EXPECT_EQ_INT(true, a->equals(*b));
+
+    /* 修改后哈希重新计算 */
+    a->get_value_from_obj_by_string("x")->get_vec()[0]->set_number(2);
+    EXPECT_EQ_INT(false, (a->hash() == b->hash()));
+    EXPECT_EQ_INT(false, a->equals(*b));
+    a->get_value_from_obj_by_string("x")->get_vec()[0]->set_number(1);
+    EXPECT_EQ_INT(true, a->equals(*b));
+
+    tihi::JsonValue::ptr c = tihi::JsonValue::create();
+    EXPECT_EQ_INT(tihi::Json::PARSE_OK, json.parse("[1,[2]]", c, ctx));
+    tihi::JsonValue::ptr d = tihi::JsonValue::create();
+    EXPECT_EQ_INT(tihi::Json::PARSE_OK, json.parse("[[2],1]", d, ctx));
+    EXPECT_EQ_INT(false, c->equals(*d));
+
+    /* 去重解析: 相等的子树只保存一份 */
+    ctx.dedup = true;
+    tihi::JsonValue::ptr v = tihi::JsonValue::create();
+    EXPECT_EQ_INT(tihi::Json::PARSE_OK,
+                  json.parse("[{\"a\":[1,2]},{\"a\":[1,2]},\"x\",\"x\",{\"a\":[1]}]",
+                             v, ctx));
+    const std::vector<tihi::JsonValue::ptr>& vec = v->get_vec();
+    EXPECT_EQ_INT(true, (vec[0] == vec[1]));
+    EXPECT_EQ_INT(true, (vec[2] == vec[3]));
+    EXPECT_EQ_INT(false, (vec[0] == vec[4]));
+    EXPECT_EQ_INT(true, (ctx.dedup_table.empty()));
+    std::string out;
+    EXPECT_EQ_INT(tihi::Json::STRINGIFY_OK, json.stringify(out, v, ctx));
+    EXPECT_EQ_STR("[{\"a\":[1,2]},{\"a\":[1,2]},\"x\",\"x\",{\"a\":[1]}]", out,
+                  out.size());
+
+    /* 经 JsonDocument 修改时共享的子树被复制 */
+    tihi::JsonDocument doc(v);
+    v.reset();
+    doc.mutate("/1/a/0")->set_number(3);
+    json.stringify(out, doc.root(), ctx);
+    EXPECT_EQ_STR("[{\"a\":[1,2]},{\"a\":[3,2]},\"x\",\"x\",{\"a\":[1]}]", out,
+                  out.size());
+}
+
+static void test_stringify_parallel() {
+    const tihi::Json json;
+    tihi::JsonContxt ctx;
+    std::string text = "{\"list\":[";
+    for (int i = 0; i < 3000; ++i) {
+        if (i > 0) {
+            text += ",";
+        }
+        text += "{\"id\":" + std::to_string(i) + ",\"s\":\"\\u00e9\\n\",\"v\":[" +
+                std::to_string(i % 7) + ",null]}";
+    }
+    text += "],\"map\":{";
+    for (int i = 0; i < 500; ++i) {
+        if (i > 0) {
+            text += ",";
+        }
+        text += "\"k" + std::to_string(i) + "\":" + std::to_string(i);
+    }
+    text += "}}";
+    tihi::JsonValue::ptr v = tihi::JsonValue::create();
+    EXPECT_EQ_INT(tihi::Json::PARSE_OK, json.parse(text, v, ctx));
+
+    std::string expect, out;
+    EXPECT_EQ_INT(tihi::Json::STRINGIFY_OK, json.stringify(expect, v, ctx));
+    ctx.stringify_threads = 4;
+    ctx.parallel_min_children = 16;
+    EXPECT_EQ_INT(tihi::Json::STRINGIFY_OK, json.stringify(out, v, ctx));
+    EXPECT_EQ_SIZE_T(expect.size(), out.size());
+    EXPECT_EQ_INT(true, (expect == out));
+
+    /* 子节点少于块数时同样正确 */
+    ctx.parallel_min_children = 0;
+    EXPECT_EQ_INT(tihi::Json::PARSE_OK, json.parse("[[],{},[1],{\"a\":2}]", v, ctx));
+    EXPECT_EQ_INT(tihi::Json::STRINGIFY_OK, json.stringify(out, v, ctx));
+    EXPECT_EQ_STR("[[],{},[1],{\"a\":2}]", out, out.size());
+}
+
+// 每次最多返回 step 字节, 模拟文档跨越多个块
+class StringSource : public tihi::JsonChunkSource {
+public:
+    StringSource(const std::string& s, size_t step) : m_s(s), m_step(step) {}
+    ssize_t read(char* buf, size_t n) override {
+        n = std::min(n, std::min(m_step, m_s.size() - m_pos));
+        memcpy(buf, m_s.data() + m_pos, n);
+        m_pos += n;
+        return n;
+    }
+
+private:
+    std::string m_s;
+    size_t m_step;
+    size_t m_pos = 0;
+};
+
+static void test_stream_reader() {
+    const std::string input =
+        "{\"a\":[1,{\"b\":\"}]\\\"{\"}]}\n[2]\n\"s\\\"x\" 3.5 true[]{}null\n  \n"
+        "-1{\"c\":null}";
+    const char* expect[] = {"{\"a\":[1,{\"b\":\"}]\\\"{\"}]}",
+                            "[2]",
+                            "\"s\\\"x\"",
+                            "3.5",
+                            "true",
+                            "[]",
+                            "{}",
+                            "null",
+                            "-1",
+                            "{\"c\":null}"};
+    const size_t count = sizeof(expect) / sizeof(expect[0]);
+
+    tihi::Json json;
+    for (size_t step : {1, 3, 7, 64}) {
+        tihi::JsonStreamReader reader(5, 3);
+        StringSource source(input, step);
+        std::vector<std::string> docs;
+        EXPECT_EQ_INT(tihi::Json::PARSE_OK,
+                      reader.parse(source, [&](tihi::JsonValue::ptr v) {
+                          std::string out;
+                          json.stringify(out, v);
+                          docs.push_back(out);
+                          return true;
+                      }));
+        EXPECT_EQ_SIZE_T(count, reader.documents());
+        EXPECT_EQ_SIZE_T(count, docs.size());
+        for (size_t i = 0; i < count && i < docs.size(); ++i) {
+            EXPECT_EQ_INT(true, (docs[i] == expect[i]));
+        }
+    }
+
+    /* 回调返回 false 时停止 */
+    {
+        tihi::JsonStreamReader reader(4);
+        StringSource source(input, 4);
+        size_t n = 0;
+        EXPECT_EQ_INT(tihi::Json::PARSE_OK,
+                      reader.parse(source, [&](tihi::JsonValue::ptr) {
+                          return ++n < 2;
+                      }));
+        EXPECT_EQ_SIZE_T(2, n);
+    }
+
+    /* 回调抛出的异常传给调用方, 读线程已退出, reader 可以继续使用 */
+    {
+        tihi::JsonStreamReader reader(4, 2);
+        StringSource source(input, 3);
+        bool thrown = false;
+        try {
+            reader.parse(source, [](tihi::JsonValue::ptr) -> bool {
+                throw std::runtime_error("stop");
+            });
+        } catch (const std::runtime_error&) {
+            thrown = true;
+        }
+        EXPECT_EQ_INT(true, thrown);
+
+        StringSource last(input, 3);
+        size_t n = 0;
+        EXPECT_EQ_INT(tihi::Json::PARSE_OK,
+                      reader.parse(last, [&](tihi::JsonValue::ptr) {
+                          return ++n > 0;
+                      }));
+        EXPECT_EQ_SIZE_T(count, n);
+    }
+
+    /* 出错时返回出错文档的状态, documents() 为其下标 */
+    {
+        tihi::JsonStreamReader reader(8);
+        StringSource source("[1]\n[2,\n{\"a\":1}", 8);
+        EXPECT_EQ_INT(tihi::Json::PARSE_MISS_COMMA_OR_SQUARE_BRACKET,
+                      reader.parse(source, [](tihi::JsonValue::ptr) {
+                          return true;
+                      }));
+        EXPECT_EQ_SIZE_T(1, reader.documents());
+    }
+
+    /* 从文件读取 */
+    char path[] = "/tmp/tihijson_stream_XXXXXX";
+    int fd = mkstemp(path);
+    EXPECT_EQ_INT(true, (fd >= 0));
+    std::string ndjson;
+    for (int i = 0; i < 1000; ++i) {
+        ndjson += "{\"id\":" + std::to_string(i) + ",\"tags\":[\"x\",\"y\"]}\n";
+    }
+    EXPECT_EQ_INT(true, (write(fd, ndjson.data(), ndjson.size()) ==
+                         static_cast<ssize_t>(ndjson.size())));
+    close(fd);
+    tihi::JsonStreamReader reader(1024);
+    // 缓冲区会被复用, 不能借用其中的字符串
+    reader.context().borrow_strings = true;
+    double sum = 0;
+    tihi::JsonValue::ptr first;
+    EXPECT_EQ_INT(tihi::Json::PARSE_OK,
+                  reader.parse_file(path, [&](tihi::JsonValue::ptr v) {
+                      sum += v->get_value_from_obj_by_string("id")->get_number();
+                      if (!first) {
+                          first = v;
+                      }
+                      return true;
+                  }));
+    EXPECT_EQ_SIZE_T(1000, reader.documents());
+    EXPECT_EQ_DOUBLE(499500.0, sum);
+    EXPECT_EQ_INT(false, reader.context().borrow_strings);
+    const tihi::JsonValue::ptr& tag =
+        first->get_value_from_obj_by_string("tags")->get_vec()[1];
+    EXPECT_EQ_INT(false, tag->is_borrowed());
+    EXPECT_EQ_STR("y", tag->get_str(), tag->get_str_size());
+    unlink(path);
+    EXPECT_EQ_INT(tihi::Json::PARSE_READ_ERROR,
+                  reader.parse_file(path, [](tihi::JsonValue::ptr) {
+                      return true;
+                  }));
+}
+
+// 两个 gzip 成员 / 两个 zstd 帧首尾相接, 解压后为
+// {"id":1,"v":[1,2]}\n{"id":2,"v":"x"}\n 和 [3]\n
+static const unsigned char GZIP_NDJSON[] = {
+    0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x03,
+    0xab, 0x56, 0xca, 0x4c, 0x51, 0xb2, 0x32, 0xd4, 0x51, 0x2a,
+    0x53, 0xb2, 0x8a, 0x36, 0xd4, 0x31, 0x8a, 0xad, 0xe5, 0xaa,
+    0x06, 0x0b, 0x19, 0x81, 0x85, 0x94, 0x2a, 0x94, 0x6a, 0xb9,
+    0x00, 0x4d, 0x41, 0x46, 0xa9, 0x24, 0x00, 0x00, 0x00, 0x1f,
+    0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x03, 0x8b,
+    0x36, 0x8e, 0xe5, 0x02, 0x00, 0x71, 0xc6, 0xa5, 0xf4, 0x04,
+    0x00, 0x00, 0x00,
+};
+static const unsigned char ZSTD_NDJSON[] = {
+    0x28, 0xb5, 0x2f, 0xfd, 0x24, 0x24, 0x0d, 0x01, 0x00, 0xc8,
+    0x7b, 0x22, 0x69, 0x64, 0x22, 0x3a, 0x31, 0x2c, 0x22, 0x76,
+    0x22, 0x3a, 0x5b, 0x31, 0x2c, 0x32, 0x5d, 0x7d, 0x0a, 0x32,
+    0x22, 0x78, 0x22, 0x7d, 0x0a, 0x02, 0x00, 0x40, 0x88, 0x36,
+    0xcc, 0x30, 0x86, 0xab, 0xc8, 0x9c, 0x28, 0xb5, 0x2f, 0xfd,
+    0x24, 0x04, 0x21, 0x00, 0x00, 0x5b, 0x33, 0x5d, 0x0a, 0xb6,
+    0xa9, 0x5e, 0x69,
+};
+
+static void test_decompress_source() {
+    struct Case {
+        const unsigned char* data;
+        size_t size;
+        tihi::JsonDecompressSource::Codec codec;
+    };
+    const Case cases[] = {
+        {GZIP_NDJSON, sizeof(GZIP_NDJSON), tihi::JsonDecompressSource::CODEC_GZIP},
+        {ZSTD_NDJSON, sizeof(ZSTD_NDJSON), tihi::JsonDecompressSource::CODEC_ZSTD},
+    };
+    tihi::Json json;
+    for (const Case& c : cases) {
+        const std::string raw(reinterpret_cast<const char*>(c.data), c.size);
+        for (size_t step : {1, 5, 1024}) {
+            StringSource compressed(raw, step);
+            tihi::JsonDecompressSource source(compressed, 16);
+            tihi::JsonStreamReader reader(7);
+            std::vector<tihi::JsonValue::ptr> docs;
+            tihi::Json::STATUS ret =
+                reader.parse(source, [&](tihi::JsonValue::ptr v) {
+                    docs.push_back(v);
+                    return true;
+                });
+            if (!tihi::JsonDecompressSource::supported(c.codec)) {
+                EXPECT_EQ_INT(tihi::Json::PARSE_READ_ERROR, ret);
+                continue;
+            }
+            EXPECT_EQ_INT(tihi::Json::PARSE_OK, ret);
+            EXPECT_EQ_INT(c.codec, source.codec());
+            EXPECT_EQ_SIZE_T(3, docs.size());
+            if (docs.size() == 3) {
+                EXPECT_EQ_DOUBLE(2.0, docs[1]->get_value_from_obj_by_string("id")
+                                          ->get_number());
+                std::string out;
+                json.stringify(out, docs[2]);
+                EXPECT_EQ_STR("[3]", out, out.size());
+            }
+        }
+
+        /* 截断的压缩数据 */
+        if (tihi::JsonDecompressSource::supported(c.codec)) {
+            StringSource compressed(raw.substr(0, raw.size() / 2), 8);
+            tihi::JsonDecompressSource source(compressed);
+            char buf[256];
+            ssize_t n = 0;
+            while ((n = source.read(buf, sizeof(buf))) > 0) {
+            }
+            EXPECT_EQ_INT(-1, static_cast<int>(n));
+        }
+    }
+
+    /* 未压缩的输入原样透传 */
+    StringSource plain(" [1] 2", 1);
+    tihi::JsonDecompressSource source(plain);
+    tihi::JsonStreamReader reader(2);
+    EXPECT_EQ_INT(tihi::Json::PARSE_OK,
+                  reader.parse(source, [](tihi::JsonValue::ptr) { return true; }));
+    EXPECT_EQ_INT(tihi::JsonDecompressSource::CODEC_NONE, source.codec());
+    EXPECT_EQ_SIZE_T(2, reader.documents());
+}
+
+static void test_json_key() {
+    const tihi::Json json;
+    tihi::JsonContxt ctx;
+    tihi::JsonValue::ptr v = tihi::JsonValue::create();
+    std::string text = "{";
+    for (int i = 0; i < 50; ++i) {
+        text += "\"k" + std::to_string(i) + "\":" + std::to_string(i) + ",";
+    }
+    text += "\"\":-1}";
+    EXPECT_EQ_INT(tihi::Json::PARSE_OK, json.parse(text, v, ctx));
+    const tihi::JsonValue& obj = *v;
+
+    for (int i = 0; i < 50; ++i) {
+        tihi::JsonKey key("k" + std::to_string(i));
+        EXPECT_EQ_INT(true, (obj.get(key) != nullptr));
+        EXPECT_EQ_DOUBLE(double(i), obj.get(key)->get_number());
+        EXPECT_EQ_INT(true,
+                      (obj.get(key) == obj.get_value_from_obj_by_string(key.str())));
+    }
+    EXPECT_EQ_DOUBLE(-1.0, obj.get(tihi::JsonKey(""))->get_number());
+    EXPECT_EQ_INT(true, (obj.get(tihi::JsonKey("k50")) == nullptr));
+    EXPECT_EQ_INT(true, (obj.get_value_from_obj_by_string("nope") == nullptr));
+
+    const tihi::JsonKey keys[] = {tihi::JsonKey("k3"), tihi::JsonKey("x"),
+                                  tihi::JsonKey("k49")};
+    tihi::JsonValue* out[3];
+    EXPECT_EQ_SIZE_T(2, obj.get(keys, 3, out));
+    EXPECT_EQ_DOUBLE(3.0, out[0]->get_number());
+    EXPECT_EQ_INT(true, (out[1] == nullptr));
+    EXPECT_EQ_DOUBLE(49.0, out[2]->get_number());
+
+    tihi::JsonValue::ptr empty = tihi::JsonValue::create();
+    empty->set_obj(std::unordered_map<std::string, tihi::JsonValue::ptr>());
+    EXPECT_EQ_INT(true, (empty->get(keys[0]) == nullptr));
+}
+
+// 记录收到的事件, 用于检查 SAX 接口
+class EventRecorder : public tihi::JsonHandler {
+public:
+    bool null() override { return add("n"); }
+    bool boolean(bool b) override { return add(b ? "t" : "f"); }
+    bool number(double d) override { return add(std::to_string(int(d))); }
+    bool string(const std::string& s) override { return add('"' + s + '"'); }
+    bool start_object() override { return add("{"); }
+    bool key(const std::string& k) override { return add(k + ":"); }
+    bool end_object() override { return add("}"); }
+    bool start_array() override { return add("["); }
+    bool end_array() override { return add("]"); }
+
+    std::string events;
+    size_t limit = SIZE_MAX;  // 收到 limit 个事件后中止
+
+private:
+    bool add(const std::string& e) {
+        events += e + ' ';
+        return --limit > 0;
+    }
+};
+
+static void test_parse_handler() {
+    const tihi::Json json;
+    tihi::JsonContxt ctx;
+
+    EventRecorder rec;
+    EXPECT_EQ_INT(tihi::Json::PARSE_OK,
+                  json.parse(" [1, {\"a\": null, \"b\": [true, \"x\"]}, [], {}] ",
+                             rec, ctx));
+    EXPECT_EQ_INT(true, (rec.events ==
+                         "[ 1 { a: n b: [ t \"x\" ] } [ ] { } ] "));
+
+    // 语法错误与原来的解析一致
+    EventRecorder bad;
+    EXPECT_EQ_INT(tihi::Json::PARSE_MISS_COMMA_OR_SQUARE_BRACKET,
+                  json.parse("[1 2]", bad, ctx));
+    EXPECT_EQ_INT(tihi::Json::PARSE_ROOT_NOT_SINGULAR,
+                  json.parse("1 2", bad, ctx));
+
+    // 中止解析, 同时作为构造树时的 observer
+    EventRecorder stop;
+    stop.limit = 3;
+    ctx.observer = &stop;
+    tihi::JsonValue::ptr v = tihi::JsonValue::create();
+    EXPECT_EQ_INT(tihi::Json::PARSE_REJECTED,
+                  json.parse("[1, 2, 3, 4]", v, ctx));
+    EXPECT_EQ_INT(tihi::JsonValue::JSON_NULL, v->get_type());
+    EXPECT_EQ_INT(true, (stop.events == "[ 1 2 "));
+    EXPECT_EQ_SIZE_T(5, ctx.curr_pos);
+
+    EventRecorder all;
+    ctx.observer = &all;
+    EXPECT_EQ_INT(tihi::Json::PARSE_OK, json.parse("{\"k\":[false]}", v, ctx));
+    EXPECT_EQ_INT(tihi::JsonValue::JSON_OBJECT, v->get_type());
+    EXPECT_EQ_INT(true, (all.events == "{ k: [ f ] } "));
+
+    EventRecorder walk;
+    v->accept(walk);
+    EXPECT_EQ_INT(true, (walk.events == all.events));
+
+    // JsonStreamReader 逐块产生事件, 文档可以跨越块边界
+    const std::string stream =
+        "{\"s\":\"a\\u00e9\\ud83d\\ude00\\n\",\"n\":[-12,3e2]}\n7 [true]null";
+    for (size_t step : {1, 3, 64}) {
+        tihi::JsonStreamReader reader(4, 2);
+        StringSource source(stream, step);
+        EventRecorder events;
+        EXPECT_EQ_INT(tihi::Json::PARSE_OK, reader.parse(source, events));
+        EXPECT_EQ_SIZE_T(4, reader.documents());
+        EXPECT_EQ_INT(true, (events.events ==
+                             "{ s: \"a\xc3\xa9\xf0\x9f\x98\x80\n\" n: [ -12 300 ] } "
+                             "7 [ t ] n "));
+    }
+    {
+        tihi::JsonStreamReader reader(4, 2);
+        StringSource source("[1]\n[2,}", 2);
+        EventRecorder events;
+        EXPECT_EQ_INT(tihi::Json::PARSE_INVALID_VALUE,
+                      reader.parse(source, events));
+        EXPECT_EQ_SIZE_T(1, reader.documents());
+    }
+
+    // handler 抛出的异常传给调用方, 之后 reader 照常以回调方式使用
+    struct Throwing : EventRecorder {
+        bool number(double) override { throw std::runtime_error("number"); }
+    };
+    {
+        tihi::JsonStreamReader reader(4, 2);
+        StringSource source(stream, 3);
+        Throwing handler;
+        bool thrown = false;
+        try {
+            reader.parse(source, handler);
+        } catch (const std::runtime_error&) {
+            thrown = true;
+        }
+        EXPECT_EQ_INT(true, thrown);
+        StringSource again(stream, 3);
+        size_t n = 0;
+        EXPECT_EQ_INT(tihi::Json::PARSE_OK,
+                      reader.parse(again, [&](tihi::JsonValue::ptr) {
+                          return ++n > 0;
+                      }));
+        EXPECT_EQ_SIZE_T(4, n);
+    }
+}
+
+static tihi::JsonSchema::ptr compile_schema(const std::string& text,
+                                            std::string* error = nullptr) {
+    const tihi::Json json;
+    tihi::JsonContxt ctx;
+    tihi::JsonValue::ptr v = tihi::JsonValue::create();
+    if (json.parse(text, v, ctx) != tihi::Json::PARSE_OK) {
+        return nullptr;
+    }
+    return tihi::JsonSchema::compile(*v, error);
+}
+
+#define EXPECT_SCHEMA(expect, validator, text)                            \
+    do {                                                                  \
+        const tihi::Json json;                                            \
+        tihi::JsonContxt ctx;                                             \
+        tihi::Json::STATUS want =                                         \
+            expect ? tihi::Json::PARSE_OK : tihi::Json::PARSE_REJECTED;   \
+        EXPECT_EQ_INT(want, json.parse(text, validator, ctx));            \
+    } while (0)
+
+static void test_schema() {
+    tihi::JsonSchema::ptr schema = compile_schema(R"({
+        "type": "object",
+        "required": ["id", "tags"],
+        "additionalProperties": false,
+        "properties": {
+            "id": {"type": "integer", "minimum": 1},
+            "name": {"type": "string", "minLength": 2, "maxLength": 3,
+                     "pattern": "^[a-z]+$"},
+            "tags": {"type": "array", "items": {"$ref": "#/definitions/tag"},
+                     "maxItems": 2},
+            "kind": {"enum": ["a", "b", null]},
+            "ratio": {"type": "number", "exclusiveMaximum": 1,
+                      "multipleOf": 0.25}
+        },
+        "definitions": {"tag": {"type": "string"}}
+    })");
+    EXPECT_EQ_INT(true, (schema != nullptr));
+    tihi::JsonSchemaValidator v(schema);
+
+    EXPECT_SCHEMA(true, v, R"({"id": 1, "tags": []})");
+    EXPECT_SCHEMA(true, v, R"({"id": 2, "name": "ab", "tags": ["x", "y"],
+                               "kind": null, "ratio": 0.75})");
+    EXPECT_SCHEMA(false, v, R"({"id": 1.5, "tags": []})");
+    EXPECT_SCHEMA(false, v, R"({"id": 0, "tags": []})");
+    EXPECT_SCHEMA(false, v, R"({"id": 1})");
+    EXPECT_EQ_INT(true, (v.error() == "missing required property: tags"));
+    EXPECT_SCHEMA(false, v, R"({"id": 1, "tags": [], "name": "abcd"})");
+    EXPECT_SCHEMA(false, v, R"({"id": 1, "tags": [], "name": "AB"})");
+
+    /* 过长的字符串不交给 std::regex, 不会耗尽调用栈 */
+    tihi::JsonSchema::ptr word = compile_schema(R"({"pattern": "^(a|b)+$"})");
+    tihi::JsonSchemaValidator w(word);
+    std::string long_word = "\"" + std::string(1 << 20, 'a') + "\"";
+    EXPECT_SCHEMA(false, w, long_word);
+    EXPECT_EQ_INT(true, (w.error() == "too long to match pattern"));
+    EXPECT_SCHEMA(true, w,
+                  "\"" + std::string(w.max_pattern_bytes, 'b') + "\"");
+    EXPECT_SCHEMA(false, v, R"({"id": 1, "tags": [], "kind": "c"})");
+    EXPECT_SCHEMA(false, v, R"({"id": 1, "tags": [], "ratio": 1})");
+    EXPECT_SCHEMA(false, v, R"({"id": 1, "tags": [], "ratio": 0.3})");
+    EXPECT_SCHEMA(false, v, R"({"id": 1, "tags": ["a", "b", "c"]})");
+    EXPECT_SCHEMA(false, v, R"({"id": 1, "tags": ["a", 2]})");
+    EXPECT_EQ_INT(true, (v.error_path() == "/tags/1"));
+    EXPECT_SCHEMA(false, v, R"([])");
+
+    // 尽早失败: 多余的 key 出现时即停止, 不再看后面的内容
+    const tihi::Json json;
+    tihi::JsonContxt ctx;
+    ctx.observer = &v;
+    tihi::JsonValue::ptr value = tihi::JsonValue::create();
+    std::string text = R"({"id": 1, "x/y": [)";
+    text += std::string(10000, '[');
+    EXPECT_EQ_INT(tihi::Json::PARSE_REJECTED, json.parse(text, value, ctx));
+    EXPECT_EQ_SIZE_T(17, ctx.curr_pos);
+    EXPECT_EQ_INT(true, (v.error_path() == "/x~1y"));
+    EXPECT_EQ_INT(tihi::Json::PARSE_OK,
+                  json.parse(R"({"id": 3, "tags": ["z"]})", value, ctx));
+    EXPECT_EQ_INT(false, v.failed());
+
+    // 校验已有的树
+    EXPECT_EQ_INT(true, v.validate(*value));
+    value->set_number(1);
+    EXPECT_EQ_INT(false, v.validate(*value));
+}
+
+static void test_schema_combinators() {
+    tihi::JsonSchemaValidator any(compile_schema(R"({
+        "type": "array",
+        "items": {"anyOf": [{"type": "string"}, {"type": "integer"}]}
+    })"));
+    EXPECT_SCHEMA(true, any, R"(["a", 1, "b"])");
+    EXPECT_SCHEMA(false, any, R"(["a", 1.5])");
+    EXPECT_EQ_INT(true, (any.error() == "anyOf: no schema matched"));
+
+    tihi::JsonSchemaValidator one(compile_schema(R"({
+        "oneOf": [{"type": "number", "multipleOf": 3},
+                  {"type": "number", "multipleOf": 5}]
+    })"));
+    EXPECT_SCHEMA(true, one, "9");
+    EXPECT_SCHEMA(true, one, "10");
+    EXPECT_SCHEMA(false, one, "15");
+    EXPECT_SCHEMA(false, one, "7");
+
+    tihi::JsonSchemaValidator nots(compile_schema(R"({
+        "type": "object",
+        "not": {"required": ["secret"]},
+        "properties": {"p": {"allOf": [{"minimum": 0}, {"maximum": 9}]}}
+    })"));
+    EXPECT_SCHEMA(true, nots, R"({"p": 3})");
+    EXPECT_SCHEMA(false, nots, R"({"secret": 1})");
+    EXPECT_SCHEMA(false, nots, R"({"p": 10})");
+
+    // 嵌套在分支中的对象, 分支失败不影响其他分支
+    tihi::JsonSchemaValidator nested(compile_schema(R"({
+        "anyOf": [
+            {"type": "object", "properties": {"a": {"type": "string"}},
+             "required": ["a"]},
+            {"type": "object", "properties": {"a": {"type": "array",
+             "items": {"type": "integer"}}}}
+        ]
+    })"));
+    EXPECT_SCHEMA(true, nested, R"({"a": "s"})");
+    EXPECT_SCHEMA(true, nested, R"({"a": [1, 2]})");
+    EXPECT_SCHEMA(false, nested, R"({"a": [1, "x"]})");
+
+    // 递归引用
+    tihi::JsonSchemaValidator tree(compile_schema(R"({
+        "type": "object",
+        "properties": {"children": {"type": "array", "items": {"$ref": "#"}},
+                       "v": {"type": "integer"}}
+    })"));
+    EXPECT_SCHEMA(true, tree, R"({"v": 1, "children": [{"children": [{}]}]})");
+    EXPECT_SCHEMA(false, tree, R"({"children": [{"children": [{"v": "1"}]}]})");
+    EXPECT_EQ_INT(true, (tree.error_path() == "/children/0/children/0/v"));
+
+    tihi::JsonSchemaValidator tuple(compile_schema(R"({
+        "items": [{"type": "string"}, true], "additionalItems": false,
+        "minItems": 1
+    })"));
+    EXPECT_SCHEMA(true, tuple, R"(["a", {}])");
+    EXPECT_SCHEMA(false, tuple, R"([])");
+    EXPECT_SCHEMA(false, tuple, R"(["a", 1, 2])");
+    EXPECT_SCHEMA(true, tuple, "3");
+
+    std::string error;
+    EXPECT_EQ_INT(true, (compile_schema(R"({"uniqueItems": true})", &error) ==
+                         nullptr));
+    EXPECT_EQ_INT(true, (error == "unsupported keyword: uniqueItems"));
+    EXPECT_EQ_INT(true, (compile_schema(R"({"$ref": "#"})") == nullptr));
+    EXPECT_EQ_INT(true,
+                  (compile_schema(R"({"$ref": "#/missing"})") == nullptr));
+    EXPECT_EQ_INT(true, (compile_schema(R"({"type": "int"})") == nullptr));
+}
+
+// 依次执行查询, 结果序列化后以空格连接
+static std::string run_query(const std::string& expr, const std::string& text) {
+    const tihi::Json json;
+    tihi::JsonContxt ctx;
+    std::string out;
+    tihi::JsonQuery::ptr query = tihi::JsonQuery::compile(expr);
+    if (!query) {
+        return "<error>";
+    }
+    tihi::JsonQueryRunner runner(query, [&](const tihi::JsonValue::ptr& v) {
+        std::string s;
+        json.stringify(s, v, ctx);
+        out += s + ' ';
+        return true;
+    });
+    if (json.parse(text, runner, ctx) != tihi::Json::PARSE_OK) {
+        return "<parse error>";
+    }
+
+    // 对完整的树求值结果相同
+    tihi::JsonValue::ptr v = tihi::JsonValue::create();
+    json.parse(text, v, ctx);
+    std::string tree;
+    query->eval(v, [&](const tihi::JsonValue::ptr& r) {
+        std::string s;
+        json.stringify(s, r, ctx);
+        tree += s + ' ';
+        return true;
+    });
+    return tree == out ? out : "<mismatch>";
+}
+
+#define EXPECT_QUERY(expect, expr, text) \
+    EXPECT_EQ_INT(true, (run_query(expr, text) == expect))
+
+static void test_query() {
+    const std::string doc =
+        R"({"items": [{"id": 1, "price": 5, "tags": ["a"]},
+                      {"id": 2, "price": 20, "tags": ["b", "c"]},
+                      {"id": 3, "price": 11.5, "name": "x y"}],
+            "meta": {"a b": [true, null]}})";
+    EXPECT_QUERY("2 3 ", ".items[] | select(.price > 10) | .id", doc);
+    EXPECT_QUERY("1 ", ".items[] | select(.price <= 5) | .id", doc);
+    EXPECT_QUERY("2 ", ".items[] | select(.tags[] == \"c\") | .id", doc);
+    EXPECT_QUERY("3 ", ".items[] | select(.name) | .id", doc);
+    EXPECT_QUERY("1 3 ", ".items[] | select(.price != 20) | .id", doc);
+    EXPECT_QUERY("\"b\" \"c\" ", ".items[1].tags[]", doc);
+    EXPECT_QUERY("true null ", ".meta.\"a b\"[]", doc);
+    EXPECT_QUERY("true ", ".[\"meta\"][\"a b\"][0]", doc);
+    EXPECT_QUERY("5 ", ".items[0] | .price", doc);
+    EXPECT_QUERY("", ".items[5]", doc);
+    EXPECT_QUERY("", ".missing.x", doc);
+    EXPECT_QUERY("", ".items[] | select(.name > 1)", doc);
+    EXPECT_QUERY("1 ", "select(.meta.\"a b\"[0] == true) | .items[0].id", doc);
+    EXPECT_QUERY("7 ", ".", "7");
+
+    std::string error;
+    EXPECT_EQ_INT(true,
+                  (tihi::JsonQuery::compile(".a | select(.b >)", &error) == nullptr));
+    EXPECT_EQ_INT(false, error.empty());
+    EXPECT_EQ_INT(true, (tihi::JsonQuery::compile("a") == nullptr));
+    EXPECT_EQ_INT(true, (tihi::JsonQuery::compile(".a.") == nullptr));
+    EXPECT_EQ_INT(true, (tihi::JsonQuery::compile(".a[x]") == nullptr));
+
+    // NDJSON 流, 回调返回 false 时停止
+    std::string ndjson;
+    for (int i = 0; i < 100; ++i) {
+        ndjson += "{\"n\":" + std::to_string(i) + ",\"pad\":[[],{}]}\n";
+    }
+    size_t sum = 0;
+    tihi::JsonQueryRunner runner(
+        tihi::JsonQuery::compile("select(.n >= 90) | .n"),
+        [&](const tihi::JsonValue::ptr& v) {
+            sum += size_t(v->get_number());
+            return true;
+        });
+    tihi::JsonStreamReader reader(64, 2);
+    StringSource source(ndjson, 50);
+    EXPECT_EQ_INT(tihi::Json::PARSE_OK, reader.parse(source, runner));
+    EXPECT_EQ_SIZE_T(100, reader.documents());
+    EXPECT_EQ_SIZE_T(945, sum);
+    EXPECT_EQ_SIZE_T(10, runner.results());
+
+    tihi::JsonQueryRunner first(tihi::JsonQuery::compile(".n"),
+                                [](const tihi::JsonValue::ptr&) { return false; });
+    StringSource again(ndjson, 50);
+    EXPECT_EQ_INT(tihi::Json::PARSE_REJECTED, reader.parse(again, first));
+    EXPECT_EQ_INT(true, first.stopped());
+    EXPECT_EQ_SIZE_T(0, reader.documents());
+
+    // 单个远大于块的文档, 逐个元素得到结果
+    std::string big = "{\"items\":[";
+    for (int i = 0; i < 1000; ++i) {
+        big += (i == 0 ? "" : ",") + std::string("{\"n\":") + std::to_string(i) + "}";
+    }
+    big += "]}";
+    size_t total = 0;
+    tihi::JsonQueryRunner items(tihi::JsonQuery::compile(".items[] | .n"),
+                                [&](const tihi::JsonValue::ptr& v) {
+                                    total += size_t(v->get_number());
+                                    return true;
+                                });
+    StringSource whole(big, 50);
+    EXPECT_EQ_INT(tihi::Json::PARSE_OK, reader.parse(whole, items));
+    EXPECT_EQ_SIZE_T(1, reader.documents());
+    EXPECT_EQ_SIZE_T(1000, items.results());
+    EXPECT_EQ_SIZE_T(499500, total);
+}
+
+// 逐字节喂给 JsonMinifier, 结果应与一次处理相同
+static tihi::Json::STATUS minify_bytes(const std::string& in, std::string& out) {
+    tihi::JsonMinifier m;
+    out.clear();
+    for (char c : in) {
+        if (m.feed(&c, 1, &out) != tihi::Json::PARSE_OK) {
+            break;
+        }
+    }
+    return m.finish(&out);
+}
+
+static void test_minify() {
+    const char* valid[][2] = {
+        {" { \"a\" : [ 1 , -2.5e+3 , 0 , true , false , null ] ,\n"
+         "\t\"b c\" : { } , \"\" : [ ] } ",
+         "{\"a\":[1,-2.5e+3,0,true,false,null],\"b c\":{},\"\":[]}"},
+        {"\"x \\\" \\\\ \\/ \\u00e9 \\ud834\\udd1e \xE2\x82\xAC\"",
+         "\"x \\\" \\\\ \\/ \\u00e9 \\ud834\\udd1e \xE2\x82\xAC\""},
+        {" 0 ", "0"},
+        {"-0.0e-0", "-0.0e-0"},
+        {"[[[[]]],{\"z\":{\"y\":[]}}]", "[[[[]]],{\"z\":{\"y\":[]}}]"},
+    };
+    const tihi::Json json;
+    tihi::JsonContxt ctx;
+    for (const auto& v : valid) {
+        std::string out, bytes;
+        EXPECT_EQ_INT(tihi::Json::PARSE_OK, tihi::JsonMinifier::minify(v[0], out));
+        EXPECT_EQ_INT(true, (out == v[1]));
+        EXPECT_EQ_INT(tihi::Json::PARSE_OK, minify_bytes(v[0], bytes));
+        EXPECT_EQ_INT(true, (bytes == v[1]));
+
+        // 逐字节输入时产生的事件与 Json::parse 相同
+        EventRecorder expect, actual;
+        EXPECT_EQ_INT(tihi::Json::PARSE_OK, json.parse(v[0], expect, ctx));
+        tihi::JsonMinifier m;
+        m.handler = &actual;
+        for (const char* p = v[0]; *p != '\0'; ++p) {
+            m.feed(p, 1, nullptr);
+        }
+        EXPECT_EQ_INT(tihi::Json::PARSE_OK, m.finish(nullptr));
+        EXPECT_EQ_INT(true, (actual.events == expect.events));
+    }
+
+    // 错误与 Json::parse 一致
+    const char* invalid[] = {
+        "",        " ",         "nul",      "?",        "+0",      "-",
+        "1.",      "1e",        ".5",       "01",       "tru e",   "[1,]",
+        "[1 2",    "[",         "{",        "{1:1}",    "{\"a\"}", "{\"a\" 1}",
+        "{\"a\":", "{\"a\":1",  "{\"a\":1,}", "{\"a\":1 \"b\":2}", "[1]]",
+        "\"abc",   "\"\\v\"",   "\"\\u12g4\"", "\"\\ud800\"", "\"\\ud800\\u0041\"",
+        "\"a\x01\"", "1 2",     "nulls",    "[\"a\",nul]",
+    };
+    for (const char* in : invalid) {
+        tihi::JsonValue::ptr v = tihi::JsonValue::create();
+        tihi::Json::STATUS expect = json.parse(in, v, ctx);
+        std::string out;
+        EXPECT_EQ_INT(expect, tihi::JsonMinifier::minify(in, out));
+        EXPECT_EQ_INT(expect, minify_bytes(in, out));
+
+        EventRecorder rec;
+        tihi::JsonMinifier m;
+        m.handler = &rec;
+        tihi::Json::STATUS ret = m.feed(in, strlen(in), nullptr);
+        if (ret == tihi::Json::PARSE_OK) {
+            ret = m.finish(nullptr);
+        }
+        EXPECT_EQ_INT(expect, ret);
+    }
+
+    // 产生事件时解码数字, 超出范围时报错; handler 可以中止
+    {
+        EventRecorder rec;
+        tihi::JsonMinifier m;
+        m.handler = &rec;
+        EXPECT_EQ_INT(tihi::Json::PARSE_NUMBER_OUT_OF_RANGE,
+                      m.feed("[1e999]", 7, nullptr));
+        m.reset();
+        EXPECT_EQ_INT(tihi::Json::PARSE_OK, m.feed("-1e999", 6, nullptr));
+        EXPECT_EQ_INT(tihi::Json::PARSE_NUMBER_OUT_OF_RANGE, m.finish(nullptr));
+
+        EventRecorder stop;
+        stop.limit = 3;
+        m.reset();
+        m.handler = &stop;
+        EXPECT_EQ_INT(tihi::Json::PARSE_REJECTED,
+                      m.feed("[1, 2, 3, 4]", 12, nullptr));
+        EXPECT_EQ_INT(true, (stop.events == "[ 1 2 "));
+    }
+
+    // 多个文档, 只检查语法
+    tihi::JsonMinifier m;
+    m.multiple = true;
+    std::string in = "{\"a\" : 1}\n[ ]\"s\" 12 true{}";
+    std::string out;
+    EXPECT_EQ_INT(tihi::Json::PARSE_OK, m.feed(in.data(), 10, &out));
+    EXPECT_EQ_INT(tihi::Json::PARSE_OK,
+                  m.feed(in.data() + 10, in.size() - 10, &out));
+    EXPECT_EQ_INT(tihi::Json::PARSE_OK, m.finish(&out));
+    EXPECT_EQ_INT(true, (out == "{\"a\":1}\n[]\n\"s\"\n12\ntrue\n{}\n"));
+    EXPECT_EQ_SIZE_T(6, m.documents());
+
+    m.reset();
+    m.max_depth = 3;
+    EXPECT_EQ_INT(tihi::Json::PARSE_DEPTH_EXCEEDED, m.feed("[[[[", 4, nullptr));
+    EXPECT_EQ_SIZE_T(3, m.offset());
+    EXPECT_EQ_INT(tihi::Json::PARSE_DEPTH_EXCEEDED, m.finish(nullptr));
+
+    // 被切断的 UTF-8 序列
+    tihi::JsonMinifier u;
+    u.validate_utf8 = true;
+    const std::string euro = "\"\xE2\x82\xAC\"";
+    EXPECT_EQ_INT(tihi::Json::PARSE_OK, u.feed(euro.data(), 2, &out));
+    EXPECT_EQ_INT(tihi::Json::PARSE_OK, u.feed(euro.data() + 2, 1, &out));
+    EXPECT_EQ_INT(tihi::Json::PARSE_OK, u.feed(euro.data() + 3, 2, &out));
+    EXPECT_EQ_INT(tihi::Json::PARSE_OK, u.finish(&out));
+    u.reset();
+    EXPECT_EQ_INT(tihi::Json::PARSE_INVALID_UTF8, u.feed("\"\xC3\x28\"", 4, &out));
+    u.reset();
+    EXPECT_EQ_INT(tihi::Json::PARSE_OK, u.feed("\"\xE2\x82", 3, &out));
+    EXPECT_EQ_INT(tihi::Json::PARSE_INVALID_UTF8, u.finish(&out));
+}
+
+static void test_columns() {
+    const std::string input =
+        "[{\"id\": 1, \"price\": 2.5, \"name\": \"a\", \"ok\": true},\n"
+        " {\"id\": -3, \"name\": \"\", \"tags\": [1, {\"x\": 2}], \"ok\": null},\n"
+        " {\"price\": null, \"name\": \"b\\u00e9\", \"id\": 9007199254740991,"
+        " \"price\": 4}]";
+
+    tihi::Json json;
+    tihi::JsonContxt ctx;
+    tihi::JsonColumns cols;
+    size_t id = cols.add_column("id", tihi::JsonColumns::INT64);
+    size_t price = cols.add_column("price", tihi::JsonColumns::DOUBLE);
+    size_t name = cols.add_column("name", tihi::JsonColumns::STRING);
+    size_t ok = cols.add_column("ok", tihi::JsonColumns::BOOL);
+    EXPECT_EQ_SIZE_T(id, cols.add_column("id", tihi::JsonColumns::DOUBLE));
+    EXPECT_EQ_INT(tihi::Json::PARSE_OK, json.parse(input, cols, ctx));
+    EXPECT_EQ_SIZE_T(3, cols.rows());
+
+    const tihi::JsonColumns::Column& c_id = cols.column(id);
+    EXPECT_EQ_SIZE_T(3, c_id.ints.size());
+    EXPECT_EQ_INT(true, (c_id.ints[0] == 1 && c_id.ints[1] == -3 &&
+                         c_id.ints[2] == 9007199254740991LL));
+    EXPECT_EQ_SIZE_T(0, c_id.null_count);
+
+    // 重复的 key 以最后一个为准
+    const tihi::JsonColumns::Column& c_price = cols.column(price);
+    EXPECT_EQ_SIZE_T(3, c_price.doubles.size());
+    EXPECT_EQ_DOUBLE(2.5, c_price.doubles[0]);
+    EXPECT_EQ_DOUBLE(0.0, c_price.doubles[1]);
+    EXPECT_EQ_DOUBLE(4.0, c_price.doubles[2]);
+    EXPECT_EQ_INT(false, c_price.is_null(0));
+    EXPECT_EQ_INT(true, c_price.is_null(1));
+    EXPECT_EQ_INT(false, c_price.is_null(2));
+    EXPECT_EQ_SIZE_T(1, c_price.null_count);
+
+    const tihi::JsonColumns::Column& c_name = cols.column(name);
+    EXPECT_EQ_SIZE_T(4, c_name.offsets.size());
+    EXPECT_EQ_INT(true, (c_name.bytes == "ab\xC3\xA9"));
+    EXPECT_EQ_SIZE_T(1, c_name.offsets[1]);
+    EXPECT_EQ_SIZE_T(1, c_name.offsets[2]);
+    EXPECT_EQ_SIZE_T(4, c_name.offsets[3]);
+    EXPECT_EQ_SIZE_T(0, c_name.null_count);
+
+    const tihi::JsonColumns::Column* c_ok = cols.column("ok");
+    EXPECT_EQ_INT(true, (c_ok == &cols.column(ok)));
+    EXPECT_EQ_INT(true, (cols.column("tags") == nullptr));
+    EXPECT_EQ_SIZE_T(3, c_ok->bools.size());
+    EXPECT_EQ_INT(1, c_ok->bools[0]);
+    EXPECT_EQ_INT(true, c_ok->is_null(1));
+    EXPECT_EQ_INT(true, c_ok->is_null(2));
+    EXPECT_EQ_SIZE_T(2, c_ok->null_count);
+
+    /* 从树中提取, 结果相同 */
+    {
+        tihi::JsonValue::ptr v = tihi::JsonValue::create();
+        EXPECT_EQ_INT(tihi::Json::PARSE_OK, json.parse(input, v));
+        tihi::JsonColumns tree;
+        tree.add_column("id", tihi::JsonColumns::INT64);
+        tree.add_column("name", tihi::JsonColumns::STRING);
+        EXPECT_EQ_INT(true, tree.extract(*v));
+        EXPECT_EQ_SIZE_T(3, tree.rows());
+        EXPECT_EQ_INT(true, (tree.column(0).ints == c_id.ints));
+        EXPECT_EQ_INT(true, (tree.column(1).bytes == c_name.bytes));
+        EXPECT_EQ_INT(true, (tree.column(1).offsets == c_name.offsets));
+    }
+
+    /* 多个文档追加, 根为对象时是一行; 后加的列以空值补齐 */
+    {
+        tihi::JsonColumns nd;
+        nd.add_column("a", tihi::JsonColumns::INT64);
+        tihi::JsonStreamReader reader;
+        StringSource source("{\"a\":1}\n{\"b\":\"x\"}\n[{\"a\":2}]\n", 5);
+        EXPECT_EQ_INT(tihi::Json::PARSE_OK, reader.parse(source, nd));
+        EXPECT_EQ_SIZE_T(3, nd.rows());
+        EXPECT_EQ_INT(true, nd.column(0).is_null(1));
+        size_t b = nd.add_column("b", tihi::JsonColumns::STRING);
+        EXPECT_EQ_SIZE_T(3, nd.column(b).null_count);
+        EXPECT_EQ_SIZE_T(4, nd.column(b).offsets.size());
+        nd.clear();
+        EXPECT_EQ_SIZE_T(0, nd.rows());
+        EXPECT_EQ_SIZE_T(1, nd.column(b).offsets.size());
+        for (size_t i = 0; i < 9; ++i) {
+            EXPECT_EQ_INT(tihi::Json::PARSE_OK,
+                          json.parse(i % 2 ? "{\"a\":1}" : "{}", nd, ctx));
+        }
+        EXPECT_EQ_SIZE_T(9, nd.rows());
+        EXPECT_EQ_SIZE_T(2, nd.column(0).validity.size());
+        EXPECT_EQ_INT(0xaa, nd.column(0).validity[0]);
+        EXPECT_EQ_SIZE_T(5, nd.column(0).null_count);
+    }
+
+    /* 类型不符时中止 */
+    const char* invalid[] = {
+        "[{\"id\": 1.5}]",
+        "[{\"id\": 1e19}]",
+        "[{\"id\": 9007199254740992}]",
+        "[{\"id\": 9007199254740993}]",
+        "[{\"id\": -9007199254740993}]",
+        "[{\"id\": \"1\"}]",
+        "[{\"price\": true}]",
+        "[{\"name\": 1}]",
+        "[{\"ok\": 0}]",
+        "[{\"name\": [\"a\"]}]",
+        "[{\"id\": {}}]",
+        "[1]",
+        "[[]]",
+        "\"x\"",
+    };
+    for (const char* in : invalid) {
+        cols.clear();
+        EXPECT_EQ_INT(tihi::Json::PARSE_REJECTED, json.parse(in, cols, ctx));
+        EXPECT_EQ_INT(true, cols.failed());
+    }
+    cols.clear();
+    json.parse("[{\"id\": 1}, {\"price\": \"x\"}]", cols, ctx);
+    EXPECT_EQ_INT(true,
+                  (cols.error() == "row 1: field \"price\" must be a number"));
+    cols.clear();
+    json.parse("[{\"id\": 9007199254740993}]", cols, ctx);
+    EXPECT_EQ_INT(true, (cols.error() == "row 0: field \"id\" must be an "
+                                         "integer with magnitude below 2^53"));
+}
+
+static void test_packed() {
+    tihi::Json json;
+    tihi::JsonContxt ctx;
+    ctx.pack_numbers = true;
+    std::string out;
+
+    tihi::JsonValue::ptr v = tihi::JsonValue::create();
+    EXPECT_EQ_INT(tihi::Json::PARSE_OK,
+                  json.parse("{\"p\":[1,-2.5,0,1e+20],\"m\":[1,\"a\",2],"
+                             "\"n\":[[1,2],[3]],\"e\":[]}",
+                             v, ctx));
+    const tihi::JsonValue::ptr& p = v->get(tihi::JsonKey("p"));
+    EXPECT_EQ_INT(true, p->is_packed());
+    EXPECT_EQ_SIZE_T(4, p->get_packed().size());
+    EXPECT_EQ_SIZE_T(4, p->get_vec_size());
+    EXPECT_EQ_DOUBLE(-2.5, p->get_packed()[1]);
+    EXPECT_EQ_INT(false, v->get(tihi::JsonKey("m"))->is_packed());
+    EXPECT_EQ_SIZE_T(3, v->get(tihi::JsonKey("m"))->get_vec_size());
+    EXPECT_EQ_INT(false, v->get(tihi::JsonKey("e"))->is_packed());
+    const tihi::JsonValue::ptr& n = v->get(tihi::JsonKey("n"));
+    EXPECT_EQ_INT(false, n->is_packed());
+    EXPECT_EQ_INT(true, n->get_vec()[0]->is_packed());
+    EXPECT_EQ_INT(true, n->get_vec()[1]->is_packed());
+
+    EXPECT_EQ_INT(tihi::Json::STRINGIFY_OK, json.stringify(out, p, ctx));
+    EXPECT_EQ_STR("[1,-2.5,0,1e+20]", out, out.size());
+
+    /* 与不打包的数组相等, 哈希相同 */
+    tihi::JsonContxt plain_ctx;
+    tihi::JsonValue::ptr plain = tihi::JsonValue::create();
+    EXPECT_EQ_INT(tihi::Json::PARSE_OK,
+                  json.parse("[1,-2.5,-0,1e+20]", plain, plain_ctx));
+    EXPECT_EQ_INT(false, plain->is_packed());
+    EXPECT_EQ_SIZE_T(plain->hash(), p->hash());
+    EXPECT_EQ_INT(true, p->equals(*plain));
+    EXPECT_EQ_INT(true, plain->equals(*p));
+    tihi::JsonValue::ptr other = tihi::JsonValue::create();
+    other->set_packed(std::vector<double>{1, -2.5, 0, 1e20});
+    EXPECT_EQ_INT(true, other->equals(*p));
+    other->set_packed(std::vector<double>{1, -2.5, 0});
+    EXPECT_EQ_INT(false, other->equals(*p));
+    EXPECT_EQ_INT(false, other->equals(*plain));
+
+    /* 经 JsonDocument 修改时复制, 原文档不变 */
+    tihi::JsonDocument doc(v);
+    tihi::JsonDocument copy = doc.clone();
+    EXPECT_EQ_DOUBLE(-2.5, copy.find("/p/1")->get_number());
+    copy.mutate("/p/1")->set_number(7);
+    tihi::JsonValue::ptr null_value = tihi::JsonValue::create();
+    null_value->set_type(tihi::JsonValue::JSON_NULL);
+    EXPECT_EQ_INT(true, doc.set("/p/-", null_value));
+    json.stringify(out, copy.root()->get(tihi::JsonKey("p")), ctx);
+    EXPECT_EQ_STR("[1,7,0,1e+20]", out, out.size());
+    json.stringify(out, doc.root()->get(tihi::JsonKey("p")), ctx);
+    EXPECT_EQ_STR("[1,-2.5,0,1e+20,null]", out, out.size());
+
+    /* 共享打包数组的两个文档, 在其中一个中查找不会修改共享的数组 */
+    tihi::JsonValue::ptr shared = tihi::JsonValue::create();
+    EXPECT_EQ_INT(tihi::Json::PARSE_OK,
+                  json.parse("{\"a\":[1,2,3]}", shared, ctx));
+    tihi::JsonDocument first(shared);
+    tihi::JsonDocument second = first.clone();
+    const tihi::JsonValue::ptr& packed = shared->get(tihi::JsonKey("a"));
+    EXPECT_EQ_DOUBLE(2.0, first.find("/a/1")->get_number());
+    EXPECT_EQ_INT(true, packed->is_packed());
+    EXPECT_EQ_INT(true, (second.find("/a/1") == first.find("/a/1")));
+    EXPECT_EQ_SIZE_T(3, packed->get_packed().size());
+    EXPECT_EQ_INT(true, (second.root()->get(tihi::JsonKey("a")) == packed));
+    first.mutate("/a/1")->set_number(9);
+    EXPECT_EQ_INT(true, packed->is_packed());
+    json.stringify(out, second.root(), ctx);
+    EXPECT_EQ_STR("{\"a\":[1,2,3]}", out, out.size());
+    json.stringify(out, first.root(), ctx);
+    EXPECT_EQ_STR("{\"a\":[1,9,3]}", out, out.size());
+
+    /* 多个线程同时展开同一个打包数组, 得到同一份结果 */
+    tihi::JsonValue::ptr wide = tihi::JsonValue::create();
+    EXPECT_EQ_INT(tihi::Json::PARSE_OK, json.parse("[5,6,7,8]", wide, ctx));
+    const tihi::JsonValue* seen[4] = {nullptr, nullptr, nullptr, nullptr};
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 4; ++i) {
+        threads.emplace_back([&, i] {
+            const tihi::JsonValue& w = *wide;
+            seen[i] = w.get_vec()[3].get();
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    for (int i = 0; i < 4; ++i) {
+        EXPECT_EQ_INT(true, (seen[i] == wide->get_vec()[3].get()));
+    }
+    EXPECT_EQ_INT(true, wide->is_packed());
+
+    /* get_vec() 另外展开, 数组仍然打包; 增删元素时才就地展开 */
+    tihi::JsonValue::ptr q = tihi::JsonValue::create();
+    EXPECT_EQ_INT(tihi::Json::PARSE_OK, json.parse("[3,4]", q, ctx));
+    size_t h = q->hash();
+    EXPECT_EQ_INT(true, q->is_packed());
+    EXPECT_EQ_SIZE_T(2, q->get_vec().size());
+    EXPECT_EQ_INT(true, q->is_packed());
+    EXPECT_EQ_DOUBLE(4.0, q->get_vec()[1]->get_number());
+    EXPECT_EQ_INT(true, (q->get_vec()[1] == q->get_vec()[1]));
+    EXPECT_EQ_SIZE_T(h, q->hash());
+    q->push_back_vec(tihi::JsonValue::create());
+    EXPECT_EQ_INT(false, q->is_packed());
+    q->get_vec()[2]->set_number(5);
+    json.stringify(out, q, ctx);
+    EXPECT_EQ_STR("[3,4,5]", out, out.size());
+
+    /* 序列化缓存在 set_packed 后失效 */
+    tihi::JsonContxt cache_ctx;
+    cache_ctx.cache_subtrees = true;
+    cache_ctx.cache_min_bytes = 0;
+    tihi::JsonValue::ptr root = tihi::JsonValue::create();
+    EXPECT_EQ_INT(tihi::Json::PARSE_OK, json.parse("[[1,2],[3]]", root, ctx));
+    json.stringify(out, root, cache_ctx);
+    EXPECT_EQ_STR("[[1,2],[3]]", out, out.size());
+    root->get_vec()[1]->set_packed(std::vector<double>{4, 5});
+    json.stringify(out, root, cache_ctx);
+    EXPECT_EQ_STR("[[1,2],[4,5]]", out, out.size());
+
+    /* 去重时打包的数组整体共享 */
+    ctx.dedup = true;
+    EXPECT_EQ_INT(tihi::Json::PARSE_OK, json.parse("[[1,2],[1,2],[1]]", v, ctx));
+    const std::vector<tihi::JsonValue::ptr>& vec = v->get_vec();
+    EXPECT_EQ_INT(true, (vec[0] == vec[1]));
+    EXPECT_EQ_INT(false, (vec[0] == vec[2]));
+    EXPECT_EQ_INT(true, vec[0]->is_packed());
+}
+
+static void test_memory_usage() {
+    tihi::Json json;
+    tihi::JsonContxt ctx;
+    std::string out;
+
+    tihi::JsonValue::ptr v = tihi::JsonValue::create();
+    EXPECT_EQ_INT(tihi::Json::PARSE_OK,
+                  json.parse("{\"a\":[1,2,3,4,5],\"long key for heap\":"
+                             "\"a string longer than the inline buffer\","
+                             "\"o\":{\"x\":null,\"y\":[true,false]}}",
+                             v, ctx));
+    tihi::JsonMemoryUsage usage = v->memory_usage();
+    EXPECT_EQ_SIZE_T(13, usage.node_count);
+    EXPECT_EQ_INT(true, (usage.nodes >= 13 * sizeof(tihi::JsonValue)));
+    EXPECT_EQ_INT(true, (usage.strings >= 2 * 18));
+    EXPECT_EQ_INT(true, (usage.containers >= 7 * sizeof(tihi::JsonValue::ptr)));
+    EXPECT_EQ_INT(true, (usage.hash_tables > 0));
+    EXPECT_EQ_SIZE_T(0, usage.caches);
+    EXPECT_EQ_INT(true, (usage.slack > 0));
+    EXPECT_EQ_SIZE_T(usage.nodes + usage.strings + usage.containers +
+                         usage.hash_tables + usage.caches + usage.slack,
+                     usage.total());
+
+    /* 收缩后值不变, 多余的容量减少; 父指针仍然有效 */
+    tihi::JsonValue copy(*v);
+    tihi::JsonValue::ptr o = v->get(tihi::JsonKey("o"));
+    v->compact();
+    tihi::JsonMemoryUsage after = v->memory_usage();
+    EXPECT_EQ_SIZE_T(13, after.node_count);
+    EXPECT_EQ_INT(true, (after.slack < usage.slack));
+    EXPECT_EQ_INT(true, (after.total() < usage.total()));
+    EXPECT_EQ_INT(true, v->equals(copy));
+    EXPECT_EQ_INT(true, (v->get(tihi::JsonKey("o")) == o));
+
+    tihi::JsonContxt cache_ctx;
+    cache_ctx.cache_subtrees = true;
+    cache_ctx.cache_min_bytes = 0;
+    json.stringify(out, v, cache_ctx);
+    EXPECT_EQ_INT(true, (v->memory_usage().caches > 0));
+    v->get(tihi::JsonKey("a"))->get_vec()[4]->set_number(6);
+    json.stringify(out, v, cache_ctx);
+    tihi::JsonValue::ptr back = tihi::JsonValue::create();
+    EXPECT_EQ_INT(tihi::Json::PARSE_OK, json.parse(out, back, ctx));
+    EXPECT_EQ_DOUBLE(6.0, back->get(tihi::JsonKey("a"))->get_vec()[4]->get_number());
+
+    /* 共享的子树只计一次, 打包的数字按 8 字节计 */
+    ctx.dedup = true;
+    EXPECT_EQ_INT(tihi::Json::PARSE_OK,
+                  json.parse("[[1,2],[1,2],[1,2]]", v, ctx));
+    EXPECT_EQ_SIZE_T(4, v->memory_usage().node_count);
+    ctx.dedup = false;
+    ctx.pack_numbers = true;
+    EXPECT_EQ_INT(tihi::Json::PARSE_OK, json.parse("[1,2,3,4,5]", v, ctx));
+    v->compact();
+    usage = v->memory_usage();
+    EXPECT_EQ_SIZE_T(1, usage.node_count);
+    EXPECT_EQ_SIZE_T(5 * sizeof(double), usage.containers);
+    EXPECT_EQ_SIZE_T(0, usage.slack);
+}
+
+static void test_frozen() {
+    tihi::Json json;
+    tihi::JsonContxt ctx;
+    const std::string input =
+        "{\"db\":{\"host\":\"localhost\",\"port\":5432,\"replicas\":[]},"
+        "\"b\":true,\"a\":null,\"\":\"empty\",\"bb\":false,"
+        "\"list\":[1,\"two\",[3],{}],\"name\\u0000x\":\"nul\"}";
+    tihi::JsonValue::ptr v = tihi::JsonValue::create();
+    EXPECT_EQ_INT(tihi::Json::PARSE_OK, json.parse(input, v, ctx));
+
+    tihi::JsonFrozen::ptr doc = tihi::JsonFrozen::freeze(*v);
+    tihi::JsonFrozen::Value root = doc->root();
+    EXPECT_EQ_INT(tihi::JsonValue::JSON_OBJECT, root.get_type());
+    EXPECT_EQ_SIZE_T(7, root.size());
+    EXPECT_EQ_SIZE_T(v->memory_usage().node_count, doc->node_count());
+
+    /* 成员按 key 排序 */
+    EXPECT_EQ_STR("", root.key(0), root.key_size(0));
+    EXPECT_EQ_STR("a", root.key(1), root.key_size(1));
+    EXPECT_EQ_STR("b", root.key(2), root.key_size(2));
+    EXPECT_EQ_STR("bb", root.key(3), root.key_size(3));
+    EXPECT_EQ_STR("db", root.key(4), root.key_size(4));
+    EXPECT_EQ_STR("list", root.key(5), root.key_size(5));
+    EXPECT_EQ_SIZE_T(6, root.key_size(6));
+
+    tihi::JsonFrozen::Value port = root.get("db").get("port");
+    EXPECT_EQ_INT(true, static_cast<bool>(port));
+    EXPECT_EQ_DOUBLE(5432.0, port.get_number());
+    tihi::JsonFrozen::Value host = root.get(std::string("db")).get("host");
+    EXPECT_EQ_STR("localhost", host.get_str(), host.get_str_size());
+    EXPECT_EQ_INT(0, strcmp("localhost", host.get_str()));
+    EXPECT_EQ_SIZE_T(0, root.get("db").get("replicas").size());
+    EXPECT_EQ_STR("empty", root.get("").get_str(), root.get("").get_str_size());
+    EXPECT_EQ_INT(tihi::JsonValue::JSON_NULL, root.get("a").get_type());
+    EXPECT_EQ_INT(tihi::JsonValue::JSON_TRUE, root.get("b").get_type());
+    EXPECT_EQ_INT(tihi::JsonValue::JSON_FALSE, root.get("bb").get_type());
+    EXPECT_EQ_STR("nul", root.get("name\0x", 6).get_str(), 3);
+
+    /* 找不到, 类型不符和越界都返回无效的句柄 */
+    EXPECT_EQ_INT(false, static_cast<bool>(root.get("c")));
+    EXPECT_EQ_INT(false, static_cast<bool>(root.get("d")));
+    EXPECT_EQ_INT(false, static_cast<bool>(root.get("zzz")));
+    EXPECT_EQ_INT(false, static_cast<bool>(root.get("c").get("d")));
+    EXPECT_EQ_INT(false, static_cast<bool>(root.get("list").get("a")));
+    EXPECT_EQ_INT(false, static_cast<bool>(root.get("list")[4]));
+    EXPECT_EQ_INT(false, static_cast<bool>(root.get("db").get("replicas").get("x")));
+
+    tihi::JsonFrozen::Value list = root.get("list");
+    EXPECT_EQ_SIZE_T(4, list.size());
+    EXPECT_EQ_DOUBLE(1.0, list[0].get_number());
+    EXPECT_EQ_STR("two", list[1].get_str(), list[1].get_str_size());
+    EXPECT_EQ_DOUBLE(3.0, list[2][0].get_number());
+    EXPECT_EQ_INT(tihi::JsonValue::JSON_OBJECT, list[3].get_type());
+    EXPECT_EQ_SIZE_T(0, list[3].size());
+
+    /* 复制回 JsonValue 与原树相等 */
+    EXPECT_EQ_INT(true, root.thaw()->equals(*v));
+    EXPECT_EQ_INT(true, list.thaw()->equals(*v->get(tihi::JsonKey("list"))));
+
+    /* 打包的数组与标量根 */
+    ctx.pack_numbers = true;
+    EXPECT_EQ_INT(tihi::Json::PARSE_OK, json.parse("[[1.5,2],[]]", v, ctx));
+    doc = tihi::JsonFrozen::freeze(*v);
+    EXPECT_EQ_INT(true, v->get_vec()[0]->is_packed());
+    EXPECT_EQ_DOUBLE(2.0, doc->root()[0][1].get_number());
+    EXPECT_EQ_INT(true, doc->root().thaw()->equals(*v));
+    EXPECT_EQ_INT(tihi::Json::PARSE_OK, json.parse("\"s\"", v, ctx));
+    doc = tihi::JsonFrozen::freeze(*v);
+    EXPECT_EQ_STR("s", doc->root().get_str(), doc->root().get_str_size());
+
+    /* 多个线程同时读取 */
+    EXPECT_EQ_INT(tihi::Json::PARSE_OK, json.parse(input, v, ctx));
+    doc = tihi::JsonFrozen::freeze(*v);
+    std::vector<std::thread> threads;
+    std::vector<int> found(4, 0);
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&doc, &found, t]() {
+            for (int i = 0; i < 1000; ++i) {
+                tihi::JsonFrozen::Value p = doc->root().get("db").get("port");
+                found[t] += p && p.get_number() == 5432;
+            }
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    for (int t = 0; t < 4; ++t) {
+        EXPECT_EQ_INT(1000, found[t]);
+    }
+}
+
+static void test_stringify_iovec() {
+    tihi::Json json;
+    tihi::JsonContxt ctx;
+    const std::string blob(2000, 'b');
+
+    tihi::JsonValue::ptr v = tihi::JsonValue::create();
+    EXPECT_EQ_INT(tihi::Json::PARSE_OK,
+                  json.parse("[\"" + blob + "\",\"short\",\"" + blob +
+                                 "\",\"" + std::string(2000, 'e') +
+                                 "\\n\",{\"k\":\"" + blob + "\"},1.5,null]",
+                             v, ctx));
+    std::string expect;
+    EXPECT_EQ_INT(tihi::Json::STRINGIFY_OK, json.stringify(expect, v, ctx));
+
+    tihi::JsonIovec out;
+    EXPECT_EQ_INT(tihi::Json::STRINGIFY_OK, json.stringify(out, v, ctx));
+    EXPECT_EQ_SIZE_T(expect.size(), out.size());
+    EXPECT_EQ_INT(true, (out.to_string() == expect));
+    // 三个不需要转义的长字符串被引用, 需要转义的照常复制
+    EXPECT_EQ_SIZE_T(3 * blob.size(), out.referenced_bytes());
+    EXPECT_EQ_SIZE_T(7, out.iov().size());
+    const std::string& first = v->get_vec()[0]->get_str();
+    EXPECT_EQ_INT(true, (out.iov()[1].iov_base == first.data()));
+    EXPECT_EQ_SIZE_T(blob.size(), out.iov()[1].iov_len);
+
+    /* 任意位置的需要转义的字节都使字符串被复制 */
+    tihi::JsonValue::ptr one = tihi::JsonValue::create();
+    for (size_t pos : {0, 3, 7, 1001, 1023}) {
+        for (char c : {'\"', '\\', '\x01', '\x1f', ' ', '\x7f', '\x80'}) {
+            std::string str(1024, 'a');
+            str[pos] = c;
+            one->set_str(str);
+            json.stringify(out, one, ctx);
+            json.stringify(expect, one, ctx);
+            EXPECT_EQ_INT(true, (out.to_string() == expect));
+            size_t want = static_cast<uint8_t>(c) >= 0x20 && c != '\"' &&
+                                  c != '\\'
+                              ? str.size()
+                              : 0;
+            EXPECT_EQ_SIZE_T(want, out.referenced_bytes());
+        }
+    }
+    json.stringify(expect, v, ctx);
+
+    /* 缓存和并行设置不影响结果 */
+    ctx.cache_subtrees = true;
+    ctx.cache_min_bytes = 0;
+    ctx.stringify_threads = 4;
+    ctx.parallel_min_children = 1;
+    std::string cached;
+    json.stringify(cached, v, ctx);
+    EXPECT_EQ_INT(tihi::Json::STRINGIFY_OK, json.stringify(out, v, ctx));
+    EXPECT_EQ_INT(true, (out.to_string() == expect));
+    EXPECT_EQ_SIZE_T(3 * blob.size(), out.referenced_bytes());
+    ctx = tihi::JsonContxt();
+
+    /* 引用的片段超过 IOV_MAX 时分批写入 */
+    tihi::JsonValue::ptr many = tihi::JsonValue::create();
+    many->set_vec(std::vector<tihi::JsonValue::ptr>());
+    for (int i = 0; i < 1500; ++i) {
+        many->emplace_back().set_str("item" + std::to_string(i));
+    }
+    out.min_ref_bytes = 1;
+    EXPECT_EQ_INT(tihi::Json::STRINGIFY_OK, json.stringify(out, many, ctx));
+    EXPECT_EQ_INT(true, (out.iov().size() > 3000));
+    json.stringify(expect, many, ctx);
+
+    char path[] = "/tmp/tihijson_iovec_XXXXXX";
+    int fd = mkstemp(path);
+    EXPECT_EQ_INT(true, (fd >= 0));
+    EXPECT_EQ_INT(true, out.write(fd));
+    std::string back(expect.size() + 1, '\0');
+    EXPECT_EQ_INT(true, (pread(fd, &back[0], back.size(), 0) ==
+                         static_cast<ssize_t>(expect.size())));
+    back.resize(expect.size());
+    EXPECT_EQ_INT(true, (back == expect));
+    close(fd);
+    unlink(path);
+
+    EXPECT_EQ_INT(tihi::Json::STRINGIFY_ERROR,
+                  json.stringify(out, tihi::JsonValue::ptr(), ctx));
+    EXPECT_EQ_SIZE_T(0, out.size());
+}
+
+static void test_borrowed_strings() {
+    tihi::Json json;
+    tihi::JsonContxt ctx;
+    ctx.borrow_strings = true;
+    const std::string in =
+        "{\"plain\":\"hello\",\"esc\":\"a\\\"b\\\\c\\u00e9\\ud834\\udd1e\","
+        "\"empty\":\"\",\"arr\":[\"x\",\"y\\n\",1]}";
+
+    tihi::JsonValue::ptr v = tihi::JsonValue::create();
+    EXPECT_EQ_INT(tihi::Json::PARSE_OK, json.parse(in, v, ctx));
+    tihi::JsonValue::ptr plain = v->get_value_from_obj_by_string("plain");
+    tihi::JsonValue::ptr esc = v->get_value_from_obj_by_string("esc");
+    tihi::JsonValue::ptr empty = v->get_value_from_obj_by_string("empty");
+    EXPECT_EQ_INT(true, plain->is_borrowed());
+    EXPECT_EQ_INT(true, esc->is_borrowed());
+    EXPECT_EQ_INT(true, empty->is_borrowed());
+
+    /* 不含转义的字符串直接指向输入 */
+    EXPECT_EQ_INT(true, (plain->get_str_data() == in.data() + 10));
+    EXPECT_EQ_SIZE_T(5, plain->get_str_size());
+    EXPECT_EQ_INT(true, plain->is_borrowed());
+    EXPECT_EQ_SIZE_T(0, empty->get_str_size());
+
+    /* 与不借用时解析的结果相同 */
+    tihi::JsonContxt owned_ctx;
+    tihi::JsonValue::ptr owned = tihi::JsonValue::create();
+    EXPECT_EQ_INT(tihi::Json::PARSE_OK, json.parse(in, owned, owned_ctx));
+    EXPECT_EQ_INT(false,
+                  owned->get_value_from_obj_by_string("esc")->is_borrowed());
+    EXPECT_EQ_SIZE_T(owned->hash(), v->hash());
+    EXPECT_EQ_INT(true, v->equals(*owned));
+    std::string expect, actual;
+    json.stringify(expect, owned, owned_ctx);
+    json.stringify(actual, v, ctx);
+    EXPECT_EQ_INT(true, (actual == expect));
+    EXPECT_EQ_INT(true, esc->is_borrowed());
+
+    /* 含转义的字符串在取值时另外解码一份, 节点仍然借用 */
+    EXPECT_EQ_STR("a\"b\\c\xC3\xA9\xF0\x9D\x84\x9E", esc->get_str(),
+                  esc->get_str_size());
+    EXPECT_EQ_INT(true, esc->is_borrowed());
+    EXPECT_EQ_INT(true, (esc->get_str_data() == esc->get_str().data()));
+    EXPECT_EQ_INT(true, v->equals(*owned));
+
+    /* 多个线程同时取值, 得到同一份解码结果 */
+    const char* decoded[4] = {nullptr, nullptr, nullptr, nullptr};
+    size_t sizes[4] = {0, 0, 0, 0};
+    {
+        tihi::JsonValue::ptr arr = v->get_value_from_obj_by_string("arr");
+        std::vector<std::thread> threads;
+        for (int i = 0; i < 4; ++i) {
+            threads.emplace_back([&, i] {
+                const tihi::JsonValue& y = *arr->get_vec()[1];
+                sizes[i] = y.get_str_size();
+                decoded[i] = y.get_str().data();
+            });
+        }
+        for (auto& t : threads) {
+            t.join();
+        }
+        for (int i = 0; i < 4; ++i) {
+            EXPECT_EQ_SIZE_T(2, sizes[i]);
+            EXPECT_EQ_INT(true, (decoded[i] == decoded[0]));
+        }
+        EXPECT_EQ_STR("y\n", arr->get_vec()[1]->get_str(), 2);
+        EXPECT_EQ_INT(true, arr->get_vec()[1]->is_borrowed());
+    }
+
+    /* 修改后不再借用 */
+    plain->set_str("world");
+    EXPECT_EQ_INT(false, plain->is_borrowed());
+    EXPECT_EQ_STR("world", plain->get_str(), plain->get_str_size());
+
+    /* 复制的节点与原节点借用同一段输入 */
+    tihi::JsonValue copy(*empty);
+    EXPECT_EQ_INT(true, copy.is_borrowed());
+    EXPECT_EQ_INT(true, copy.equals(*empty));
+
+    /* compact 之后输入可以释放 */
+    std::string temp = "[\"abc\",\"d\\te\",[\"fgh\"]]";
+    tihi::JsonValue::ptr t = tihi::JsonValue::create();
+    EXPECT_EQ_INT(tihi::Json::PARSE_OK, json.parse(temp, t, ctx));
+    EXPECT_EQ_INT(true, t->get_vec()[0]->is_borrowed());
+    t->compact();
+    temp.assign(temp.size(), 'z');
+    EXPECT_EQ_INT(false, t->get_vec()[0]->is_borrowed());
+    EXPECT_EQ_INT(false, t->get_vec()[2]->get_vec()[0]->is_borrowed());
+    json.stringify(actual, t, ctx);
+    EXPECT_EQ_STR("[\"abc\",\"d\\te\",[\"fgh\"]]", actual, actual.size());
+
+    /* 语法错误与不借用时相同 */
+    for (const char* bad : {"\"abc", "\"\\v\"", "\"\x01\"", "\"\\u12\"",
+                            "\"\\ud800\"", "[\"a\",\"\\ud800\\u0041\"]"}) {
+        tihi::JsonValue::ptr r = tihi::JsonValue::create();
+        EXPECT_EQ_INT(json.parse(bad, r, owned_ctx), json.parse(bad, r, ctx));
+    }
+
+    /* 设置 observer 时 handler 收到解码后的字符串 */
+    std::vector<std::string> seen;
+    struct Collect : public tihi::JsonHandler {
+        std::vector<std::string>* out;
+        bool string(const std::string& s) override {
+            out->push_back(s);
+            return true;
+        }
+    } collect;
+    collect.out = &seen;
+    ctx.observer = &collect;
+    const std::string pq = "[\"p\",\"q\\/r\"]";
+    EXPECT_EQ_INT(tihi::Json::PARSE_OK, json.parse(pq, t, ctx));
+    EXPECT_EQ_SIZE_T(2, seen.size());
+    EXPECT_EQ_INT(true, (seen.size() == 2 && seen[1] == "q/r"));
+    ctx.observer = nullptr;
+
+    /* 交给 handler 的字符串已解码 */
+    EXPECT_EQ_INT(tihi::Json::PARSE_OK, json.parse(in, v, ctx));
+    seen.clear();
+    EXPECT_EQ_INT(true, v->get_value_from_obj_by_string("arr")->accept(collect));
+    EXPECT_EQ_INT(true, (seen.size() == 2 && seen[1] == "y\n"));
+}
+
+static void test_parse_cache() {
+    tihi::JsonParseCache cache;
+    tihi::JsonContxt ctx;
+    const std::string body = "{\"a\":[1,2,3],\"s\":\"x\"}";
+
+    /* 相同的输入共享同一棵树 */
+    tihi::JsonDocument d1, d2;
+    EXPECT_EQ_INT(tihi::Json::PARSE_OK, cache.parse(body, d1, ctx));
+    EXPECT_EQ_INT(tihi::Json::PARSE_OK,
+                  cache.parse(std::string(body), d2, ctx));
+    EXPECT_EQ_INT(true, (d1.root() == d2.root()));
+    EXPECT_EQ_SIZE_T(1, cache.size());
+    EXPECT_EQ_SIZE_T(1, cache.hits());
+    EXPECT_EQ_SIZE_T(1, cache.misses());
+    EXPECT_EQ_DOUBLE(2.0, d1.find("/a/1")->get_number());
+
+    /* 修改是写时复制的, 不影响缓存中的树 */
+    tihi::JsonValue::ptr n = tihi::JsonValue::create();
+    n->set_number(5);
+    EXPECT_EQ_INT(true, d1.set("/a/1", n));
+    EXPECT_EQ_DOUBLE(2.0, d2.find("/a/1")->get_number());
+    tihi::JsonDocument d3;
+    cache.parse(body, d3, ctx);
+    EXPECT_EQ_INT(true, (d3.root() == d2.root()));
+    EXPECT_EQ_DOUBLE(2.0, d3.find("/a/1")->get_number());
+
+    /* 不同的输入, 以及失败的解析不缓存 */
+    cache.parse(body + " ", d3, ctx);
+    EXPECT_EQ_INT(false, (d3.root() == d2.root()));
+    EXPECT_EQ_INT(true, d3.root()->equals(*d2.root()));
+    EXPECT_EQ_INT(tihi::Json::PARSE_MISS_COMMA_OR_SQUARE_BRACKET,
+                  cache.parse("[1", d3, ctx));
+    EXPECT_EQ_SIZE_T(2, cache.size());
+
+    /* 缓存的树不打包数字也不借用输入, ctx 的设置保持不变 */
+    ctx.pack_numbers = true;
+    ctx.borrow_strings = true;
+    cache.parse("[4,5,\"y\"]", d3, ctx);
+    EXPECT_EQ_INT(false, d3.root()->is_packed());
+    EXPECT_EQ_INT(false, d3.root()->get_vec()[2]->is_borrowed());
+    EXPECT_EQ_INT(true, (ctx.pack_numbers && ctx.borrow_strings));
+    ctx = tihi::JsonContxt();
+
+    /* 选项不同的调用方不会命中彼此的结果 */
+    size_t entries = cache.size();
+    EXPECT_EQ_INT(tihi::Json::PARSE_OK, cache.parse("[[[[1]]]]", d3, ctx));
+    tihi::JsonContxt strict;
+    strict.max_depth = 2;
+    EXPECT_EQ_INT(tihi::Json::PARSE_DEPTH_EXCEEDED,
+                  cache.parse("[[[[1]]]]", d3, strict));
+    EXPECT_EQ_INT(tihi::Json::PARSE_OK, cache.parse("\"\xff\"", d3, ctx));
+    strict = tihi::JsonContxt();
+    strict.validate_utf8 = true;
+    EXPECT_EQ_INT(tihi::Json::PARSE_INVALID_UTF8,
+                  cache.parse("\"\xff\"", d3, strict));
+    tihi::JsonDocument d4;
+    strict = tihi::JsonContxt();
+    strict.dedup = true;
+    EXPECT_EQ_INT(tihi::Json::PARSE_OK, cache.parse("[[1],[1]]", d3, ctx));
+    EXPECT_EQ_INT(tihi::Json::PARSE_OK, cache.parse("[[1],[1]]", d4, strict));
+    EXPECT_EQ_INT(false, (d3.root() == d4.root()));
+    EXPECT_EQ_INT(true, (d4.find("/0") == d4.find("/1")));
+    EXPECT_EQ_SIZE_T(entries + 4, cache.size());
+
+    /* 设置了 observer 时总是解析, 不使用缓存 */
+    EventRecorder rec;
+    strict = tihi::JsonContxt();
+    strict.observer = &rec;
+    EXPECT_EQ_INT(tihi::Json::PARSE_OK, cache.parse("[[1],[1]]", d4, strict));
+    EXPECT_EQ_INT(false, (d3.root() == d4.root()));
+    EXPECT_EQ_INT(true, (rec.events == "[ [ 1 ] [ 1 ] ] "));
+    EXPECT_EQ_SIZE_T(entries + 4, cache.size());
+
+    /* 超出上限时淘汰最近最少使用的结果 */
+    cache.clear();
+    EXPECT_EQ_SIZE_T(0, cache.bytes());
+    cache.parse("[1]", d3, ctx);
+    size_t entry = cache.bytes();
+    cache.set_max_bytes(entry * 2 + entry / 2);
+    cache.parse("[2]", d3, ctx);
+    cache.parse("[1]", d3, ctx);
+    cache.parse("[3]", d3, ctx);
+    EXPECT_EQ_SIZE_T(2, cache.size());
+    size_t misses = cache.misses();
+    cache.parse("[1]", d3, ctx);
+    EXPECT_EQ_SIZE_T(misses, cache.misses());
+    cache.parse("[2]", d3, ctx);
+    EXPECT_EQ_SIZE_T(misses + 1, cache.misses());
+    EXPECT_EQ_INT(true, (cache.bytes() <= cache.max_bytes()));
+
+    /* 单个结果超过上限时照常返回, 但不缓存 */
+    cache.set_max_bytes(entry / 2);
+    EXPECT_EQ_SIZE_T(0, cache.size());
+    EXPECT_EQ_INT(tihi::Json::PARSE_OK, cache.parse("[1]", d3, ctx));
+    EXPECT_EQ_DOUBLE(1.0, d3.find("/0")->get_number());
+    EXPECT_EQ_SIZE_T(0, cache.size());
+
+    /* 多个线程同时使用 */
+    cache.set_max_bytes(64 << 20);
+    std::vector<std::thread> threads;
+    std::vector<int> ok(4, 0);
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&cache, &ok, t]() {
+            tihi::JsonContxt tctx;
+            tihi::JsonDocument doc;
+            for (int i = 0; i < 200; ++i) {
+                std::string in = "[" + std::to_string(i % 10) + "]";
+                if (cache.parse(in, doc, tctx) == tihi::Json::PARSE_OK &&
+                    doc.find("/0")->get_number() == i % 10) {
+                    ++ok[t];
+                }
+            }
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    for (int t = 0; t < 4; ++t) {
+        EXPECT_EQ_INT(200, ok[t]);
+    }
+    EXPECT_EQ_SIZE_T(10, cache.size());
+
+    /* 命中的树在两个线程中同时 hash(), 哈希已在缓存前算好 */
+    const std::string shared_body = "{\"k\":[{\"x\":1},[2,3],\"s\"]}";
+    tihi::JsonDocument warm;
+    EXPECT_EQ_INT(tihi::Json::PARSE_OK, cache.parse(shared_body, warm, ctx));
+    tihi::JsonValue::ptr fresh = tihi::JsonValue::create();
+    EXPECT_EQ_INT(tihi::Json::PARSE_OK,
+                  tihi::Json().parse(shared_body, fresh, ctx));
+    size_t hashes[2] = {0, 0};
+    bool equal[2] = {false, false};
+    threads.clear();
+    for (int t = 0; t < 2; ++t) {
+        threads.emplace_back([&, t]() {
+            tihi::JsonContxt tctx;
+            tihi::JsonDocument doc;
+            if (cache.parse(shared_body, doc, tctx) == tihi::Json::PARSE_OK) {
+                hashes[t] = doc.root()->hash();
+                equal[t] = doc.root()->equals(*warm.root());
+            }
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    EXPECT_EQ_SIZE_T(fresh->hash(), hashes[0]);
+    EXPECT_EQ_SIZE_T(fresh->hash(), hashes[1]);
+    EXPECT_EQ_INT(true, (equal[0] && equal[1]));
+}
+
 #define TEST_ROUNDTRIP(json1)                                                     \
     do {                                                                    \
         tihi::JsonValue::ptr json_value =                                   \
@@ -457,6 +2480,7 @@ static void test_stringify_string() {
     TEST_ROUNDTRIP("\"Hello\\nWorld\"");
     TEST_ROUNDTRIP("\"\\\" \\\\ / \\b \\f \\n \\r \\t\"");
     TEST_ROUNDTRIP("\"Hello\\u0000World\"");
+    TEST_ROUNDTRIP("\"\xE2\x82\xAC\"");
 }
 
 static void test_stringify_array() {
@@ -466,6 +2490,7 @@ static void test_stringify_array() {
 
 static void test_stringify_object() {
     TEST_ROUNDTRIP("{}");
+    TEST_ROUNDTRIP("{\"a\\\"b\":1}");
     TEST_ROUNDTRIP("{\"n\":null,\"f\":false,\"t\":true,\"i\":123,\"s\":\"abc\",\"a\":[1,2,3],\"o\":{\"1\":1,\"2\":2,\"3\":3}}");
 }
 
@@ -495,6 +2520,31 @@ static void test() {
     test_parse_miss_key();
     test_parse_miss_colon();
     test_parse_miss_comma_or_curly_bracket();
+    test_parse_deep_nesting();
+    test_parse_concurrent();
+    test_parse_allocator();
+    test_profile_stats();
+    test_utf8_validate();
+    test_document_cow();
+    test_builder();
+    test_stringify_cache();
+    test_hash_equals();
+    test_stringify_parallel();
+    test_stream_reader();
+    test_decompress_source();
+    test_json_key();
+    test_parse_handler();
+    test_schema();
+    test_schema_combinators();
+    test_query();
+    test_minify();
+    test_columns();
+    test_packed();
+    test_memory_usage();
+    test_frozen();
+    test_stringify_iovec();
+    test_borrowed_strings();
+    test_parse_cache();
 
     test_stringify();
 }
@@ -0,0 +1,95 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../src/tihijson_minify.h"
+#include "../src/tihijson_stream.h"
+
+// 去掉 JSON 中的空白并检查语法, 不构造树, 输入按块流式处理
+//
+// 用法: tihijson-minify [-c] [-m] [-u] [文件...]
+//   -c  只检查语法, 不输出
+//   -m  输入为多个文档 (如 NDJSON), 每个文档输出一行
+//   -u  同时检查 UTF-8
+// 不指定文件或文件为 - 时读标准输入, gzip/zstd 压缩的输入自动解压.
+
+static bool minify(tihi::JsonMinifier& m, tihi::JsonChunkSource& source,
+                   bool check_only, const std::string& name) {
+    std::vector<char> buf(1 << 20);
+    std::string out;
+    std::string* dst = check_only ? nullptr : &out;
+    tihi::Json::STATUS status = tihi::Json::PARSE_OK;
+    for (;;) {
+        ssize_t n = source.read(buf.data(), buf.size());
+        if (n < 0) {
+            std::cerr << name << ": read error" << std::endl;
+            return false;
+        }
+        status = n == 0 ? m.finish(dst) : m.feed(buf.data(), n, dst);
+        if (!out.empty() &&
+            fwrite(out.data(), 1, out.size(), stdout) != out.size()) {
+            std::cerr << name << ": write error" << std::endl;
+            return false;
+        }
+        out.clear();
+        if (status != tihi::Json::PARSE_OK || n == 0) {
+            break;
+        }
+    }
+    if (status != tihi::Json::PARSE_OK) {
+        std::cerr << name << ": offset " << m.offset() << ": parse error "
+                  << status << std::endl;
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    bool check_only = false;
+    tihi::JsonMinifier m;
+    std::vector<std::string> files;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-c") == 0) {
+            check_only = true;
+        } else if (strcmp(argv[i], "-m") == 0) {
+            m.multiple = true;
+        } else if (strcmp(argv[i], "-u") == 0) {
+            m.validate_utf8 = true;
+        } else {
+            files.push_back(argv[i]);
+        }
+    }
+    if (files.empty()) {
+        files.push_back("-");
+    }
+
+    int ret = 0;
+    for (const auto& path : files) {
+        int fd = path == "-" ? 0 : ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            std::cerr << path << ": cannot open" << std::endl;
+            ret = 1;
+            continue;
+        }
+        tihi::JsonFdSource fd_source(fd);
+        tihi::JsonDecompressSource source(fd_source);
+        m.reset();
+        if (!minify(m, source, check_only, path)) {
+            ret = 1;
+        } else if (!check_only && !m.multiple) {
+            putchar('\n');
+        }
+        if (fd != 0) {
+            ::close(fd);
+        }
+    }
+    if (fflush(stdout) != 0) {
+        ret = 1;
+    }
+    return ret;
+}
@@ -0,0 +1,83 @@
+#include <stdio.h>
+
+#include <iostream>
+#include <string>
+
+#include "../src/tihijson_query.h"
+#include "../src/tihijson_stream.h"
+
+// 对大 JSON 文件或 NDJSON 流执行查询, 每个结果输出一行 JSON
+//
+// 用法: tihijson-query 表达式 [文件...]
+// 例如: tihijson-query '.items[] | select(.price > 10) | .id' log.ndjson.gz
+// 不指定文件或文件为 - 时读标准输入, gzip/zstd 压缩的输入自动解压.
+// 输入边读边匹配, 只为匹配到的值构造 JsonValue. 表达式的语法见
+// src/tihijson_query.h
+
+static bool flush(std::string& out) {
+    bool ok = fwrite(out.data(), 1, out.size(), stdout) == out.size();
+    out.clear();
+    return ok;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::cerr << "usage: " << argv[0] << " expression [file...]"
+                  << std::endl;
+        return 2;
+    }
+
+    std::string error;
+    tihi::JsonQuery::ptr query = tihi::JsonQuery::compile(argv[1], &error);
+    if (!query) {
+        std::cerr << argv[0] << ": " << error << std::endl;
+        return 2;
+    }
+
+    const tihi::Json json;
+    tihi::JsonContxt ctx;
+    std::string line;
+    std::string out;
+    bool write_ok = true;
+    tihi::JsonQueryRunner runner(query, [&](const tihi::JsonValue::ptr& v) {
+        json.stringify(line, v, ctx);
+        out += line;
+        out += '\n';
+        if (out.size() >= (1 << 16)) {
+            write_ok = flush(out);
+        }
+        return write_ok;
+    });
+
+    int ret = 0;
+    tihi::JsonStreamReader reader;
+    for (int i = 2; i < argc || i == 2; ++i) {
+        std::string path = i < argc ? argv[i] : "-";
+        tihi::Json::STATUS status;
+        if (path == "-") {
+            tihi::JsonFdSource fd(0);
+            tihi::JsonDecompressSource source(fd);
+            status = reader.parse(source, runner);
+        } else {
+            status = reader.parse_file(path, runner);
+        }
+
+        if (runner.stopped()) {
+            break;
+        }
+        if (status == tihi::Json::PARSE_READ_ERROR) {
+            std::cerr << path << ": read error" << std::endl;
+            ret = 1;
+        } else if (status != tihi::Json::PARSE_OK) {
+            std::cerr << path << ": document " << reader.documents()
+                      << ": parse error " << status << std::endl;
+            ret = 1;
+        }
+    }
+
+    if (!flush(out) || !write_ok || fflush(stdout) != 0) {
+        std::cerr << argv[0] << ": write error" << std::endl;
+        ret = 1;
+    }
+    return ret;
+}